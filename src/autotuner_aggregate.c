@@ -0,0 +1,399 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Small-write aggregation.  Datasets created while an "aggregate" rule
+ * applies get a write buffer of the rule's size.  An independent H5Dwrite of
+ * one hyperslab block from a contiguous memory buffer (or, with H5S_ALL as
+ * the memory space, from the same block of a buffer with the extent of the
+ * dataset) is copied into it instead of being written, as long as the block
+ * continues the buffered one along the first (slowest) dimension with the
+ * same extent in the others.
+ * The merged block is then still one hyperslab, and the buffered data is in
+ * its row-major order, so it is written with a single H5Dwrite.
+ *
+ * The buffer is written when the next block does not fit or does not
+ * continue it, before a write that cannot be buffered, before an H5Dread or
+ * H5Dset_extent of the dataset, and at H5Dclose, H5Fflush, H5Fclose and
+ * MPI_Finalize.  An error writing the buffer is returned by the call that
+ * wrote it.  Collective transfers are never buffered, since the ranks would
+ * write their buffers at different times.
+ *
+ * Buffers are allocated at the first buffered write of a dataset and freed
+ * at H5Dclose.  A dataset whose buffer would take the process over
+ * H5TUNER_AGGREGATE_MAX bytes is written through.
+ */
+
+#include "autotuner_private.h"
+
+/* Default limit on the buffers of a process */
+#define AGGREGATE_DEF_MAX ((size_t)64 * 1024 * 1024)
+
+typedef struct aggregate_dset_t {
+    hid_t dset_id;
+    char *filename;
+    size_t capacity;
+    unsigned char *buf;         /* NULL until the first buffered write */
+    size_t nbytes;              /* Bytes buffered */
+    hid_t mem_type_id;          /* Memory type of the buffered data */
+    hid_t xfer_plist_id;        /* DXPL of the buffered writes */
+    int ndims;
+    hsize_t start[H5S_MAX_RANK];        /* Buffered block */
+    hsize_t count[H5S_MAX_RANK];
+} aggregate_dset_t;
+
+static aggregate_dset_t *aggregate_dsets_g = NULL;
+static size_t naggregate_dsets_g = 0;
+static size_t aggregate_dsets_alloc_g = 0;
+
+/* Bytes allocated for buffers, and the limit */
+static size_t aggregate_bytes_g = 0;
+static size_t aggregate_max_g = AGGREGATE_DEF_MAX;
+
+
+void set_aggregate(void)
+{
+    static int aggregate_set = 0;
+    char *aggregate_max = getenv("H5TUNER_AGGREGATE_MAX");
+
+    if(aggregate_set)
+        return;
+    aggregate_set = 1;
+
+    if(aggregate_max && *aggregate_max) {
+        long long max = strtoll(aggregate_max, NULL, 10);
+
+        if(max < 0)
+            DONE_ERROR("Invalid value for H5TUNER_AGGREGATE_MAX");
+        else
+            aggregate_max_g = (size_t)max;
+    }
+
+    return;
+}
+
+
+static aggregate_dset_t *aggregate_find(hid_t dset_id)
+{
+    size_t i;
+
+    for(i = 0; i < naggregate_dsets_g; i++)
+        if(aggregate_dsets_g[i].dset_id == dset_id)
+            return &aggregate_dsets_g[i];
+
+    return NULL;
+}
+
+
+herr_t aggregate_register(hid_t dset_id, size_t capacity)
+{
+    aggregate_dset_t *ad;
+    ssize_t filename_len;
+    herr_t ret_value = SUCCEED;
+
+    if(naggregate_dsets_g == aggregate_dsets_alloc_g) {
+        size_t new_alloc = aggregate_dsets_alloc_g ? 2 * aggregate_dsets_alloc_g : 16;
+        aggregate_dset_t *new_dsets;
+
+        if(NULL == (new_dsets = (aggregate_dset_t *)realloc(aggregate_dsets_g, new_alloc * sizeof(aggregate_dset_t))))
+            ERROR("Unable to grow aggregated dataset table");
+        aggregate_dsets_g = new_dsets;
+        aggregate_dsets_alloc_g = new_alloc;
+    }
+    ad = &aggregate_dsets_g[naggregate_dsets_g];
+    memset(ad, 0, sizeof(*ad));
+    ad->dset_id = dset_id;
+    ad->capacity = capacity;
+    ad->mem_type_id = -1;
+    ad->xfer_plist_id = -1;
+
+    if((filename_len = H5Fget_name(dset_id, NULL, 0)) < 0)
+        ERROR("Unable to get HDF5 file name length");
+    if(NULL == (ad->filename = (char *)malloc((size_t)filename_len + 1)))
+        ERROR("Unable to allocate HDF5 file name buffer");
+    if(H5Fget_name(dset_id, ad->filename, (size_t)filename_len + 1) < 0) {
+        free(ad->filename);
+        ERROR("Unable to get HDF5 file name");
+    }
+
+    naggregate_dsets_g++;
+
+done:
+    return ret_value;
+}
+
+
+static herr_t aggregate_flush_dset(aggregate_dset_t *ad)
+{
+    hid_t file_space_id = -1;
+    hid_t mem_space_id = -1;
+    hsize_t npoints = 1;
+    int d;
+    herr_t ret_value = SUCCEED;
+
+    if(ad->nbytes == 0)
+        return ret_value;
+
+    for(d = 0; d < ad->ndims; d++)
+        npoints *= ad->count[d];
+
+    if(verbose_g >= 3)
+        printf("  Writing %llu aggregated bytes to %s\n", (long long unsigned)ad->nbytes, ad->filename);
+
+    if((file_space_id = H5Dget_space(ad->dset_id)) < 0)
+        ERROR("Unable to get dataset dataspace");
+    if(H5Sselect_hyperslab(file_space_id, H5S_SELECT_SET, ad->start, NULL, ad->count, NULL) < 0)
+        ERROR("Unable to select aggregated block");
+    if((mem_space_id = H5Screate_simple(1, &npoints, NULL)) < 0)
+        ERROR("Unable to create memory dataspace");
+
+    if(forward_write(ad->dset_id, ad->mem_type_id, mem_space_id, file_space_id, ad->xfer_plist_id, ad->buf) < 0)
+        ERROR("Unable to write aggregated data");
+
+done:
+    /* The data is dropped if it could not be written, the error is reported
+     * once */
+    ad->nbytes = 0;
+    if((ad->mem_type_id >= 0) && (H5Tclose(ad->mem_type_id) < 0))
+        DONE_ERROR("Failure closing datatype");
+    ad->mem_type_id = -1;
+    if((ad->xfer_plist_id >= 0) && (ad->xfer_plist_id != H5P_DEFAULT) && (H5Pclose(ad->xfer_plist_id) < 0))
+        DONE_ERROR("Failure closing DXPL");
+    ad->xfer_plist_id = -1;
+
+    if((mem_space_id >= 0) && (H5Sclose(mem_space_id) < 0))
+        DONE_ERROR("Failure closing dataspace");
+    if((file_space_id >= 0) && (H5Sclose(file_space_id) < 0))
+        DONE_ERROR("Failure closing dataspace");
+
+    return ret_value;
+}
+
+
+/* Check whether a write can be buffered, and get its block and size */
+static herr_t aggregate_check(hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, /* OUT */ int *ndims,
+    hsize_t start[], hsize_t count[], size_t *nbytes, int *ok)
+{
+    hsize_t end[H5S_MAX_RANK];
+    hssize_t npoints;
+    hssize_t mem_npoints;
+    hsize_t box_npoints = 1;
+    size_t type_size;
+    H5FD_mpio_xfer_t xfer_mode = H5FD_MPIO_INDEPENDENT;
+    int d;
+    herr_t ret_value = SUCCEED;
+
+    *ok = 0;
+
+    if(file_space_id == H5S_ALL)
+        goto done;
+    if((xfer_plist_id != H5P_DEFAULT) && (H5Pget_dxpl_mpio(xfer_plist_id, &xfer_mode) < 0))
+        ERROR("Unable to get transfer mode");
+    if(xfer_mode == H5FD_MPIO_COLLECTIVE)
+        goto done;
+
+    /* The copy must not refer to application memory */
+    if(H5Tdetect_class(mem_type_id, H5T_VLEN) != 0 || H5Tdetect_class(mem_type_id, H5T_REFERENCE) != 0
+            || H5Tis_variable_str(mem_type_id) != 0)
+        goto done;
+
+    /* One hyperslab block in the file, i.e. a hyperslab selecting its whole
+     * bounding box */
+    if(H5Sget_select_type(file_space_id) != H5S_SEL_HYPERSLABS)
+        goto done;
+    if((*ndims = H5Sget_simple_extent_ndims(file_space_id)) <= 0)
+        goto done;
+    if(H5Sget_select_bounds(file_space_id, start, end) < 0)
+        ERROR("Unable to get selection bounds");
+    if((npoints = H5Sget_select_npoints(file_space_id)) < 0)
+        ERROR("Unable to get number of selected points");
+    for(d = 0; d < *ndims; d++) {
+        count[d] = end[d] - start[d] + 1;
+        box_npoints *= count[d];
+    }
+    if((hsize_t)npoints != box_npoints)
+        goto done;
+
+    /* From contiguous memory.  With H5S_ALL the file selection also selects
+     * the memory, which aggregate_write() gathers. */
+    if(mem_space_id != H5S_ALL) {
+        if((mem_npoints = H5Sget_select_npoints(mem_space_id)) < 0)
+            ERROR("Unable to get number of selected points");
+        if(mem_npoints != H5Sget_simple_extent_npoints(mem_space_id))
+            goto done;
+    }
+
+    if(0 == (type_size = H5Tget_size(mem_type_id)))
+        ERROR("Unable to get datatype size");
+    *nbytes = (size_t)npoints * type_size;
+    *ok = 1;
+
+done:
+    return ret_value;
+}
+
+
+herr_t aggregate_write(hid_t dset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void *buf,
+    /* OUT */ int *buffered)
+{
+    aggregate_dset_t *ad;
+    hsize_t start[H5S_MAX_RANK];
+    hsize_t count[H5S_MAX_RANK];
+    size_t nbytes = 0;
+    int ndims = 0;
+    int ok;
+    int d;
+    herr_t ret_value = SUCCEED;
+
+    *buffered = 0;
+
+    if(NULL == (ad = aggregate_find(dset_id)))
+        return ret_value;
+
+    if(aggregate_check(mem_type_id, mem_space_id, file_space_id, xfer_plist_id, &ndims, start, count, &nbytes, &ok) < 0)
+        ERROR("Unable to check write for aggregation");
+    if(ok && nbytes > ad->capacity)
+        ok = 0;
+
+    /* Does it continue the buffered block? */
+    if(ok && ad->nbytes > 0) {
+        int merge = (ndims == ad->ndims) && (ad->nbytes + nbytes <= ad->capacity)
+                && (start[0] == ad->start[0] + ad->count[0]);
+        htri_t equal;
+
+        for(d = 1; merge && d < ndims; d++)
+            if(start[d] != ad->start[d] || count[d] != ad->count[d])
+                merge = 0;
+        if(merge) {
+            if((equal = H5Tequal(mem_type_id, ad->mem_type_id)) < 0)
+                ERROR("Unable to compare datatypes");
+            merge = equal > 0;
+        }
+        if(merge && (xfer_plist_id != ad->xfer_plist_id)) {
+            if((xfer_plist_id == H5P_DEFAULT) || (ad->xfer_plist_id == H5P_DEFAULT))
+                merge = 0;
+            else {
+                if((equal = H5Pequal(xfer_plist_id, ad->xfer_plist_id)) < 0)
+                    ERROR("Unable to compare DXPLs");
+                merge = equal > 0;
+            }
+        }
+
+        if(!merge && (aggregate_flush_dset(ad) < 0))
+            ERROR("Unable to write aggregated data");
+    }
+    else if(aggregate_flush_dset(ad) < 0)
+        ERROR("Unable to write aggregated data");
+
+    if(!ok)
+        goto done;
+
+    if(!ad->buf) {
+        if(aggregate_bytes_g + ad->capacity > aggregate_max_g)
+            goto done;
+        if(NULL == (ad->buf = (unsigned char *)malloc(ad->capacity)))
+            goto done;
+        aggregate_bytes_g += ad->capacity;
+    }
+
+    if(mem_space_id == H5S_ALL) {
+        if(H5Dgather(file_space_id, buf, mem_type_id, nbytes, ad->buf + ad->nbytes, NULL, NULL) < 0)
+            ERROR("Unable to copy write buffer");
+    }
+    else
+        memcpy(ad->buf + ad->nbytes, buf, nbytes);
+
+    if(ad->nbytes == 0) {
+        if((ad->mem_type_id = H5Tcopy(mem_type_id)) < 0)
+            ERROR("Unable to copy datatype");
+        if(xfer_plist_id == H5P_DEFAULT)
+            ad->xfer_plist_id = H5P_DEFAULT;
+        else if((ad->xfer_plist_id = H5Pcopy(xfer_plist_id)) < 0)
+            ERROR("Unable to copy DXPL");
+        ad->ndims = ndims;
+        for(d = 0; d < ndims; d++) {
+            ad->start[d] = start[d];
+            ad->count[d] = count[d];
+        }
+    }
+    else
+        ad->count[0] += count[0];
+    ad->nbytes += nbytes;
+    *buffered = 1;
+
+    /* Write a full buffer right away */
+    if((ad->nbytes == ad->capacity) && (aggregate_flush_dset(ad) < 0))
+        ERROR("Unable to write aggregated data");
+
+done:
+    return ret_value;
+}
+
+
+herr_t aggregate_flush(hid_t dset_id)
+{
+    aggregate_dset_t *ad;
+
+    if(NULL == (ad = aggregate_find(dset_id)))
+        return SUCCEED;
+
+    return aggregate_flush_dset(ad);
+}
+
+
+herr_t aggregate_flush_file(const char *filename)
+{
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    for(i = 0; i < naggregate_dsets_g; i++)
+        if((filename == NULL || !strcmp(aggregate_dsets_g[i].filename, filename))
+                && (aggregate_flush_dset(&aggregate_dsets_g[i]) < 0))
+            ret_value = FAIL;
+
+    return ret_value;
+}
+
+
+int aggregate_has_data(void)
+{
+    size_t i;
+
+    for(i = 0; i < naggregate_dsets_g; i++)
+        if(aggregate_dsets_g[i].nbytes > 0)
+            return 1;
+
+    return 0;
+}
+
+
+herr_t aggregate_close(hid_t dset_id)
+{
+    aggregate_dset_t *ad;
+    herr_t ret_value = SUCCEED;
+
+    if(NULL == (ad = aggregate_find(dset_id)))
+        return ret_value;
+
+    if(aggregate_flush_dset(ad) < 0)
+        ret_value = FAIL;
+
+    if(ad->buf)
+        aggregate_bytes_g -= ad->capacity;
+    free(ad->buf);
+    free(ad->filename);
+
+    /* Move the last entry into the slot */
+    *ad = aggregate_dsets_g[naggregate_dsets_g - 1];
+    naggregate_dsets_g--;
+
+    return ret_value;
+}
@@ -0,0 +1,519 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Write-behind.  With H5TUNER_ASYNC=1 an independent H5Dwrite copies the
+ * selected elements into a staging buffer and returns; an I/O thread then
+ * writes them in the order they were queued, so writes to a dataset reach
+ * HDF5 in program order.  H5Dread, H5Dset_extent and H5Dclose wait for the
+ * queued writes of the dataset, and H5Fflush, H5Fclose and MPI_Finalize for
+ * all queued writes.  These are the sync points: if a queued write failed,
+ * the next sync point returns an error.
+ *
+ * Staging buffers are kept in a pool after their write completes.  The pool
+ * is limited to H5TUNER_ASYNC_MAX bytes; a write that needs more waits for
+ * queued writes to complete, and a write larger than the limit is written
+ * synchronously.  So are collective writes, which all ranks must make at the
+ * same point, and variable-length data, which refers to application memory.
+ *
+ * The I/O thread only calls H5Dwrite.  Completed writes are added to the
+ * statistics, trace, live metrics and cost by the application thread, the
+ * next time it queues a write or waits.  Since the I/O thread calls HDF5 and
+ * MPI-IO while the application does too, write-behind needs a thread-safe
+ * HDF5 library and, once MPI is initialized, MPI_THREAD_MULTIPLE; it is
+ * also not used with MPI-IO attribution, which is per thread.
+ */
+
+#include "autotuner_private.h"
+#include <pthread.h>
+
+/* Default limit on the staging buffers of a process */
+#define ASYNC_DEF_MAX ((size_t)256 * 1024 * 1024)
+
+typedef struct async_buf_t {
+    unsigned char *data;
+    size_t capacity;
+    struct async_buf_t *next;   /* Next free buffer */
+} async_buf_t;
+
+typedef struct async_req_t {
+    hid_t dset_id;
+    hid_t mem_type_id;
+    hid_t mem_space_id;         /* All of the staged elements */
+    hid_t file_space_id;
+    hid_t xfer_plist_id;
+    async_buf_t *buf;           /* NULL once written */
+    herr_t ret;
+    hid_t err_stack_id;         /* HDF5 error stack of a failed write, -1 if none */
+    double start;
+    double end;
+    struct async_req_t *next;
+} async_req_t;
+
+/* Global to indicate write-behind is enabled */
+int async_enabled_g = 0;
+
+static size_t async_max_g = ASYNC_DEF_MAX;
+
+/* Queued, in flight and completed writes, and the buffer pool, all under
+ * async_mutex_g */
+static pthread_mutex_t async_mutex_g = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_work_cond_g = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t async_done_cond_g = PTHREAD_COND_INITIALIZER;
+static async_req_t *async_queue_head_g = NULL;
+static async_req_t *async_queue_tail_g = NULL;
+static async_req_t *async_inflight_g = NULL;
+static async_req_t *async_done_head_g = NULL;
+static async_req_t *async_done_tail_g = NULL;
+static async_buf_t *async_free_bufs_g = NULL;
+static size_t async_bytes_g = 0;               /* Capacity of all buffers */
+static int async_stop_g = 0;
+
+/* I/O thread */
+static pthread_t async_thread_g;
+static int async_thread_running_g = 0;
+
+/* Queued writes that failed since the last sync point, application thread
+ * only */
+static unsigned async_failed_g = 0;
+
+
+static void async_atexit(void)
+{
+    if(async_finalize() < 0)
+        DONE_ERROR("Unable to complete write-behind");
+
+    return;
+}
+
+
+void set_async(void)
+{
+    static int async_set = 0;
+    char *async = getenv("H5TUNER_ASYNC");
+    char *async_max = getenv("H5TUNER_ASYNC_MAX");
+    hbool_t threadsafe = 0;
+    int mpi_initialized = 0;
+
+    if(async_set)
+        return;
+    async_set = 1;
+
+    if(!async || strtol(async, NULL, 10) <= 0)
+        return;
+
+    if(async_max && *async_max) {
+        long long max = strtoll(async_max, NULL, 10);
+
+        if(max <= 0) {
+            DONE_ERROR("Invalid value for H5TUNER_ASYNC_MAX");
+            return;
+        }
+        async_max_g = (size_t)max;
+    }
+
+    if(H5is_library_threadsafe(&threadsafe) < 0 || !threadsafe) {
+        fprintf(stderr, "H5Tuner: H5TUNER_ASYNC needs a thread-safe HDF5 library, writing synchronously\n");
+        return;
+    }
+    MPI_Initialized(&mpi_initialized);
+    if(mpi_initialized) {
+        int provided;
+
+        MPI_Query_thread(&provided);
+        if(provided < MPI_THREAD_MULTIPLE) {
+            fprintf(stderr, "H5Tuner: H5TUNER_ASYNC needs MPI_THREAD_MULTIPLE, writing synchronously\n");
+            return;
+        }
+    }
+    if(mpiio_enabled_g) {
+        fprintf(stderr, "H5Tuner: H5TUNER_ASYNC is not used with H5TUNER_MPIIO, writing synchronously\n");
+        return;
+    }
+
+    async_enabled_g = 1;
+    atexit(async_atexit);
+
+    return;
+}
+
+
+static void *async_thread(void *arg)
+{
+    async_req_t *req;
+
+    /* Errors are printed by the application thread, at the sync point */
+    if(H5Eset_auto2(H5E_DEFAULT, NULL, NULL) < 0)
+        DONE_ERROR("Unable to turn off HDF5 error printing");
+
+    pthread_mutex_lock(&async_mutex_g);
+
+    for(;;) {
+        while(!async_queue_head_g && !async_stop_g)
+            pthread_cond_wait(&async_work_cond_g, &async_mutex_g);
+        if(NULL == (req = async_queue_head_g))
+            break;
+
+        if(NULL == (async_queue_head_g = req->next))
+            async_queue_tail_g = NULL;
+        req->next = NULL;
+        async_inflight_g = req;
+        pthread_mutex_unlock(&async_mutex_g);
+
+        req->start = h5tuner_wtime();
+        req->ret = call_write(req->dset_id, req->mem_type_id, req->mem_space_id, req->file_space_id, req->xfer_plist_id, req->buf->data);
+        req->end = h5tuner_wtime();
+        if(req->ret < 0)
+            req->err_stack_id = H5Eget_current_stack();
+
+        pthread_mutex_lock(&async_mutex_g);
+
+        /* Return the buffer to the pool */
+        req->buf->next = async_free_bufs_g;
+        async_free_bufs_g = req->buf;
+        req->buf = NULL;
+
+        if(async_done_tail_g)
+            async_done_tail_g->next = req;
+        else
+            async_done_head_g = req;
+        async_done_tail_g = req;
+        async_inflight_g = NULL;
+
+        pthread_cond_broadcast(&async_done_cond_g);
+    }
+
+    pthread_mutex_unlock(&async_mutex_g);
+
+    return NULL;
+}
+
+
+/* Get a staging buffer of at least size bytes, waiting for queued writes to
+ * complete while the pool is at its limit.  Returns NULL if no buffer could
+ * be allocated. */
+static async_buf_t *async_get_buf(size_t size)
+{
+    async_buf_t **bufp;
+    async_buf_t *buf = NULL;
+
+    pthread_mutex_lock(&async_mutex_g);
+
+    for(;;) {
+        async_buf_t **best = NULL;
+
+        /* Smallest free buffer that is large enough */
+        for(bufp = &async_free_bufs_g; *bufp; bufp = &(*bufp)->next)
+            if((*bufp)->capacity >= size && (!best || (*bufp)->capacity < (*best)->capacity))
+                best = bufp;
+        if(best) {
+            buf = *best;
+            *best = buf->next;
+            buf->next = NULL;
+            break;
+        }
+
+        if(async_bytes_g + size <= async_max_g) {
+            if(NULL == (buf = (async_buf_t *)malloc(sizeof(async_buf_t))))
+                break;
+            if(NULL == (buf->data = (unsigned char *)malloc(size))) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf->capacity = size;
+            buf->next = NULL;
+            async_bytes_g += size;
+            break;
+        }
+
+        /* Make room by freeing a buffer too small to use, or wait for the
+         * writes holding the pool */
+        if(async_free_bufs_g) {
+            buf = async_free_bufs_g;
+            async_free_bufs_g = buf->next;
+            async_bytes_g -= buf->capacity;
+            free(buf->data);
+            free(buf);
+            buf = NULL;
+        }
+        else
+            pthread_cond_wait(&async_done_cond_g, &async_mutex_g);
+    }
+
+    pthread_mutex_unlock(&async_mutex_g);
+
+    return buf;
+}
+
+
+/* Record the completed writes and release their resources */
+static void async_harvest(void)
+{
+    async_req_t *req;
+    async_req_t *next;
+
+    pthread_mutex_lock(&async_mutex_g);
+    req = async_done_head_g;
+    async_done_head_g = async_done_tail_g = NULL;
+    pthread_mutex_unlock(&async_mutex_g);
+
+    for(; req; req = next) {
+        next = req->next;
+
+        if(req->ret < 0) {
+            async_failed_g++;
+            if(req->err_stack_id >= 0) {
+                H5Eprint2(req->err_stack_id, stderr);
+                if(H5Eclose_stack(req->err_stack_id) < 0)
+                    DONE_ERROR("Failure closing error stack");
+            }
+        }
+        else if(TIMING_ENABLED)
+            record_write(req->dset_id, req->mem_type_id, req->mem_space_id, req->file_space_id, req->start, req->end);
+
+        if(H5Tclose(req->mem_type_id) < 0)
+            DONE_ERROR("Failure closing datatype");
+        if(H5Sclose(req->mem_space_id) < 0)
+            DONE_ERROR("Failure closing dataspace");
+        if(H5Sclose(req->file_space_id) < 0)
+            DONE_ERROR("Failure closing dataspace");
+        if((req->xfer_plist_id != H5P_DEFAULT) && (H5Pclose(req->xfer_plist_id) < 0))
+            DONE_ERROR("Failure closing DXPL");
+        free(req);
+    }
+
+    return;
+}
+
+
+/* Whether a write of the dataset (any dataset for -1) is queued or in
+ * flight.  Called with async_mutex_g held. */
+static int async_busy(hid_t dset_id)
+{
+    async_req_t *req;
+
+    if(async_inflight_g && (dset_id < 0 || async_inflight_g->dset_id == dset_id))
+        return 1;
+    for(req = async_queue_head_g; req; req = req->next)
+        if(dset_id < 0 || req->dset_id == dset_id)
+            return 1;
+
+    return 0;
+}
+
+
+/* Wait for the queued writes of the dataset (all datasets for -1) */
+static void async_wait(hid_t dset_id)
+{
+    if(!async_thread_running_g)
+        return;
+
+    pthread_mutex_lock(&async_mutex_g);
+    while(async_busy(dset_id))
+        pthread_cond_wait(&async_done_cond_g, &async_mutex_g);
+    pthread_mutex_unlock(&async_mutex_g);
+
+    async_harvest();
+
+    return;
+}
+
+
+/* Check whether a write can be queued, and get the selection of the
+ * application buffer and its size */
+static herr_t async_check(hid_t dset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id,
+    /* OUT */ hid_t *file_copy_id, hid_t *mem_select_id, hsize_t *npoints, size_t *nbytes, int *ok)
+{
+    H5FD_mpio_xfer_t xfer_mode = H5FD_MPIO_INDEPENDENT;
+    hssize_t nselected;
+    size_t type_size;
+    herr_t ret_value = SUCCEED;
+
+    *ok = 0;
+
+    if((xfer_plist_id != H5P_DEFAULT) && (H5Pget_dxpl_mpio(xfer_plist_id, &xfer_mode) < 0))
+        ERROR("Unable to get transfer mode");
+    if(xfer_mode == H5FD_MPIO_COLLECTIVE)
+        goto done;
+
+    /* The copy must not refer to application memory */
+    if(H5Tdetect_class(mem_type_id, H5T_VLEN) != 0 || H5Tdetect_class(mem_type_id, H5T_REFERENCE) != 0
+            || H5Tis_variable_str(mem_type_id) != 0)
+        goto done;
+
+    /* The file selection is kept until the write is made */
+    if(file_space_id == H5S_ALL) {
+        if((*file_copy_id = H5Dget_space(dset_id)) < 0)
+            ERROR("Unable to get dataset dataspace");
+    }
+    else if((*file_copy_id = H5Scopy(file_space_id)) < 0)
+        ERROR("Unable to copy dataspace");
+
+    /* Without a memory dataspace, the buffer has the file dataspace */
+    *mem_select_id = mem_space_id == H5S_ALL ? *file_copy_id : mem_space_id;
+
+    if((nselected = H5Sget_select_npoints(*mem_select_id)) < 0)
+        ERROR("Unable to get number of selected points");
+    if(0 == (type_size = H5Tget_size(mem_type_id)))
+        ERROR("Unable to get datatype size");
+    *npoints = (hsize_t)nselected;
+    *nbytes = (size_t)nselected * type_size;
+
+    *ok = (*nbytes > 0) && (*nbytes <= async_max_g);
+
+done:
+    return ret_value;
+}
+
+
+herr_t async_write(hid_t dset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void *buf,
+    /* OUT */ int *queued)
+{
+    async_req_t *req = NULL;
+    hid_t file_copy_id = -1;
+    hid_t mem_select_id = -1;
+    hsize_t npoints = 0;
+    size_t nbytes = 0;
+    int ok = 0;
+    herr_t ret_value = SUCCEED;
+
+    *queued = 0;
+
+    if(!async_enabled_g)
+        return ret_value;
+
+    async_harvest();
+
+    if(async_check(dset_id, mem_type_id, mem_space_id, file_space_id, xfer_plist_id, &file_copy_id, &mem_select_id, &npoints, &nbytes, &ok) < 0)
+        ERROR("Unable to check write for write-behind");
+    if(!ok)
+        goto done;
+
+    if(NULL == (req = (async_req_t *)calloc(1, sizeof(async_req_t))))
+        goto done;
+    req->mem_type_id = req->mem_space_id = req->file_space_id = req->xfer_plist_id = -1;
+    req->err_stack_id = -1;
+
+    if(NULL == (req->buf = async_get_buf(nbytes)))
+        goto done;
+    if(H5Dgather(mem_select_id, buf, mem_type_id, nbytes, req->buf->data, NULL, NULL) < 0)
+        ERROR("Unable to copy write buffer");
+
+    req->dset_id = dset_id;
+    if((req->mem_type_id = H5Tcopy(mem_type_id)) < 0)
+        ERROR("Unable to copy datatype");
+    if((req->mem_space_id = H5Screate_simple(1, &npoints, NULL)) < 0)
+        ERROR("Unable to create memory dataspace");
+    req->file_space_id = file_copy_id;
+    file_copy_id = -1;
+    if(xfer_plist_id == H5P_DEFAULT)
+        req->xfer_plist_id = H5P_DEFAULT;
+    else if((req->xfer_plist_id = H5Pcopy(xfer_plist_id)) < 0)
+        ERROR("Unable to copy DXPL");
+
+    if(!async_thread_running_g) {
+        if(pthread_create(&async_thread_g, NULL, async_thread, NULL) != 0) {
+            DONE_ERROR("Unable to start write-behind thread, writing synchronously");
+            async_enabled_g = 0;
+            goto done;
+        }
+        async_thread_running_g = 1;
+    }
+
+    pthread_mutex_lock(&async_mutex_g);
+    if(async_queue_tail_g)
+        async_queue_tail_g->next = req;
+    else
+        async_queue_head_g = req;
+    async_queue_tail_g = req;
+    pthread_cond_signal(&async_work_cond_g);
+    pthread_mutex_unlock(&async_mutex_g);
+
+    if(verbose_g >= 3)
+        printf("  Queued %llu bytes for write-behind\n", (long long unsigned)nbytes);
+
+    req = NULL;
+    *queued = 1;
+
+done:
+    /* Not queued, written by the caller after the queued writes */
+    if(req) {
+        if(req->buf) {
+            pthread_mutex_lock(&async_mutex_g);
+            req->buf->next = async_free_bufs_g;
+            async_free_bufs_g = req->buf;
+            pthread_mutex_unlock(&async_mutex_g);
+        }
+        if((req->mem_type_id >= 0) && (H5Tclose(req->mem_type_id) < 0))
+            DONE_ERROR("Failure closing datatype");
+        if((req->mem_space_id >= 0) && (H5Sclose(req->mem_space_id) < 0))
+            DONE_ERROR("Failure closing dataspace");
+        if((req->file_space_id >= 0) && (H5Sclose(req->file_space_id) < 0))
+            DONE_ERROR("Failure closing dataspace");
+        if((req->xfer_plist_id >= 0) && (req->xfer_plist_id != H5P_DEFAULT) && (H5Pclose(req->xfer_plist_id) < 0))
+            DONE_ERROR("Failure closing DXPL");
+        free(req);
+    }
+    if((file_copy_id >= 0) && (H5Sclose(file_copy_id) < 0))
+        DONE_ERROR("Failure closing dataspace");
+
+    if(!*queued)
+        async_wait(dset_id);
+
+    return ret_value;
+}
+
+
+herr_t async_drain(hid_t dset_id)
+{
+    herr_t ret_value = SUCCEED;
+
+    async_wait(dset_id);
+
+    if(async_failed_g) {
+        fprintf(stderr, "H5Tuner: %u queued H5Dwrite calls failed\n", async_failed_g);
+        async_failed_g = 0;
+        ret_value = FAIL;
+    }
+
+    return ret_value;
+}
+
+
+herr_t async_finalize(void)
+{
+    async_buf_t *buf;
+    herr_t ret_value = SUCCEED;
+
+    if(!async_thread_running_g)
+        return ret_value;
+
+    if(async_drain(-1) < 0)
+        ret_value = FAIL;
+
+    pthread_mutex_lock(&async_mutex_g);
+    async_stop_g = 1;
+    pthread_cond_signal(&async_work_cond_g);
+    pthread_mutex_unlock(&async_mutex_g);
+    pthread_join(async_thread_g, NULL);
+    async_thread_running_g = 0;
+    async_enabled_g = 0;
+
+    while(NULL != (buf = async_free_bufs_g)) {
+        async_free_bufs_g = buf->next;
+        free(buf->data);
+        free(buf);
+    }
+    async_bytes_g = 0;
+
+    return ret_value;
+}
@@ -0,0 +1,350 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Promotion of independent writes to collective.  With
+ * H5TUNER_COLLECTIVE=lockstep (for all datasets) or a "transfer" rule of
+ * "lockstep" (for the datasets created under it), the independent H5Dwrite
+ * calls of a dataset in a file opened with MPI-IO on more than one rank are
+ * counted between sync points, H5Dset_extent and H5Dclose, which are
+ * collective anyway.  At each sync point the ranks compare their counts and
+ * a hash of the positions of the writes among all counted writes.  Once all
+ * ranks made the same number of writes in the same order at
+ * COLLECTIVE_LOCKSTEP_SYNCS sync points in a row, the dataset is promoted:
+ * from then on, the first that many independent writes between two sync
+ * points are made collective, and any others stay independent.
+ *
+ * A promoted write waits for the other ranks' writes, so the value
+ * "lockstep" states that every rank keeps making them, in the same order
+ * across promoted datasets, without another collective call in between.
+ * It cannot be checked without communication on every write: a rank that
+ * skips a promoted write and makes another collective call (e.g.
+ * MPI_Barrier) before the next sync point hangs the job.  A rank that skips
+ * some and reaches the sync point first makes the missing collective
+ * writes with an empty selection, so the other ranks' writes complete, and
+ * the dataset is demoted for good.
+ *
+ * The state is kept with the statistics of the dataset, so that it carries
+ * over when a dataset of the same name is opened again.  Transfers already
+ * collective and transfers made independent by H5TUNER_PATTERN=adaptive
+ * are left alone.
+ */
+
+#include "autotuner_private.h"
+
+/* Sync points in lockstep before a dataset is promoted */
+#define COLLECTIVE_LOCKSTEP_SYNCS 2
+
+/* Values exchanged at sync points, as maxima of the values and their
+ * negations */
+#define COLLECTIVE_VAL_NWRITES 0
+#define COLLECTIVE_VAL_ORDER 1
+#define COLLECTIVE_NVALS 2
+
+/* Bits of the order hash, so that it can be negated */
+#define COLLECTIVE_ORDER_MASK ((1LL << 62) - 1)
+
+/* Global to indicate promotion is enabled (COLLECTIVE_ALL, or
+ * COLLECTIVE_RULES once a dataset has a transfer rule) */
+int collective_enabled_g = 0;
+
+/* Counted writes of all datasets, for the order hash */
+static long long collective_seq_g = 0;
+
+
+void set_collective(void)
+{
+    static int collective_set = 0;
+    char *collective = getenv("H5TUNER_COLLECTIVE");
+
+    if(collective_set)
+        return;
+    collective_set = 1;
+
+    if(!collective || !*collective)
+        return;
+    if(!strcmp(collective, "lockstep"))
+        collective_enabled_g = COLLECTIVE_ALL;
+    else if(strcmp(collective, "none") != 0)
+        DONE_ERROR("Unknown value for H5TUNER_COLLECTIVE, expected \"lockstep\" or \"none\"");
+
+    return;
+}
+
+
+herr_t collective_set_rule(hid_t dset_id, int rule)
+{
+    dset_stats_t *stats;
+    herr_t ret_value = SUCCEED;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+    stats->collective.rule = rule;
+
+    if(!collective_enabled_g && (rule == COLLECTIVE_RULE_LOCKSTEP))
+        collective_enabled_g = COLLECTIVE_RULES;
+
+done:
+    return ret_value;
+}
+
+
+/* Whether the writes of a dataset are counted.  Every rank decides the
+ * same, since the decision only depends on the configuration. */
+static int collective_applies(const collective_state_t *cs)
+{
+    if(cs->rule == COLLECTIVE_RULE_INDEPENDENT)
+        return 0;
+
+    return (collective_enabled_g == COLLECTIVE_ALL) || (cs->rule == COLLECTIVE_RULE_LOCKSTEP);
+}
+
+
+/* Whether the file of a dataset is opened for writing, without
+ * communication */
+static herr_t collective_get_writable(hid_t dset_id, /* OUT */ int *writable)
+{
+    hid_t file_id = -1;
+    unsigned intent;
+    herr_t ret_value = SUCCEED;
+
+    *writable = 0;
+
+    if((file_id = H5Iget_file_id(dset_id)) < 0)
+        ERROR("Unable to get file ID");
+    if(H5Fget_intent(file_id, &intent) < 0)
+        ERROR("Unable to get file intent");
+    *writable = (intent & H5F_ACC_RDWR) != 0;
+
+done:
+    if((file_id >= 0) && (H5Idec_ref(file_id) < 0))
+        DONE_ERROR("Failure releasing file ID");
+
+    return ret_value;
+}
+
+
+/* Get the state of a dataset whose writes are counted, NULL if they are
+ * not.  The ranks sharing the file are only counted by collective_sync(),
+ * which all of them call; until then the writes are counted, but the
+ * dataset cannot be promoted. */
+static herr_t collective_get_state(hid_t dset_id, /* OUT */ dset_stats_t **stats_out)
+{
+    dset_stats_t *stats;
+    collective_state_t *cs;
+    herr_t ret_value = SUCCEED;
+
+    *stats_out = NULL;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+    cs = &stats->collective;
+    if(collective_applies(cs) && (cs->nranks != 1))
+        *stats_out = stats;
+
+done:
+    return ret_value;
+}
+
+
+herr_t collective_adapt_dxpl(hid_t dset_id, hid_t xfer_plist_id, /* OUT */ hid_t *adapted_dxpl_id)
+{
+    dset_stats_t *stats;
+    collective_state_t *cs;
+    H5FD_mpio_xfer_t xfer_mode = H5FD_MPIO_INDEPENDENT;
+    hid_t dxpl_id = -1;
+    herr_t ret_value = SUCCEED;
+
+    *adapted_dxpl_id = -1;
+
+    if(collective_get_state(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset transfer state");
+    if(!stats)
+        goto done;
+    cs = &stats->collective;
+
+    if((xfer_plist_id != H5P_DEFAULT) && (H5Pget_dxpl_mpio(xfer_plist_id, &xfer_mode) < 0))
+        ERROR("Unable to get transfer mode");
+    if(xfer_mode == H5FD_MPIO_COLLECTIVE)
+        goto done;
+
+    cs->nwrites += 1.0;
+    cs->order = (cs->order * 31 + ++collective_seq_g) & COLLECTIVE_ORDER_MASK;
+
+    if(!cs->promoted || cs->ncollective >= cs->lockstep_calls)
+        goto done;
+
+    if(xfer_plist_id == H5P_DEFAULT) {
+        if((dxpl_id = H5Pcreate(H5P_DATASET_XFER)) < 0)
+            ERROR("Unable to create DXPL");
+    }
+    else if((dxpl_id = H5Pcopy(xfer_plist_id)) < 0)
+        ERROR("Unable to copy DXPL");
+    if(H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_COLLECTIVE) < 0)
+        ERROR("Unable to set transfer mode");
+    cs->ncollective += 1.0;
+
+    *adapted_dxpl_id = dxpl_id;
+    dxpl_id = -1;
+
+done:
+    if((dxpl_id >= 0) && (H5Pclose(dxpl_id) < 0))
+        DONE_ERROR("Failure closing DXPL");
+
+    return ret_value;
+}
+
+
+/* Make a collective write of nothing, for the promoted writes a rank did
+ * not make */
+static herr_t collective_empty_write(hid_t dset_id)
+{
+    hid_t type_id = -1;
+    hid_t file_space_id = -1;
+    hid_t mem_space_id = -1;
+    hid_t dxpl_id = -1;
+    hsize_t one = 1;
+    char dummy = 0;
+    herr_t ret_value = SUCCEED;
+
+    /* The file type needs no conversion */
+    if((type_id = H5Dget_type(dset_id)) < 0)
+        ERROR("Unable to get dataset datatype");
+    if((file_space_id = H5Dget_space(dset_id)) < 0)
+        ERROR("Unable to get dataset dataspace");
+    if(H5Sselect_none(file_space_id) < 0)
+        ERROR("Unable to select nothing");
+    if((mem_space_id = H5Screate_simple(1, &one, NULL)) < 0)
+        ERROR("Unable to create memory dataspace");
+    if(H5Sselect_none(mem_space_id) < 0)
+        ERROR("Unable to select nothing");
+    if((dxpl_id = H5Pcreate(H5P_DATASET_XFER)) < 0)
+        ERROR("Unable to create DXPL");
+    if(H5Pset_dxpl_mpio(dxpl_id, H5FD_MPIO_COLLECTIVE) < 0)
+        ERROR("Unable to set transfer mode");
+
+    if(call_write(dset_id, type_id, mem_space_id, file_space_id, dxpl_id, &dummy) < 0)
+        ERROR("Unable to make empty collective write");
+
+done:
+    if((dxpl_id >= 0) && (H5Pclose(dxpl_id) < 0))
+        DONE_ERROR("Failure closing DXPL");
+    if((mem_space_id >= 0) && (H5Sclose(mem_space_id) < 0))
+        DONE_ERROR("Failure closing dataspace");
+    if((file_space_id >= 0) && (H5Sclose(file_space_id) < 0))
+        DONE_ERROR("Failure closing dataspace");
+    if((type_id >= 0) && (H5Tclose(type_id) < 0))
+        DONE_ERROR("Failure closing datatype");
+
+    return ret_value;
+}
+
+
+herr_t collective_sync(hid_t dset_id)
+{
+    dset_stats_t *stats;
+    collective_state_t *cs = NULL;
+    long long local[2 * COLLECTIVE_NVALS];
+    long long global[2 * COLLECTIVE_NVALS];
+    long long min_writes, max_writes;
+    MPI_Comm comm = MPI_COMM_NULL;
+    int writable = 0;
+    int mpi_rank = 0;
+    herr_t ret_value = SUCCEED;
+
+    if(!collective_enabled_g)
+        return ret_value;
+
+    if(collective_get_state(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset transfer state");
+    if(!stats)
+        goto done;
+    cs = &stats->collective;
+
+    /* The ranks open a file with the same flags, so they all skip a file
+     * opened read-only, where no write was made */
+    if(collective_get_writable(dset_id, &writable) < 0)
+        ERROR("Unable to get file intent");
+    if(!writable)
+        goto done;
+
+    /* Complete the collective writes the other ranks are in, before any
+     * other collective call */
+    if(cs->promoted)
+        while(cs->ncollective < cs->lockstep_calls) {
+            if(collective_empty_write(dset_id) < 0)
+                ERROR("Unable to complete promoted writes");
+            cs->ncollective += 1.0;
+        }
+
+    if(stats_get_comm(dset_id, &comm) < 0)
+        ERROR("Unable to get file communicator");
+
+    /* Only files shared by several ranks, checked once per dataset */
+    if(cs->nranks == 0) {
+        if(comm == MPI_COMM_NULL)
+            cs->nranks = 1;
+        else if(MPI_Comm_size(comm, &cs->nranks) != MPI_SUCCESS)
+            ERROR("Unable to get MPI size");
+    }
+    if(cs->nranks == 1)
+        goto done;
+
+    if(MPI_Comm_rank(comm, &mpi_rank) != MPI_SUCCESS)
+        ERROR("Unable to get MPI rank");
+
+    local[COLLECTIVE_VAL_NWRITES] = (long long)cs->nwrites;
+    local[COLLECTIVE_VAL_ORDER] = cs->order;
+    local[COLLECTIVE_NVALS + COLLECTIVE_VAL_NWRITES] = -local[COLLECTIVE_VAL_NWRITES];
+    local[COLLECTIVE_NVALS + COLLECTIVE_VAL_ORDER] = -local[COLLECTIVE_VAL_ORDER];
+    if(MPI_Allreduce(local, global, 2 * COLLECTIVE_NVALS, MPI_LONG_LONG, MPI_MAX, comm) != MPI_SUCCESS)
+        ERROR("Unable to exchange write counts");
+    max_writes = global[COLLECTIVE_VAL_NWRITES];
+    min_writes = -global[COLLECTIVE_NVALS + COLLECTIVE_VAL_NWRITES];
+
+    if(max_writes == 0)
+        goto done;
+
+    if((min_writes == max_writes) && (global[COLLECTIVE_VAL_ORDER] == -global[COLLECTIVE_NVALS + COLLECTIVE_VAL_ORDER])) {
+        if(cs->lockstep_calls == (double)max_writes)
+            cs->nlockstep++;
+        else {
+            cs->nlockstep = 1;
+            cs->lockstep_calls = (double)max_writes;
+        }
+
+        if(!cs->promoted && !cs->diverged && (cs->nlockstep >= COLLECTIVE_LOCKSTEP_SYNCS)) {
+            cs->promoted = 1;
+            if(verbose_g && mpi_rank == 0)
+                printf("H5Tuner: promoting %.0f writes of %s %s to collective between sync points\n", cs->lockstep_calls,
+                        stats->filename, stats->dset_name);
+        }
+    }
+    else {
+        if(cs->promoted) {
+            cs->promoted = 0;
+            cs->diverged = 1;
+            if(verbose_g && mpi_rank == 0)
+                printf("H5Tuner: ranks diverged, writes of %s %s stay independent\n", stats->filename, stats->dset_name);
+        }
+        cs->nlockstep = 0;
+    }
+
+done:
+    /* Start counting the next interval */
+    if(cs) {
+        cs->nwrites = 0.0;
+        cs->ncollective = 0.0;
+        cs->order = 0;
+    }
+
+    return ret_value;
+}
@@ -0,0 +1,382 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Deferred dataset creation.  A dataset matched by a chunk rule with the
+ * value "auto" is not created by H5Dcreate: the application gets a proxy
+ * ID of an H5Tuner ID type, which holds copies of the creation arguments.
+ * The dataset is created at the first H5Dwrite or H5Dread, with a chunk
+ * shape taken from the bounding box of the file selection.  For files
+ * opened with MPI-IO, the ranks agree on the per-dimension maximum of their
+ * boxes, so they all create the dataset with the same chunk shape; the first
+ * access is collective, as H5Dcreate would have been.  Datasets still
+ * pending at H5Dclose or H5Fclose are created with the whole extent as the
+ * chunk shape.  The deferred datasets of a file share one duplicate of the
+ * file's communicator.
+ *
+ * H5Dget_space, H5Dget_type and H5Dget_create_plist (without the chunk
+ * shape) are answered from the proxy, and H5Dset_extent changes its
+ * dataspace, so the application can select its first hyperslab before the
+ * dataset exists.  After creation the intercepted calls forward the proxy to
+ * the real dataset.  Other HDF5 calls do not accept the proxy.
+ */
+
+#include "autotuner_private.h"
+
+/* HDF5 limits chunks to less than 4 GiB, and chunk dimensions to 32 bits */
+#define DEFER_MAX_CHUNK_BYTES ((hsize_t)0xffffffff)
+#define DEFER_MAX_CHUNK_DIM ((hsize_t)0xffffffff)
+
+/* ID type of the proxies, registered at the first deferred creation */
+static H5I_type_t defer_type_g = H5I_BADID;
+
+/* Deferred datasets not created yet, in the order of their H5Dcreate */
+static defer_dset_t *defer_pending_g = NULL;
+
+
+static void defer_unlink(defer_dset_t *dd)
+{
+    defer_dset_t **p;
+
+    for(p = &defer_pending_g; *p; p = &(*p)->next)
+        if(*p == dd) {
+            *p = dd->next;
+            break;
+        }
+    dd->next = NULL;
+
+    return;
+}
+
+
+/* Communicator of the pending datasets of a file, MPI_COMM_NULL if none */
+static MPI_Comm defer_find_comm(const char *filename)
+{
+    defer_dset_t *dd;
+
+    for(dd = defer_pending_g; dd; dd = dd->next)
+        if((dd->comm != MPI_COMM_NULL) && !strcmp(dd->filename, filename))
+            return dd->comm;
+
+    return MPI_COMM_NULL;
+}
+
+
+/* Release the creation arguments, once the dataset is created or the proxy
+ * is closed */
+static void defer_release(defer_dset_t *dd)
+{
+    defer_unlink(dd);
+
+    if((dd->loc_id >= 0) && (H5Idec_ref(dd->loc_id) < 0))
+        DONE_ERROR("Failure releasing deferred dataset location");
+    dd->loc_id = -1;
+    if((dd->type_id >= 0) && (H5Tclose(dd->type_id) < 0))
+        DONE_ERROR("Failure closing deferred dataset datatype");
+    dd->type_id = -1;
+    if((dd->lcpl_id >= 0) && (dd->lcpl_id != H5P_DEFAULT) && (H5Pclose(dd->lcpl_id) < 0))
+        DONE_ERROR("Failure closing deferred dataset LCPL");
+    dd->lcpl_id = -1;
+    if((dd->dcpl_id >= 0) && (H5Pclose(dd->dcpl_id) < 0))
+        DONE_ERROR("Failure closing deferred dataset DCPL");
+    dd->dcpl_id = -1;
+    if((dd->app_dcpl_id >= 0) && (dd->app_dcpl_id != H5P_DEFAULT) && (H5Pclose(dd->app_dcpl_id) < 0))
+        DONE_ERROR("Failure closing deferred dataset DCPL");
+    dd->app_dcpl_id = -1;
+    if((dd->dapl_id >= 0) && (dd->dapl_id != H5P_DEFAULT) && (H5Pclose(dd->dapl_id) < 0))
+        DONE_ERROR("Failure closing deferred dataset DAPL");
+    dd->dapl_id = -1;
+    if((dd->comm != MPI_COMM_NULL) && (defer_find_comm(dd->filename) == MPI_COMM_NULL) && (MPI_Comm_free(&dd->comm) != MPI_SUCCESS))
+        DONE_ERROR("Failure freeing MPI comm");
+    dd->comm = MPI_COMM_NULL;
+    params_free(dd->params);
+    dd->params = NULL;
+
+    return;
+}
+
+
+static herr_t defer_free(void *obj)
+{
+    defer_dset_t *dd = (defer_dset_t *)obj;
+
+    defer_release(dd);
+    if((dd->space_id >= 0) && (H5Sclose(dd->space_id) < 0))
+        DONE_ERROR("Failure closing deferred dataset dataspace");
+    free(dd->name);
+    free(dd->filename);
+    free(dd);
+
+    return SUCCEED;
+}
+
+
+/* Copy a property list, keeping H5P_DEFAULT */
+static hid_t defer_copy_plist(hid_t plist_id)
+{
+    if(plist_id == H5P_DEFAULT)
+        return H5P_DEFAULT;
+
+    return H5Pcopy(plist_id);
+}
+
+
+hid_t defer_register(hid_t loc_id, const char *name, hid_t type_id, hid_t space_id, hid_t lcpl_id, hid_t dcpl_id, hid_t app_dcpl_id, hid_t dapl_id,
+    size_t aggregate, int transfer)
+{
+    defer_dset_t *dd = NULL;
+    defer_dset_t **tail;
+    ssize_t filename_len;
+    hid_t fapl_id = -1;
+    hid_t ret_value = -1;
+
+    if(defer_type_g == H5I_BADID)
+        if((defer_type_g = H5Iregister_type((size_t)64, 0, defer_free)) < 0) {
+            defer_type_g = H5I_BADID;
+            ERROR("Unable to register deferred dataset ID type");
+        }
+
+    if(NULL == (dd = (defer_dset_t *)calloc(1, sizeof(defer_dset_t))))
+        ERROR("Unable to allocate deferred dataset");
+    dd->loc_id = dd->type_id = dd->space_id = dd->lcpl_id = -1;
+    dd->dcpl_id = dd->app_dcpl_id = dd->dapl_id = dd->dset_id = -1;
+    dd->comm = MPI_COMM_NULL;
+    dd->aggregate = aggregate;
+    dd->transfer = transfer;
+
+    if(NULL == (dd->name = strdup(name)))
+        ERROR("Unable to copy dataset name");
+    if((filename_len = H5Fget_name(loc_id, NULL, 0)) < 0)
+        ERROR("Unable to get HDF5 file name length");
+    if(NULL == (dd->filename = (char *)malloc((size_t)filename_len + 1)))
+        ERROR("Unable to allocate HDF5 file name buffer");
+    if(H5Fget_name(loc_id, dd->filename, (size_t)filename_len + 1) < 0)
+        ERROR("Unable to get HDF5 file name");
+
+    /* Keep the location open until the dataset is created */
+    if(H5Iinc_ref(loc_id) < 0)
+        ERROR("Unable to hold dataset location");
+    dd->loc_id = loc_id;
+
+    if((dd->type_id = H5Tcopy(type_id)) < 0)
+        ERROR("Unable to copy datatype");
+    if((dd->space_id = H5Scopy(space_id)) < 0)
+        ERROR("Unable to copy dataspace");
+    if(H5Sselect_all(dd->space_id) < 0)
+        ERROR("Unable to select dataspace");
+    if((dd->lcpl_id = defer_copy_plist(lcpl_id)) < 0)
+        ERROR("Unable to copy LCPL");
+    if((dd->dcpl_id = H5Pcopy(dcpl_id)) < 0)
+        ERROR("Unable to copy DCPL");
+    if((dd->app_dcpl_id = defer_copy_plist(app_dcpl_id)) < 0)
+        ERROR("Unable to copy DCPL");
+    if((dd->dapl_id = defer_copy_plist(dapl_id)) < 0)
+        ERROR("Unable to copy DAPL");
+
+    /* The ranks agree on the chunk shape over the file's communicator,
+     * duplicated once for all the pending datasets of the file */
+    if((fapl_id = H5Fget_access_plist(loc_id)) < 0)
+        ERROR("Unable to get FAPL");
+    if((H5Pget_driver(fapl_id) == H5FD_MPIO) && ((dd->comm = defer_find_comm(dd->filename)) == MPI_COMM_NULL)) {
+        MPI_Info info = MPI_INFO_NULL;
+
+        if(H5Pget_fapl_mpio(fapl_id, &dd->comm, &info) < 0)
+            ERROR("Unable to get MPIO file driver info");
+        if((info != MPI_INFO_NULL) && (MPI_Info_free(&info) != MPI_SUCCESS))
+            ERROR("Failure freeing MPI info");
+    }
+
+    /* The parameters applied so far are committed when the dataset is
+     * created, with its chunk shape */
+    dd->params = params_take();
+
+    if((ret_value = H5Iregister(defer_type_g, dd)) < 0)
+        ERROR("Unable to register deferred dataset");
+    dd->proxy_id = ret_value;
+
+    for(tail = &defer_pending_g; *tail; tail = &(*tail)->next)
+        ;
+    *tail = dd;
+
+    if(verbose_g >= 3)
+        printf("  Deferring creation of %s: %s\n", dd->filename, dd->name);
+
+done:
+    if((fapl_id >= 0) && (H5Pclose(fapl_id) < 0))
+        DONE_ERROR("Failure closing FAPL");
+
+    if((ret_value < 0) && dd)
+        defer_free(dd);
+
+    return ret_value;
+}
+
+
+defer_dset_t *defer_lookup(hid_t id)
+{
+    if(defer_type_g == H5I_BADID || H5Iget_type(id) != defer_type_g)
+        return NULL;
+
+    return (defer_dset_t *)H5Iobject_verify(id, defer_type_g);
+}
+
+
+hid_t defer_next_pending(const char *filename)
+{
+    defer_dset_t *dd;
+
+    for(dd = defer_pending_g; dd; dd = dd->next)
+        if(!strcmp(dd->filename, filename))
+            return dd->proxy_id;
+
+    return -1;
+}
+
+
+int defer_has_pending(void)
+{
+    return defer_pending_g != NULL;
+}
+
+
+herr_t defer_set_extent(defer_dset_t *dd, const hsize_t size[])
+{
+    hsize_t dims[H5S_MAX_RANK];
+    hsize_t maxdims[H5S_MAX_RANK];
+    int ndims;
+    int d;
+    herr_t ret_value = SUCCEED;
+
+    if((ndims = H5Sget_simple_extent_dims(dd->space_id, dims, maxdims)) < 0)
+        ERROR("Unable to get space dimensions");
+    for(d = 0; d < ndims; d++)
+        if((maxdims[d] != H5S_UNLIMITED) && (size[d] > maxdims[d]))
+            ERROR("Dataset extent exceeds the maximum dimensions");
+
+    if(H5Sset_extent_simple(dd->space_id, ndims, size, maxdims) < 0)
+        ERROR("Unable to set dataspace extent");
+
+done:
+    return ret_value;
+}
+
+
+herr_t defer_chunk(defer_dset_t *dd, hid_t file_space_id)
+{
+    hsize_t dims[H5S_MAX_RANK];
+    hsize_t maxdims[H5S_MAX_RANK];
+    hsize_t start[H5S_MAX_RANK];
+    hsize_t end[H5S_MAX_RANK];
+    unsigned long long local[H5S_MAX_RANK];
+    unsigned long long global[H5S_MAX_RANK];
+    hsize_t chunk[H5S_MAX_RANK];
+    hsize_t chunk_bytes;
+    size_t type_size;
+    hssize_t npoints;
+    char chunk_str[H5S_MAX_RANK * 21 + 1];
+    int any = 0;
+    int ndims;
+    int d;
+    herr_t ret_value = SUCCEED;
+
+    if((ndims = H5Sget_simple_extent_dims(dd->space_id, dims, maxdims)) < 0)
+        ERROR("Unable to get space dimensions");
+
+    /* Bounding box of this rank's selection, empty if there is none */
+    for(d = 0; d < ndims; d++)
+        local[d] = 0;
+    if(file_space_id == H5S_ALL) {
+        for(d = 0; d < ndims; d++)
+            local[d] = (unsigned long long)dims[d];
+    }
+    else if(file_space_id >= 0) {
+        if((npoints = H5Sget_select_npoints(file_space_id)) < 0)
+            ERROR("Unable to get number of selected points");
+        if(npoints > 0 && ndims > 0) {
+            if(H5Sget_select_bounds(file_space_id, start, end) < 0)
+                ERROR("Unable to get selection bounds");
+            for(d = 0; d < ndims; d++)
+                local[d] = (unsigned long long)(end[d] - start[d] + 1);
+        }
+    }
+
+    /* Collective for files opened with MPI-IO */
+    if((dd->comm != MPI_COMM_NULL) && (ndims > 0)) {
+        if(MPI_Allreduce(local, global, ndims, MPI_UNSIGNED_LONG_LONG, MPI_MAX, dd->comm) != MPI_SUCCESS)
+            ERROR("Unable to agree on chunk dimensions");
+    }
+    else
+        for(d = 0; d < ndims; d++)
+            global[d] = local[d];
+
+    /* Scalar datasets and fixed empty dimensions cannot be chunked, keep the
+     * layout of the application */
+    if(ndims == 0)
+        goto done;
+    for(d = 0; d < ndims; d++)
+        if(maxdims[d] == 0)
+            goto done;
+
+    for(d = 0; d < ndims; d++)
+        if(global[d] > 0)
+            any = 1;
+    for(d = 0; d < ndims; d++) {
+        chunk[d] = any ? (hsize_t)global[d] : dims[d];
+        if((maxdims[d] != H5S_UNLIMITED) && (chunk[d] > maxdims[d]))
+            chunk[d] = maxdims[d];
+        if(chunk[d] > DEFER_MAX_CHUNK_DIM)
+            chunk[d] = DEFER_MAX_CHUNK_DIM;
+        if(chunk[d] == 0)
+            chunk[d] = 1;
+    }
+
+    /* Halve the largest dimension until the chunk fits */
+    if(0 == (type_size = H5Tget_size(dd->type_id)))
+        ERROR("Unable to get datatype size");
+    for(;;) {
+        int largest = 0;
+
+        chunk_bytes = (hsize_t)type_size;
+        for(d = 0; d < ndims; d++) {
+            chunk_bytes *= chunk[d];
+            if(chunk[d] > chunk[largest])
+                largest = d;
+        }
+        if(chunk_bytes <= DEFER_MAX_CHUNK_BYTES || chunk[largest] == 1)
+            break;
+        chunk[largest] = (chunk[largest] + 1) / 2;
+    }
+
+    if(H5Pset_chunk(dd->dcpl_id, ndims, chunk) < 0)
+        ERROR("Unable to set chunk size");
+
+    chunk_str[0] = '\0';
+    for(d = 0; d < ndims; d++)
+        sprintf(chunk_str + strlen(chunk_str), "%s%llu", d ? "," : "", (long long unsigned)chunk[d]);
+
+    if(verbose_g >= 4)
+        printf("    Setting chunk size: {%s} for %s: %s\n", chunk_str, dd->filename, dd->name);
+
+    if(params_record("chunk", dd->name, chunk_str) < 0)
+        ERROR("Unable to record chunk size");
+
+done:
+    return ret_value;
+}
+
+
+void defer_created(defer_dset_t *dd, hid_t dset_id)
+{
+    dd->dset_id = dset_id;
+    defer_release(dd);
+
+    return;
+}
@@ -73,6 +73,9 @@ herr_t set_gpfs_parameter(mxml_node_t *tree, const char *parameter_name, const c
                     strcpy(*new_filename, "bglockless:");
                     strcat(*new_filename, filename);
 
+                    if(params_record(parameter_name, NULL, "true") < 0)
+                        ERROR("Unable to record GPFS parameter");
+
                     if(node_file_name)
                         break;
                 }
@@ -114,6 +117,8 @@ herr_t set_mpi_parameter(mxml_node_t *tree, const char *parameter_name, const ch
 
             if(MPI_Info_set(*orig_info, parameter_name, node->child->value.text.string) != MPI_SUCCESS)
                 ERROR("Failed to set MPI info");
+            if(params_record(parameter_name, NULL, node->child->value.text.string) < 0)
+                ERROR("Unable to record MPI parameter");
 
             if(node_file_name)
                 break;
@@ -130,6 +135,7 @@ hid_t set_fapl_parameter(mxml_node_t *tree, const char *parameter_name, const ch
     const char *node_file_name;
     const char *file_basename = NULL;
     mxml_node_t *node;
+    char value_str[64];
     herr_t ret_value = SUCCEED;
     hid_t dcpl_id = -1;
 
@@ -164,6 +170,10 @@ hid_t set_fapl_parameter(mxml_node_t *tree, const char *parameter_name, const ch
                 if(H5Pset_sieve_buf_size(fapl_id, (size_t)sieve_size) < 0)
                     ERROR("Unable to set sieve buffer size");
 
+                sprintf(value_str, "%lld", sieve_size);
+                if(params_record(parameter_name, NULL, value_str) < 0)
+                    ERROR("Unable to record sieve buffer size");
+
                 if(node_file_name)
                     break;
             }
@@ -201,6 +211,11 @@ hid_t set_fapl_parameter(mxml_node_t *tree, const char *parameter_name, const ch
                 if(H5Pset_alignment(fapl_id, (hsize_t)threshold, (hsize_t)alignment) < 0)
                     ERROR("Unable to set alignment");
 
+                /* The node text was split by strtok, rebuild it */
+                sprintf(value_str, "%lld,%lld", threshold, alignment);
+                if(params_record(parameter_name, NULL, value_str) < 0)
+                    ERROR("Unable to record alignment");
+
                 if(node_file_name)
                     break;
             }
@@ -214,7 +229,7 @@ done:
 }
 
 
-herr_t set_dcpl_parameter(mxml_node_t *tree, const char *parameter_name, const char *filename, const char *variable_name, hid_t space_id, hid_t dcpl_id)
+herr_t set_dcpl_parameter(mxml_node_t *tree, const char *parameter_name, const char *filename, const char *variable_name, const char *variable_path, hid_t space_id, hid_t dcpl_id, /* OUT */ int *chunk_auto)
 {
     const char *node_file_name;
     size_t filename_len = strlen(filename);
@@ -222,6 +237,7 @@ herr_t set_dcpl_parameter(mxml_node_t *tree, const char *parameter_name, const c
     mxml_node_t *node;
     hsize_t *dims = NULL;
     hsize_t *chunk_arr = NULL;
+    char *chunk_str = NULL;
     herr_t ret_value = SUCCEED;
 
     for(node = mxmlFindElement(tree, tree, parameter_name, NULL, NULL,MXML_DESCEND);
@@ -245,13 +261,27 @@ herr_t set_dcpl_parameter(mxml_node_t *tree, const char *parameter_name, const c
             if(!strcmp(parameter_name, "chunk")) {
                 const char* node_variable_name = mxmlElementGetAttr(node, "VariableName");
 
-                /* Check if this parameter applies to this dataset */
-                if(!node_variable_name || (!strcmp(node_variable_name, variable_name))) {
+                /* Check if this parameter applies to this dataset, named as
+                 * in the call or by its path in the file */
+                if(!node_variable_name || !strcmp(node_variable_name, variable_name)
+                        || (variable_path && !strcmp(node_variable_name, variable_path))) {
                     char *chunk_dim_str;
                     long long chunk_dim_ll;
                     int ndims;
                     int i;
 
+                    /* The chunk size is chosen at the first access, see
+                     * autotuner_defer.c */
+                    if(!strcmp(node->child->value.text.string, "auto")) {
+                        if(verbose_g >= 4)
+                            printf("    Deferring chunk size for %s: %s\n", filename, variable_name);
+                        *chunk_auto = 1;
+                        if(node_file_name && node_variable_name)
+                            break;
+                        continue;
+                    }
+                    *chunk_auto = 0;
+
                     if((ndims = H5Sget_simple_extent_ndims(space_id)) < 0)
                         ERROR("Unable to get number of space dimensions");
                     if(NULL == (dims = (hsize_t *)malloc(sizeof(hsize_t) * ndims)))
@@ -294,6 +324,19 @@ herr_t set_dcpl_parameter(mxml_node_t *tree, const char *parameter_name, const c
 
                     H5Pset_chunk(dcpl_id, ndims, chunk_arr);
 
+                    /* The node text was split by strtok, rebuild it */
+                    if(record_params_g != PARAMS_RECORD_NONE) {
+                        if(NULL == (chunk_str = (char *)malloc((size_t)ndims * 21 + 1)))
+                            ERROR("Unable to allocate chunk string");
+                        chunk_str[0] = '\0';
+                        for(i = 0; i < ndims; i++)
+                            sprintf(chunk_str + strlen(chunk_str), "%s%llu", i ? "," : "", (long long unsigned)chunk_arr[i]);
+                        if(params_record(parameter_name, variable_name, chunk_str) < 0)
+                            ERROR("Unable to record chunk size");
+                        free(chunk_str);
+                        chunk_str = NULL;
+                    }
+
                     if(node_file_name && node_variable_name)
                         break;
                 }
@@ -306,11 +349,112 @@ herr_t set_dcpl_parameter(mxml_node_t *tree, const char *parameter_name, const c
 done:
     free(dims);
     dims = NULL;
+    free(chunk_str);
+    chunk_str = NULL;
+
+    return ret_value;
+}
+
+
+/* Get the value of the rule for a dataset, NULL if none applies.  As for
+ * chunk rules, FileName matches the trailing bytes of filename, and
+ * VariableName the name of the dataset in the call or its path in the file.
+ * A rule with both attributes wins, otherwise the last one that applies. */
+const char *get_dset_rule(mxml_node_t *tree, const char *parameter_name, const char *filename, const char *variable_name,
+    const char *variable_path)
+{
+    const char *node_file_name;
+    const char *node_variable_name;
+    const char *value = NULL;
+    size_t filename_len = strlen(filename);
+    size_t node_file_name_len;
+    mxml_node_t *node;
+
+    for(node = mxmlFindElement(tree, tree, parameter_name, NULL, NULL, MXML_DESCEND);
+            node != NULL; node = mxmlFindElement(node, tree, parameter_name, NULL, NULL, MXML_DESCEND)) {
+        node_file_name = mxmlElementGetAttr(node, "FileName");
+        node_variable_name = mxmlElementGetAttr(node, "VariableName");
+
+        if(node_file_name) {
+            node_file_name_len = strlen(node_file_name);
+            if(node_file_name_len > filename_len || strcmp(filename + (filename_len - node_file_name_len), node_file_name))
+                continue;
+        }
+        if(node_variable_name && strcmp(node_variable_name, variable_name)
+                && (!variable_path || strcmp(node_variable_name, variable_path)))
+            continue;
+        if(!node->child)
+            continue;
+
+        value = node->child->value.text.string;
+        if(node_file_name && node_variable_name)
+            break;
+    }
+
+    return value;
+}
+
+
+herr_t set_aggregate_parameter(const char *value, const char *filename, const char *variable_name, /* OUT */ size_t *buf_size)
+{
+    long long size;
+    char value_str[32];
+    herr_t ret_value = SUCCEED;
+
+    *buf_size = 0;
+
+    if(!value)
+        goto done;
+
+    errno = 0;
+    size = strtoll(value, NULL, 10);
+    if(errno != 0)
+        ERROR("Unable to parse aggregation buffer size");
+    if(size < 0)
+        ERROR("Invalid value for aggregation buffer size");
+    *buf_size = (size_t)size;
+
+    if(*buf_size > 0) {
+        if(verbose_g >= 4)
+            printf("    Setting aggregation buffer size: %llu for %s: %s\n", (long long unsigned)*buf_size, filename, variable_name);
+
+        sprintf(value_str, "%llu", (long long unsigned)*buf_size);
+        if(params_record("aggregate", variable_name, value_str) < 0)
+            ERROR("Unable to record aggregation buffer size");
+    }
+
+done:
+    return ret_value;
+}
+
+herr_t set_transfer_parameter(const char *value, const char *filename, const char *variable_name, /* OUT */ int *transfer)
+{
+    herr_t ret_value = SUCCEED;
+
+    *transfer = COLLECTIVE_RULE_NONE;
+
+    if(!value)
+        goto done;
+
+    if(!strcmp(value, "lockstep"))
+        *transfer = COLLECTIVE_RULE_LOCKSTEP;
+    else if(!strcmp(value, "independent"))
+        *transfer = COLLECTIVE_RULE_INDEPENDENT;
+    else
+        ERROR("Invalid value for transfer rule, expected \"lockstep\" or \"independent\"");
+
+    if(verbose_g >= 4)
+        printf("    Setting transfer: %s for %s: %s\n", value, filename, variable_name);
 
+    if(params_record("transfer", variable_name, value) < 0)
+        ERROR("Unable to record transfer rule");
+
+done:
     return ret_value;
 }
 
 
+
 void
 set_verbose(void)
 {
@@ -328,8 +472,25 @@ set_verbose(void)
 FORWARD_DECL(H5Fcreate, hid_t, (const char *filename, unsigned flags, hid_t fcpl_id, hid_t fapl_id));
 FORWARD_DECL(H5Fopen, hid_t, (const char *filename, unsigned flags, hid_t fapl_id));
 FORWARD_DECL(H5Dwrite, herr_t, (hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void * buf));
+FORWARD_DECL(H5Dread, herr_t, (hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, void * buf));
+FORWARD_DECL(H5Dclose, herr_t, (hid_t dataset_id));
+FORWARD_DECL(H5Dget_space, hid_t, (hid_t dataset_id));
+FORWARD_DECL(H5Dget_type, hid_t, (hid_t dataset_id));
+FORWARD_DECL(H5Dget_create_plist, hid_t, (hid_t dataset_id));
+FORWARD_DECL(H5Dset_extent, herr_t, (hid_t dataset_id, const hsize_t size[]));
+FORWARD_DECL(H5Fclose, herr_t, (hid_t file_id));
+FORWARD_DECL(H5Fflush, herr_t, (hid_t object_id, H5F_scope_t scope));
 FORWARD_DECL(H5Dcreate1, hid_t, (hid_t loc_id, const char *name, hid_t type_id, hid_t space_id, hid_t dcpl_id));
 FORWARD_DECL(H5Dcreate2, hid_t, (hid_t loc_id, const char *name, hid_t dtype_id, hid_t space_id, hid_t lcpl_id, hid_t dcpl_id, hid_t dapl_id));
+FORWARD_DECL(MPI_Finalize, int, (void));
+FORWARD_DECL(MPI_File_open, int, (MPI_Comm comm, const char *filename, int amode, MPI_Info info, MPI_File *fh));
+FORWARD_DECL(MPI_File_close, int, (MPI_File *fh));
+FORWARD_DECL(MPI_File_set_view, int, (MPI_File fh, MPI_Offset disp, MPI_Datatype etype, MPI_Datatype filetype, const char *datarep, MPI_Info info));
+FORWARD_DECL(MPI_File_sync, int, (MPI_File fh));
+FORWARD_DECL(MPI_File_write_at, int, (MPI_File fh, MPI_Offset offset, const void *buf, int count, MPI_Datatype datatype, MPI_Status *status));
+FORWARD_DECL(MPI_File_write_at_all, int, (MPI_File fh, MPI_Offset offset, const void *buf, int count, MPI_Datatype datatype, MPI_Status *status));
+FORWARD_DECL(MPI_File_read_at, int, (MPI_File fh, MPI_Offset offset, void *buf, int count, MPI_Datatype datatype, MPI_Status *status));
+FORWARD_DECL(MPI_File_read_at_all, int, (MPI_File fh, MPI_Offset offset, void *buf, int count, MPI_Datatype datatype, MPI_Status *status));
 
 
 hid_t DECL(H5Fcreate)(const char *filename, unsigned flags, hid_t fcpl_id, hid_t fapl_id)
@@ -344,10 +505,20 @@ hid_t DECL(H5Fcreate)(const char *filename, unsigned flags, hid_t fcpl_id, hid_t
     char *config_file = getenv("H5TUNER_CONFIG_FILE");
     hid_t real_fapl_id = -1;
     hid_t driver;
+    double start = 0.0;
+    double profile_time = 0.0;
 
     MAP_OR_FAIL(H5Fcreate);
 
     set_verbose();
+    set_trace();
+    set_cost();
+    set_mpiio();
+    set_pattern();
+    set_live();
+    set_skeleton();
+    set_record_params();
+    set_self_profile();
 
     if(!library_message_g) {
         if(verbose_g)
@@ -361,11 +532,15 @@ hid_t DECL(H5Fcreate)(const char *filename, unsigned flags, hid_t fcpl_id, hid_t
             printf("  Loading parameters file: %s\n", config_file ? config_file : "config.xml");
     }
 
+    PROFILE_START(profile_time);
+
     if(NULL == (fp = fopen(config_file ? config_file : "config.xml", "r")))
         ERROR("Unable to open config file");
     if(NULL == (tree = mxmlLoadFile(NULL, fp, MXML_TEXT_CALLBACK)))
         ERROR("Unable to load config file");
 
+    PROFILE_PHASE(PROF_H5FCREATE, PROF_CONFIG_LOAD, profile_time);
+
     /* Set up/copy FAPL */
     if(fapl_id == H5P_DEFAULT) {
         if((real_fapl_id = H5Pcreate(H5P_FILE_ACCESS)) < 0)
@@ -377,6 +552,8 @@ hid_t DECL(H5Fcreate)(const char *filename, unsigned flags, hid_t fcpl_id, hid_t
     if((driver = H5Pget_driver(real_fapl_id)) < 0)
         ERROR("Unable to get file driver");
 
+    PROFILE_PHASE(PROF_H5FCREATE, PROF_PROPERTY_COPY, profile_time);
+
     if(driver == H5FD_MPIO) {
         if(H5Pget_fapl_mpio(real_fapl_id, &new_comm, &new_info) < 0)
             ERROR("Unable to get MPIO file driver info");
@@ -416,11 +593,16 @@ hid_t DECL(H5Fcreate)(const char *filename, unsigned flags, hid_t fcpl_id, hid_t
             ERROR("Unable to set MPI file driver");
     }
 
+    /* Includes matching the MPI hint rules */
+    PROFILE_PHASE(PROF_H5FCREATE, PROF_MPI_INFO, profile_time);
+
     if(set_fapl_parameter(tree, "sieve_buf_size", filename, real_fapl_id) < 0)
         ERROR("Unable to set FAPL parameter \"sieve_buf_size\"");
     if(set_fapl_parameter(tree, "alignment", filename, real_fapl_id) < 0)
         ERROR("Unable to set FAPL parameter \"alignment\"");
 
+    PROFILE_PHASE(PROF_H5FCREATE, PROF_RULE_MATCH, profile_time);
+
 #ifdef DEBUG
     if(driver == H5FD_MPIO) {
         int nkeys = -1;
@@ -431,9 +613,37 @@ hid_t DECL(H5Fcreate)(const char *filename, unsigned flags, hid_t fcpl_id, hid_t
     }
 #endif
 
+    if(TIMING_ENABLED)
+        start = h5tuner_wtime();
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5FCREATE, -1, filename);
+
     ret_value = __fake_H5Fcreate(new_filename ? new_filename : filename, flags, fcpl_id, real_fapl_id);
 
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    PROFILE_PHASE(PROF_H5FCREATE, PROF_HDF5_CALL, profile_time);
+
+    if(TIMING_ENABLED && (ret_value >= 0)) {
+        double end = h5tuner_wtime();
+
+        if(cost_enabled_g)
+            cost_add_io_time(end - start);
+        if(trace_enabled_g)
+            trace_event(TRACE_H5FCREATE, -1, filename, start, end, 0);
+        if(skeleton_enabled_g && (skeleton_file("fcreate", filename, flags, fapl_id, start, end) < 0))
+            DONE_ERROR("Unable to record file creation in skeleton");
+    }
+
+    if((ret_value >= 0) && (params_commit(ret_value) < 0))
+        DONE_ERROR("Unable to record applied parameters");
+
 done:
+    if(ret_value < 0)
+        params_discard();
+
     if(fp && (fclose(fp) != 0))
         DONE_ERROR("Failure closing config file");
 
@@ -465,10 +675,20 @@ hid_t DECL(H5Fopen)(const char *filename, unsigned flags, hid_t fapl_id)
     char *config_file = getenv("H5TUNER_CONFIG_FILE");
     hid_t real_fapl_id = -1;
     hid_t driver;
+    double start = 0.0;
+    double profile_time = 0.0;
 
     MAP_OR_FAIL(H5Fopen);
 
     set_verbose();
+    set_trace();
+    set_cost();
+    set_mpiio();
+    set_pattern();
+    set_live();
+    set_skeleton();
+    set_record_params();
+    set_self_profile();
 
     if(!library_message_g) {
         if(verbose_g)
@@ -482,11 +702,15 @@ hid_t DECL(H5Fopen)(const char *filename, unsigned flags, hid_t fapl_id)
             printf("  Loading parameters file: %s\n", config_file ? config_file : "config.xml");
     }
 
+    PROFILE_START(profile_time);
+
     if(NULL == (fp = fopen(config_file ? config_file : "config.xml", "r")))
         ERROR("Unable to open config file");
     if(NULL == (tree = mxmlLoadFile(NULL, fp, MXML_TEXT_CALLBACK)))
         ERROR("Unable to load config file");
 
+    PROFILE_PHASE(PROF_H5FOPEN, PROF_CONFIG_LOAD, profile_time);
+
     /* Set up/copy FAPL */
     if(fapl_id == H5P_DEFAULT) {
         if((real_fapl_id = H5Pcreate(H5P_FILE_ACCESS)) < 0)
@@ -498,6 +722,8 @@ hid_t DECL(H5Fopen)(const char *filename, unsigned flags, hid_t fapl_id)
     if((driver = H5Pget_driver(real_fapl_id)) < 0)
         ERROR("Unable to get file driver");
 
+    PROFILE_PHASE(PROF_H5FOPEN, PROF_PROPERTY_COPY, profile_time);
+
     if(driver == H5FD_MPIO) {
         if(H5Pget_fapl_mpio(real_fapl_id, &new_comm, &new_info) < 0)
             ERROR("Unable to get MPIO file driver info");
@@ -532,11 +758,16 @@ hid_t DECL(H5Fopen)(const char *filename, unsigned flags, hid_t fapl_id)
             ERROR("Unable to set MPI file driver");
     }
 
+    /* Includes matching the MPI hint rules */
+    PROFILE_PHASE(PROF_H5FOPEN, PROF_MPI_INFO, profile_time);
+
     if(set_fapl_parameter(tree, "sieve_buf_size", filename, real_fapl_id) < 0)
         ERROR("Unable to set FAPL parameter \"sieve_buf_size\"");
     if(set_fapl_parameter(tree, "alignment", filename, real_fapl_id) < 0)
         ERROR("Unable to set FAPL parameter \"alignment\"");
 
+    PROFILE_PHASE(PROF_H5FOPEN, PROF_RULE_MATCH, profile_time);
+
 #ifdef DEBUG
     if(driver == H5FD_MPIO) {
         int nkeys = -1;
@@ -547,9 +778,37 @@ hid_t DECL(H5Fopen)(const char *filename, unsigned flags, hid_t fapl_id)
     }
 #endif
 
+    if(TIMING_ENABLED)
+        start = h5tuner_wtime();
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5FOPEN, -1, filename);
+
     ret_value = __fake_H5Fopen(new_filename ? new_filename : filename, flags, real_fapl_id);
 
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    PROFILE_PHASE(PROF_H5FOPEN, PROF_HDF5_CALL, profile_time);
+
+    if(TIMING_ENABLED && (ret_value >= 0)) {
+        double end = h5tuner_wtime();
+
+        if(cost_enabled_g)
+            cost_add_io_time(end - start);
+        if(trace_enabled_g)
+            trace_event(TRACE_H5FOPEN, -1, filename, start, end, 0);
+        if(skeleton_enabled_g && (skeleton_file("fopen", filename, flags, fapl_id, start, end) < 0))
+            DONE_ERROR("Unable to record file open in skeleton");
+    }
+
+    if((ret_value >= 0) && (params_commit(ret_value) < 0))
+        DONE_ERROR("Unable to record applied parameters");
+
 done:
+    if(ret_value < 0)
+        params_discard();
+
     if(fp && (fclose(fp) != 0))
         DONE_ERROR("Failure closing config file");
 
@@ -569,12 +828,223 @@ done:
 }
 
 
-herr_t DECL(H5Dwrite)(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void * buf) {
+/* Get the dataset behind a deferred dataset proxy, creating it with chunks
+ * fitting file_space_id (none if negative) if it was not created yet.
+ * Other IDs are returned as they are. */
+static hid_t resolve_dataset(hid_t dataset_id, hid_t file_space_id)
+{
+    defer_dset_t *dd;
+    double start = 0.0;
+    hid_t ret_value = -1;
+
+    if(NULL == (dd = defer_lookup(dataset_id)))
+        return dataset_id;
+    if(dd->loc_id < 0)
+        return dd->dset_id;
+
+    MAP_OR_FAIL(H5Dcreate2);
+
+    if(verbose_g >= 2)
+        printf("Creating deferred dataset %s: %s\n", dd->filename, dd->name);
+
+    /* Commit the parameters of H5Dcreate with the chunk shape */
+    if(params_restore(dd->params) < 0)
+        DONE_ERROR("Unable to record applied parameters");
+    dd->params = NULL;
+
+    if(defer_chunk(dd, file_space_id) < 0)
+        ERROR("Unable to choose chunk dimensions");
+
+    if(TIMING_ENABLED)
+        start = h5tuner_wtime();
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5DCREATE, -1, NULL);
+
+    ret_value = __fake_H5Dcreate2(dd->loc_id, dd->name, dd->type_id, dd->space_id, dd->lcpl_id, dd->dcpl_id, dd->dapl_id);
+
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    if(ret_value < 0)
+        ERROR("Unable to create deferred dataset");
+
+    if(TIMING_ENABLED) {
+        double end = h5tuner_wtime();
+
+        if(cost_enabled_g)
+            cost_add_io_time(end - start);
+        if(trace_enabled_g)
+            trace_event(TRACE_H5DCREATE, ret_value, NULL, start, end, 0);
+        if(skeleton_enabled_g && (skeleton_dcreate(ret_value, dd->type_id, dd->space_id, dd->app_dcpl_id, start, end) < 0))
+            DONE_ERROR("Unable to record dataset creation in skeleton");
+    }
+
+    if(params_commit(ret_value) < 0)
+        DONE_ERROR("Unable to record applied parameters");
+
+    if(dd->aggregate && (aggregate_register(ret_value, dd->aggregate) < 0))
+        DONE_ERROR("Unable to set up write aggregation");
+    if(dd->transfer && (collective_set_rule(ret_value, dd->transfer) < 0))
+        DONE_ERROR("Unable to set transfer rule");
+
+done:
+    if(ret_value < 0)
+        params_discard();
+
+    /* A failed creation is not retried */
+    defer_created(dd, ret_value);
+
+    return ret_value;
+}
+
+
+/* Get the name of the file of an object, to be freed by the caller.
+ * Returns NULL on failure. */
+static char *get_filename(hid_t obj_id)
+{
+    char *filename;
+    ssize_t filename_len;
+
+    if((filename_len = H5Fget_name(obj_id, NULL, 0)) < 0)
+        return NULL;
+    if(NULL == (filename = (char *)malloc((size_t)filename_len + 1)))
+        return NULL;
+    if(H5Fget_name(obj_id, filename, (size_t)filename_len + 1) < 0) {
+        free(filename);
+        return NULL;
+    }
+
+    return filename;
+}
+
+
+/* Create the deferred datasets of a file that were never accessed */
+static herr_t create_pending_datasets(hid_t file_id)
+{
+    char *filename = NULL;
+    hid_t proxy_id;
+    herr_t ret_value = SUCCEED;
+
+    if(NULL == (filename = get_filename(file_id)))
+        ERROR("Unable to get HDF5 file name");
+
+    /* In the order of their H5Dcreate, the same on all ranks */
+    while((proxy_id = defer_next_pending(filename)) >= 0)
+        if(resolve_dataset(proxy_id, -1) < 0)
+            ret_value = FAIL;
+
+done:
+    free(filename);
+    filename = NULL;
+
+    return ret_value;
+}
+
+
+/* Write the aggregated data of the datasets in the file of an object */
+static herr_t flush_file_buffers(hid_t obj_id)
+{
+    char *filename = NULL;
+    herr_t ret_value = SUCCEED;
+
+    if(NULL == (filename = get_filename(obj_id)))
+        ERROR("Unable to get HDF5 file name");
+    if(aggregate_flush_file(filename) < 0)
+        ERROR("Unable to write aggregated data");
+
+done:
+    free(filename);
+    filename = NULL;
+
+    return ret_value;
+}
+
+
+/* Call HDF5's H5Dwrite without recording it, from the write-behind thread
+ * or for padding */
+herr_t call_write(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void * buf)
+{
+    MAP_OR_FAIL(H5Dwrite);
+
+    return __fake_H5Dwrite(dataset_id, mem_type_id, mem_space_id, file_space_id, xfer_plist_id, buf);
+}
+
+
+/* Add a write to the statistics, trace, live metrics and cost */
+void record_write(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, double start, double end)
+{
+    hssize_t nbytes;
+
+    if(cost_enabled_g)
+        cost_add_transfer_time(1, end - start);
+
+    if((nbytes = get_io_bytes(dataset_id, mem_type_id, mem_space_id, file_space_id)) < 0)
+        DONE_ERROR("Unable to get number of bytes written");
+    else {
+        if(stats_enabled_g && (stats_record_io(dataset_id, 1, file_space_id, nbytes, end - start) < 0))
+            DONE_ERROR("Unable to record write statistics");
+        if(live_enabled_g && (live_record(dataset_id, 1, nbytes, end - start) < 0))
+            DONE_ERROR("Unable to publish live metrics");
+        if(trace_enabled_g)
+            trace_event(TRACE_H5DWRITE, dataset_id, NULL, start, end, nbytes);
+    }
+
+    return;
+}
+
+
+/* Forward a write to HDF5, timed for the statistics, trace, live metrics and
+ * cost.  With write-behind, the write is queued if it can be. */
+herr_t forward_write(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void * buf)
+{
     herr_t ret = -1;
+    double start = 0.0;
+    int queued = 0;
 
     MAP_OR_FAIL(H5Dwrite);
 
+    if(async_write(dataset_id, mem_type_id, mem_space_id, file_space_id, xfer_plist_id, buf, &queued) < 0)
+        DONE_ERROR("Unable to queue write");
+    else if(queued)
+        return SUCCEED;
+
+    if(TIMING_ENABLED)
+        start = h5tuner_wtime();
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5DWRITE, dataset_id, NULL);
+
+    ret = __fake_H5Dwrite(dataset_id, mem_type_id, mem_space_id, file_space_id, xfer_plist_id, buf);
+
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    if(TIMING_ENABLED && (ret >= 0))
+        record_write(dataset_id, mem_type_id, mem_space_id, file_space_id, start, h5tuner_wtime());
+
+    return ret;
+}
+
+
+herr_t DECL(H5Dwrite)(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void * buf) {
+    herr_t ret = -1;
+    double start = 0.0;
+    hid_t adapted_dxpl_id = -1;
+    hid_t real_dxpl_id;
+    int buffered = 0;
+
     set_verbose();
+    set_stats();
+    set_trace();
+    set_cost();
+    set_mpiio();
+    set_pattern();
+    set_live();
+    set_skeleton();
+    set_aggregate();
+    set_async();
+    set_collective();
 
     if(!library_message_g) {
         if(verbose_g)
@@ -585,6 +1055,12 @@ herr_t DECL(H5Dwrite)(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, h
     if(verbose_g >= 2)
         printf("Entering H5Tuner/H5Dwrite()\n");
 
+    /* Create a deferred dataset, with chunks fitting this selection */
+    if((dataset_id = resolve_dataset(dataset_id, file_space_id)) < 0) {
+        DONE_ERROR("Unable to create deferred dataset");
+        return ret;
+    }
+
 #ifdef DEBUG
     /* printf("dataset_id: %d\n", dataset_id);
       printf("mem_type_id: %d\n", mem_type_id);
@@ -593,21 +1069,427 @@ herr_t DECL(H5Dwrite)(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, h
       printf("xfer_plist_id: %d\n", xfer_plist_id); */
 #endif
 
-    ret = __fake_H5Dwrite(dataset_id, mem_type_id, mem_space_id, file_space_id, xfer_plist_id, buf);
+    /* Use the transfer mode learned from earlier accesses */
+    if((pattern_enabled_g == PATTERN_ADAPTIVE) && (pattern_adapt_dxpl(dataset_id, 1, xfer_plist_id, &adapted_dxpl_id) < 0))
+        DONE_ERROR("Unable to adapt transfer mode");
+
+    /* Make the write collective if the ranks write in lockstep */
+    if(collective_enabled_g && (adapted_dxpl_id < 0) && (collective_adapt_dxpl(dataset_id, xfer_plist_id, &adapted_dxpl_id) < 0))
+        DONE_ERROR("Unable to promote transfer mode");
+    real_dxpl_id = adapted_dxpl_id >= 0 ? adapted_dxpl_id : xfer_plist_id;
+
+    if(skeleton_enabled_g)
+        start = h5tuner_wtime();
+
+    /* Small writes to datasets with an aggregate rule are buffered, and
+     * written later with forward_write(), which may queue them */
+    if(aggregate_write(dataset_id, mem_type_id, mem_space_id, file_space_id, real_dxpl_id, buf, &buffered) < 0)
+        DONE_ERROR("Unable to write aggregated data");
+    else if(buffered)
+        ret = SUCCEED;
+    else
+        ret = forward_write(dataset_id, mem_type_id, mem_space_id, file_space_id, real_dxpl_id, buf);
+
+    if(skeleton_enabled_g && (ret >= 0) && (skeleton_io(dataset_id, 1, file_space_id, xfer_plist_id, start, h5tuner_wtime()) < 0))
+        DONE_ERROR("Unable to record write in skeleton");
+
+    if(pattern_enabled_g && (ret >= 0) && (pattern_record(dataset_id, 1, xfer_plist_id, file_space_id) < 0))
+        DONE_ERROR("Unable to record access pattern");
+
+    if((adapted_dxpl_id >= 0) && (H5Pclose(adapted_dxpl_id) < 0))
+        DONE_ERROR("Failure closing DXPL");
 
     return ret;
 }
 
 
-hid_t prepare_dcpl(hid_t loc_id, const char *name, hid_t space_id, hid_t dcpl_id)
+herr_t DECL(H5Dread)(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, void * buf) {
+    herr_t ret = -1;
+    hssize_t nbytes;
+    double start = 0.0;
+    hid_t adapted_dxpl_id = -1;
+
+    MAP_OR_FAIL(H5Dread);
+
+    set_verbose();
+    set_stats();
+    set_trace();
+    set_cost();
+    set_mpiio();
+    set_pattern();
+    set_live();
+    set_skeleton();
+
+    if(!library_message_g) {
+        if(verbose_g)
+            printf("H5Tuner library loaded\n");
+        library_message_g = 1;
+    }
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/H5Dread()\n");
+
+    /* Create a deferred dataset, with chunks fitting this selection */
+    if((dataset_id = resolve_dataset(dataset_id, file_space_id)) < 0) {
+        DONE_ERROR("Unable to create deferred dataset");
+        return ret;
+    }
+
+    /* Read what was written */
+    if(aggregate_flush(dataset_id) < 0) {
+        DONE_ERROR("Unable to write aggregated data");
+        return ret;
+    }
+    if(async_drain(dataset_id) < 0) {
+        DONE_ERROR("Unable to complete queued writes");
+        return ret;
+    }
+
+    /* Use the transfer mode learned from earlier accesses */
+    if((pattern_enabled_g == PATTERN_ADAPTIVE) && (pattern_adapt_dxpl(dataset_id, 0, xfer_plist_id, &adapted_dxpl_id) < 0))
+        DONE_ERROR("Unable to adapt transfer mode");
+
+    if(TIMING_ENABLED)
+        start = h5tuner_wtime();
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5DREAD, dataset_id, NULL);
+
+    ret = __fake_H5Dread(dataset_id, mem_type_id, mem_space_id, file_space_id, adapted_dxpl_id >= 0 ? adapted_dxpl_id : xfer_plist_id, buf);
+
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    if(TIMING_ENABLED && (ret >= 0)) {
+        double end = h5tuner_wtime();
+
+        if(cost_enabled_g)
+            cost_add_transfer_time(0, end - start);
+
+        if((nbytes = get_io_bytes(dataset_id, mem_type_id, mem_space_id, file_space_id)) < 0)
+            DONE_ERROR("Unable to get number of bytes read");
+        else {
+            if(stats_enabled_g && (stats_record_io(dataset_id, 0, file_space_id, nbytes, end - start) < 0))
+                DONE_ERROR("Unable to record read statistics");
+            if(live_enabled_g && (live_record(dataset_id, 0, nbytes, end - start) < 0))
+                DONE_ERROR("Unable to publish live metrics");
+            if(trace_enabled_g)
+                trace_event(TRACE_H5DREAD, dataset_id, NULL, start, end, nbytes);
+        }
+
+        if(skeleton_enabled_g && (skeleton_io(dataset_id, 0, file_space_id, xfer_plist_id, start, end) < 0))
+            DONE_ERROR("Unable to record read in skeleton");
+    }
+
+    if(pattern_enabled_g && (ret >= 0) && (pattern_record(dataset_id, 0, xfer_plist_id, file_space_id) < 0))
+        DONE_ERROR("Unable to record access pattern");
+
+    if((adapted_dxpl_id >= 0) && (H5Pclose(adapted_dxpl_id) < 0))
+        DONE_ERROR("Failure closing DXPL");
+
+    return ret;
+}
+
+
+herr_t DECL(H5Dclose)(hid_t dataset_id) {
+    herr_t ret = -1;
+    herr_t aggregate_ret;
+    hid_t proxy_id = -1;
+    double start = 0.0;
+
+    MAP_OR_FAIL(H5Dclose);
+
+    set_verbose();
+    set_trace();
+    set_cost();
+    set_mpiio();
+    set_pattern();
+    set_live();
+    set_skeleton();
+    set_collective();
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/H5Dclose()\n");
+
+    /* Close the dataset behind a proxy, creating it if it was never
+     * accessed */
+    if(defer_lookup(dataset_id)) {
+        proxy_id = dataset_id;
+        if((dataset_id = resolve_dataset(proxy_id, -1)) < 0) {
+            DONE_ERROR("Unable to create deferred dataset");
+            if(H5Idec_ref(proxy_id) < 0)
+                DONE_ERROR("Failure closing deferred dataset proxy");
+            return ret;
+        }
+    }
+
+    /* Write the buffered data, an error is returned after closing */
+    if((aggregate_ret = aggregate_close(dataset_id)) < 0)
+        DONE_ERROR("Unable to write aggregated data");
+    if(async_drain(dataset_id) < 0) {
+        DONE_ERROR("Unable to complete queued writes");
+        aggregate_ret = FAIL;
+    }
+
+    /* Collective for files opened with MPI-IO, like H5Dclose */
+    if(collective_sync(dataset_id) < 0)
+        DONE_ERROR("Unable to check writes for lockstep");
+    if(pattern_enabled_g && (pattern_close(dataset_id) < 0))
+        DONE_ERROR("Unable to classify access pattern");
+
+    if(TIMING_ENABLED) {
+        /* Look up the names for the trace and skeleton while the dataset is
+         * still open */
+        if(trace_enabled_g || skeleton_enabled_g) {
+            dset_stats_t *stats;
+
+            if(stats_get_dset(dataset_id, &stats) < 0)
+                DONE_ERROR("Unable to get dataset statistics");
+        }
+
+        start = h5tuner_wtime();
+    }
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5DCLOSE, dataset_id, NULL);
+
+    ret = __fake_H5Dclose(dataset_id);
+
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    if(TIMING_ENABLED && (ret >= 0)) {
+        double end = h5tuner_wtime();
+
+        if(cost_enabled_g)
+            cost_add_io_time(end - start);
+        if(trace_enabled_g)
+            trace_event(TRACE_H5DCLOSE, dataset_id, NULL, start, end, 0);
+        if(skeleton_enabled_g && (skeleton_dclose(dataset_id, start, end) < 0))
+            DONE_ERROR("Unable to record dataset close in skeleton");
+    }
+
+    stats_close_dset(dataset_id);
+
+    if((proxy_id >= 0) && (ret >= 0) && (H5Idec_ref(proxy_id) < 0))
+        DONE_ERROR("Failure closing deferred dataset proxy");
+
+    return aggregate_ret < 0 ? FAIL : ret;
+}
+
+
+hid_t DECL(H5Dget_space)(hid_t dataset_id) {
+    defer_dset_t *dd;
+
+    MAP_OR_FAIL(H5Dget_space);
+
+    /* Answer from the proxy until the dataset is created */
+    if(NULL != (dd = defer_lookup(dataset_id))) {
+        if(dd->dset_id < 0)
+            return H5Scopy(dd->space_id);
+        dataset_id = dd->dset_id;
+    }
+
+    return __fake_H5Dget_space(dataset_id);
+}
+
+
+hid_t DECL(H5Dget_type)(hid_t dataset_id) {
+    defer_dset_t *dd;
+
+    MAP_OR_FAIL(H5Dget_type);
+
+    if(NULL != (dd = defer_lookup(dataset_id))) {
+        if(dd->dset_id < 0)
+            return H5Tcopy(dd->type_id);
+        dataset_id = dd->dset_id;
+    }
+
+    return __fake_H5Dget_type(dataset_id);
+}
+
+
+/* Until the dataset is created, the DCPL has no chunk shape yet */
+hid_t DECL(H5Dget_create_plist)(hid_t dataset_id) {
+    defer_dset_t *dd;
+
+    MAP_OR_FAIL(H5Dget_create_plist);
+
+    if(NULL != (dd = defer_lookup(dataset_id))) {
+        if(dd->dset_id < 0)
+            return H5Pcopy(dd->dcpl_id);
+        dataset_id = dd->dset_id;
+    }
+
+    return __fake_H5Dget_create_plist(dataset_id);
+}
+
+
+herr_t DECL(H5Dset_extent)(hid_t dataset_id, const hsize_t size[]) {
+    defer_dset_t *dd;
+
+    MAP_OR_FAIL(H5Dset_extent);
+
+    set_verbose();
+    set_collective();
+
+    /* Change the extent the dataset will be created with */
+    if(NULL != (dd = defer_lookup(dataset_id))) {
+        if(dd->dset_id < 0)
+            return defer_set_extent(dd, size);
+        dataset_id = dd->dset_id;
+    }
+
+    /* The buffered block and the queued writes are selected in the current
+     * extent */
+    if(aggregate_flush(dataset_id) < 0) {
+        DONE_ERROR("Unable to write aggregated data");
+        return FAIL;
+    }
+    if(async_drain(dataset_id) < 0) {
+        DONE_ERROR("Unable to complete queued writes");
+        return FAIL;
+    }
+
+    /* Collective, like H5Dset_extent */
+    if(collective_sync(dataset_id) < 0)
+        DONE_ERROR("Unable to check writes for lockstep");
+
+    return __fake_H5Dset_extent(dataset_id, size);
+}
+
+
+herr_t DECL(H5Fclose)(hid_t file_id) {
+    herr_t ret = -1;
+    herr_t aggregate_ret = SUCCEED;
+    char *filename = NULL;
+    ssize_t filename_len;
+    int size_owner = 0;
+    double start = 0.0;
+
+    MAP_OR_FAIL(H5Fclose);
+
+    set_verbose();
+    set_trace();
+    set_cost();
+    set_mpiio();
+    set_pattern();
+    set_live();
+    set_skeleton();
+    set_record_params();
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/H5Fclose()\n");
+
+    /* Collective for files opened with MPI-IO, like H5Fclose */
+    if(defer_has_pending() && (create_pending_datasets(file_id) < 0))
+        DONE_ERROR("Unable to create deferred datasets");
+
+    /* Write the buffered data of datasets left open */
+    if(aggregate_has_data() && ((aggregate_ret = flush_file_buffers(file_id)) < 0))
+        DONE_ERROR("Unable to write aggregated data");
+    if(async_drain(-1) < 0) {
+        DONE_ERROR("Unable to complete queued writes");
+        aggregate_ret = FAIL;
+    }
+
+    /* Record the applied parameters while the file is still open */
+    if(params_write(file_id) < 0)
+        DONE_ERROR("Unable to write applied parameters");
+    if(stats_free_comm(file_id) < 0)
+        DONE_ERROR("Unable to free file communicator");
+
+    if(TIMING_ENABLED) {
+        /* Get the file name for the trace, skeleton and file size while
+         * the file is still open */
+        if(cost_enabled_g && (cost_is_size_owner(file_id, &size_owner) < 0))
+            DONE_ERROR("Unable to check file size owner");
+        if(trace_enabled_g || skeleton_enabled_g || size_owner) {
+            if((filename_len = H5Fget_name(file_id, NULL, 0)) < 0)
+                DONE_ERROR("Unable to get HDF5 file name length");
+            else if(NULL == (filename = (char *)malloc((size_t)filename_len + 1)))
+                DONE_ERROR("Unable to allocate HDF5 file name buffer");
+            else if(H5Fget_name(file_id, filename, (size_t)filename_len + 1) < 0) {
+                DONE_ERROR("Unable to get HDF5 file name");
+                free(filename);
+                filename = NULL;
+            }
+        }
+
+        start = h5tuner_wtime();
+    }
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5FCLOSE, -1, filename);
+
+    ret = __fake_H5Fclose(file_id);
+
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    if(TIMING_ENABLED && (ret >= 0)) {
+        double end = h5tuner_wtime();
+
+        if(cost_enabled_g)
+            cost_add_io_time(end - start);
+        if(trace_enabled_g && filename)
+            trace_event(TRACE_H5FCLOSE, -1, filename, start, end, 0);
+        if(skeleton_enabled_g && filename && (skeleton_fclose(filename, start, end) < 0))
+            DONE_ERROR("Unable to record file close in skeleton");
+        if(size_owner && filename && (cost_add_file_size(filename) < 0))
+            DONE_ERROR("Unable to record file size");
+    }
+
+    free(filename);
+    filename = NULL;
+
+    return aggregate_ret < 0 ? FAIL : ret;
+}
+
+
+herr_t DECL(H5Fflush)(hid_t object_id, H5F_scope_t scope) {
+    herr_t aggregate_ret = SUCCEED;
+    herr_t ret;
+
+    MAP_OR_FAIL(H5Fflush);
+
+    set_verbose();
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/H5Fflush()\n");
+
+    if(aggregate_has_data() && ((aggregate_ret = flush_file_buffers(object_id)) < 0))
+        DONE_ERROR("Unable to write aggregated data");
+    if(async_drain(-1) < 0) {
+        DONE_ERROR("Unable to complete queued writes");
+        aggregate_ret = FAIL;
+    }
+
+    ret = __fake_H5Fflush(object_id, scope);
+
+    return aggregate_ret < 0 ? FAIL : ret;
+}
+
+
+hid_t prepare_dcpl(hid_t loc_id, const char *name, hid_t space_id, hid_t dcpl_id, /* OUT */ int *defer, size_t *aggregate,
+    int *transfer)
 {
     FILE *fp = NULL;
     mxml_node_t *tree;
     char *config_file = getenv("H5TUNER_CONFIG_FILE");
     char *h5_filename = NULL;
     ssize_t h5_filename_len;
+    char *variable_path = NULL;
+    ssize_t loc_name_len;
     hid_t copied_dcpl_id = -1;
     hid_t ret_value = -1;
+    double profile_time = 0.0;
+
+    *defer = 0;
+    *aggregate = 0;
+    *transfer = COLLECTIVE_RULE_NONE;
+
+    PROFILE_START(profile_time);
 
     if(verbose_g >= 3)
         printf("  Loading parameters file: %s\n", config_file ? config_file : "config.xml");
@@ -617,6 +1499,8 @@ hid_t prepare_dcpl(hid_t loc_id, const char *name, hid_t space_id, hid_t dcpl_id
     if(NULL == (tree = mxmlLoadFile(NULL, fp, MXML_TEXT_CALLBACK)))
         ERROR("Unable to load config file");
 
+    PROFILE_PHASE(PROF_H5DCREATE, PROF_CONFIG_LOAD, profile_time);
+
     /* Get file name */
     if((h5_filename_len = H5Fget_name(loc_id, NULL, 0)) < 0)
         ERROR("Unable to get HDF5 file name length");
@@ -625,6 +1509,25 @@ hid_t prepare_dcpl(hid_t loc_id, const char *name, hid_t space_id, hid_t dcpl_id
     if(H5Fget_name(loc_id, h5_filename, (size_t)h5_filename_len + 1) < 0)
         ERROR("Unable to get HDF5 file name");
 
+    /* Get the path of the new dataset in the file */
+    if(name[0] == '/') {
+        if(NULL == (variable_path = strdup(name)))
+            ERROR("Unable to copy dataset path");
+    }
+    else {
+        if((loc_name_len = H5Iget_name(loc_id, NULL, 0)) < 0)
+            ERROR("Unable to get location name length");
+        if(NULL == (variable_path = (char *)malloc((size_t)loc_name_len + strlen(name) + 2)))
+            ERROR("Unable to allocate dataset path buffer");
+        if(H5Iget_name(loc_id, variable_path, (size_t)loc_name_len + 1) < 0)
+            ERROR("Unable to get location name");
+        if(loc_name_len == 0 || variable_path[loc_name_len - 1] != '/')
+            strcat(variable_path, "/");
+        strcat(variable_path, name);
+    }
+
+    PROFILE_PHASE(PROF_H5DCREATE, PROF_RULE_MATCH, profile_time);
+
     /* Set up/copy DCPL */
     if(dcpl_id == H5P_DEFAULT) {
         if((copied_dcpl_id = H5Pcreate(H5P_DATASET_CREATE)) < 0)
@@ -633,8 +1536,18 @@ hid_t prepare_dcpl(hid_t loc_id, const char *name, hid_t space_id, hid_t dcpl_id
     else if((copied_dcpl_id = H5Pcopy(dcpl_id)) < 0)
         ERROR("Unable to copy DCPL");
 
-    if(set_dcpl_parameter(tree, "chunk", h5_filename, name, space_id, copied_dcpl_id) < 0)
+    PROFILE_PHASE(PROF_H5DCREATE, PROF_PROPERTY_COPY, profile_time);
+
+    if(set_dcpl_parameter(tree, "chunk", h5_filename, name, variable_path, space_id, copied_dcpl_id, defer) < 0)
         ERROR("Unable to set DCPL parameter \"chunk\"");
+    if(set_aggregate_parameter(get_dset_rule(tree, "aggregate", h5_filename, name, variable_path), h5_filename, name,
+            aggregate) < 0)
+        ERROR("Unable to set dataset parameter \"aggregate\"");
+    if(set_transfer_parameter(get_dset_rule(tree, "transfer", h5_filename, name, variable_path), h5_filename, name,
+            transfer) < 0)
+        ERROR("Unable to set dataset parameter \"transfer\"");
+
+    PROFILE_PHASE(PROF_H5DCREATE, PROF_RULE_MATCH, profile_time);
 
     ret_value = copied_dcpl_id;
 
@@ -644,6 +1557,8 @@ done:
 
     free(h5_filename);
     h5_filename = NULL;
+    free(variable_path);
+    variable_path = NULL;
 
     if((ret_value < 0) && (copied_dcpl_id >= 0) && (H5Pclose(copied_dcpl_id) < 0))
         DONE_ERROR("Failure closing DCPL");
@@ -656,10 +1571,25 @@ done:
 hid_t DECL(H5Dcreate1)(hid_t loc_id, const char *name, hid_t type_id, hid_t space_id, hid_t dcpl_id) {
     hid_t real_dcpl_id = -1;
     hid_t ret_value = -1;
+    int defer = 0;
+    size_t aggregate = 0;
+    int transfer = COLLECTIVE_RULE_NONE;
+    double start = 0.0;
+    double profile_time = 0.0;
 
     MAP_OR_FAIL(H5Dcreate1);
 
     set_verbose();
+    set_trace();
+    set_cost();
+    set_mpiio();
+    set_pattern();
+    set_live();
+    set_skeleton();
+    set_record_params();
+    set_self_profile();
+    set_aggregate();
+    set_collective();
 
     if(!library_message_g) {
         if(verbose_g)
@@ -671,12 +1601,53 @@ hid_t DECL(H5Dcreate1)(hid_t loc_id, const char *name, hid_t type_id, hid_t spac
         printf("Entering H5Tuner/H5Dcreate1()\n");
 
     /* Get real DCPL */
-    if((real_dcpl_id = prepare_dcpl(loc_id, name, space_id, dcpl_id)) < 0)
+    if((real_dcpl_id = prepare_dcpl(loc_id, name, space_id, dcpl_id, &defer, &aggregate, &transfer)) < 0)
         ERROR("Unable to obtain real DCPL");
 
+    /* Return a proxy, the dataset is created at its first access */
+    if(defer) {
+        if((ret_value = defer_register(loc_id, name, type_id, space_id, H5P_DEFAULT, real_dcpl_id, dcpl_id, H5P_DEFAULT, aggregate, transfer)) < 0)
+            ERROR("Unable to defer dataset creation");
+        goto done;
+    }
+
+    PROFILE_START(profile_time);
+    if(TIMING_ENABLED)
+        start = h5tuner_wtime();
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5DCREATE, -1, NULL);
+
     ret_value = __fake_H5Dcreate1(loc_id, name, type_id, space_id, real_dcpl_id);
 
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    PROFILE_PHASE(PROF_H5DCREATE, PROF_HDF5_CALL, profile_time);
+
+    if(TIMING_ENABLED && (ret_value >= 0)) {
+        double end = h5tuner_wtime();
+
+        if(cost_enabled_g)
+            cost_add_io_time(end - start);
+        if(trace_enabled_g)
+            trace_event(TRACE_H5DCREATE, ret_value, NULL, start, end, 0);
+        if(skeleton_enabled_g && (skeleton_dcreate(ret_value, type_id, space_id, dcpl_id, start, end) < 0))
+            DONE_ERROR("Unable to record dataset creation in skeleton");
+    }
+
+    if((ret_value >= 0) && (params_commit(ret_value) < 0))
+        DONE_ERROR("Unable to record applied parameters");
+
+    if((ret_value >= 0) && aggregate && (aggregate_register(ret_value, aggregate) < 0))
+        DONE_ERROR("Unable to set up write aggregation");
+    if((ret_value >= 0) && transfer && (collective_set_rule(ret_value, transfer) < 0))
+        DONE_ERROR("Unable to set transfer rule");
+
 done:
+    if(ret_value < 0)
+        params_discard();
+
     if((real_dcpl_id >= 0) && (H5Pclose(real_dcpl_id) < 0))
         DONE_ERROR("Failure closing DCPL");
     real_dcpl_id = -1;
@@ -687,10 +1658,25 @@ done:
 hid_t DECL(H5Dcreate2)(hid_t loc_id, const char *name, hid_t dtype_id, hid_t space_id, hid_t lcpl_id, hid_t dcpl_id, hid_t dapl_id) {
     hid_t real_dcpl_id = -1;
     hid_t ret_value = -1;
+    int defer = 0;
+    size_t aggregate = 0;
+    int transfer = COLLECTIVE_RULE_NONE;
+    double start = 0.0;
+    double profile_time = 0.0;
 
     MAP_OR_FAIL(H5Dcreate2);
 
     set_verbose();
+    set_trace();
+    set_cost();
+    set_mpiio();
+    set_pattern();
+    set_live();
+    set_skeleton();
+    set_record_params();
+    set_self_profile();
+    set_aggregate();
+    set_collective();
 
     if(!library_message_g) {
         if(verbose_g)
@@ -702,12 +1688,53 @@ hid_t DECL(H5Dcreate2)(hid_t loc_id, const char *name, hid_t dtype_id, hid_t spa
         printf("Entering H5Tuner/H5Dcreate2()\n");
 
     /* Get real DCPL */
-    if((real_dcpl_id = prepare_dcpl(loc_id, name, space_id, dcpl_id)) < 0)
+    if((real_dcpl_id = prepare_dcpl(loc_id, name, space_id, dcpl_id, &defer, &aggregate, &transfer)) < 0)
         ERROR("Unable to obtain real DCPL");
 
+    /* Return a proxy, the dataset is created at its first access */
+    if(defer) {
+        if((ret_value = defer_register(loc_id, name, dtype_id, space_id, lcpl_id, real_dcpl_id, dcpl_id, dapl_id, aggregate, transfer)) < 0)
+            ERROR("Unable to defer dataset creation");
+        goto done;
+    }
+
+    PROFILE_START(profile_time);
+    if(TIMING_ENABLED)
+        start = h5tuner_wtime();
+
+    if(mpiio_enabled_g)
+        mpiio_enter(TRACE_H5DCREATE, -1, NULL);
+
     ret_value = __fake_H5Dcreate2(loc_id, name, dtype_id, space_id, lcpl_id, real_dcpl_id, dapl_id);
 
+    if(mpiio_enabled_g)
+        mpiio_leave(start);
+
+    PROFILE_PHASE(PROF_H5DCREATE, PROF_HDF5_CALL, profile_time);
+
+    if(TIMING_ENABLED && (ret_value >= 0)) {
+        double end = h5tuner_wtime();
+
+        if(cost_enabled_g)
+            cost_add_io_time(end - start);
+        if(trace_enabled_g)
+            trace_event(TRACE_H5DCREATE, ret_value, NULL, start, end, 0);
+        if(skeleton_enabled_g && (skeleton_dcreate(ret_value, dtype_id, space_id, dcpl_id, start, end) < 0))
+            DONE_ERROR("Unable to record dataset creation in skeleton");
+    }
+
+    if((ret_value >= 0) && (params_commit(ret_value) < 0))
+        DONE_ERROR("Unable to record applied parameters");
+
+    if((ret_value >= 0) && aggregate && (aggregate_register(ret_value, aggregate) < 0))
+        DONE_ERROR("Unable to set up write aggregation");
+    if((ret_value >= 0) && transfer && (collective_set_rule(ret_value, transfer) < 0))
+        DONE_ERROR("Unable to set transfer rule");
+
 done:
+    if(ret_value < 0)
+        params_discard();
+
     if((real_dcpl_id >= 0) && (H5Pclose(real_dcpl_id) < 0))
         DONE_ERROR("Failure closing DCPL");
     real_dcpl_id = -1;
@@ -715,3 +1742,249 @@ done:
     return ret_value;
 }
 
+
+int DECL(MPI_Finalize)(void) {
+    MAP_OR_FAIL(MPI_Finalize);
+
+    set_verbose();
+
+    /* The finalize calls below are collective, so whether they run must
+     * depend on the environment only, not on the HDF5 calls this rank made */
+    set_stats();
+    set_cost();
+    set_self_profile();
+    set_mpiio();
+    set_trace();
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_Finalize()\n");
+
+    /* Write the buffered data of datasets never closed, so that it is in the
+     * statistics */
+    if(aggregate_flush_file(NULL) < 0)
+        DONE_ERROR("Unable to write aggregated data");
+    if(async_finalize() < 0)
+        DONE_ERROR("Unable to complete queued writes");
+
+    /* Reduce statistics across ranks while MPI is still available */
+    if(stats_finalize() < 0)
+        DONE_ERROR("Unable to reduce H5Tuner statistics");
+    if(trace_finalize() < 0)
+        DONE_ERROR("Unable to finalize H5Tuner trace");
+    if(cost_finalize() < 0)
+        DONE_ERROR("Unable to write H5Tuner cost file");
+    if(profile_finalize() < 0)
+        DONE_ERROR("Unable to write H5Tuner self profile");
+    if(mpiio_finalize() < 0)
+        DONE_ERROR("Unable to write H5Tuner MPI-IO summary");
+
+    return __fake_MPI_Finalize();
+}
+
+
+int DECL(MPI_File_open)(MPI_Comm comm, const char *filename, int amode, MPI_Info info, MPI_File *fh) {
+    int ret;
+    double start;
+
+    MAP_OR_FAIL(MPI_File_open);
+
+    set_mpiio();
+
+    if(!mpiio_enabled_g)
+        return __fake_MPI_File_open(comm, filename, amode, info, fh);
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_File_open()\n");
+
+    start = h5tuner_wtime();
+    ret = __fake_MPI_File_open(comm, filename, amode, info, fh);
+    if(ret == MPI_SUCCESS) {
+        mpiio_record(TRACE_MPI_FILE_OPEN, start, h5tuner_wtime(), 0);
+    }
+
+    return ret;
+}
+
+
+int DECL(MPI_File_close)(MPI_File *fh) {
+    int ret;
+    double start;
+
+    MAP_OR_FAIL(MPI_File_close);
+
+    set_mpiio();
+
+    if(!mpiio_enabled_g)
+        return __fake_MPI_File_close(fh);
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_File_close()\n");
+
+    start = h5tuner_wtime();
+    ret = __fake_MPI_File_close(fh);
+    if(ret == MPI_SUCCESS) {
+        mpiio_record(TRACE_MPI_FILE_CLOSE, start, h5tuner_wtime(), 0);
+    }
+
+    return ret;
+}
+
+
+int DECL(MPI_File_set_view)(MPI_File fh, MPI_Offset disp, MPI_Datatype etype, MPI_Datatype filetype, const char *datarep, MPI_Info info) {
+    int ret;
+    double start;
+
+    MAP_OR_FAIL(MPI_File_set_view);
+
+    set_mpiio();
+
+    if(!mpiio_enabled_g)
+        return __fake_MPI_File_set_view(fh, disp, etype, filetype, datarep, info);
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_File_set_view()\n");
+
+    start = h5tuner_wtime();
+    ret = __fake_MPI_File_set_view(fh, disp, etype, filetype, datarep, info);
+    if(ret == MPI_SUCCESS) {
+        mpiio_record(TRACE_MPI_FILE_SET_VIEW, start, h5tuner_wtime(), 0);
+    }
+
+    return ret;
+}
+
+
+int DECL(MPI_File_sync)(MPI_File fh) {
+    int ret;
+    double start;
+
+    MAP_OR_FAIL(MPI_File_sync);
+
+    set_mpiio();
+
+    if(!mpiio_enabled_g)
+        return __fake_MPI_File_sync(fh);
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_File_sync()\n");
+
+    start = h5tuner_wtime();
+    ret = __fake_MPI_File_sync(fh);
+    if(ret == MPI_SUCCESS) {
+        mpiio_record(TRACE_MPI_FILE_SYNC, start, h5tuner_wtime(), 0);
+    }
+
+    return ret;
+}
+
+
+int DECL(MPI_File_write_at)(MPI_File fh, MPI_Offset offset, const void *buf, int count, MPI_Datatype datatype, MPI_Status *status) {
+    int ret;
+    double start;
+    long long nbytes = 0;
+    int type_size;
+
+    MAP_OR_FAIL(MPI_File_write_at);
+
+    set_mpiio();
+
+    if(!mpiio_enabled_g)
+        return __fake_MPI_File_write_at(fh, offset, buf, count, datatype, status);
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_File_write_at()\n");
+
+    start = h5tuner_wtime();
+    ret = __fake_MPI_File_write_at(fh, offset, buf, count, datatype, status);
+    if(ret == MPI_SUCCESS) {
+        if(MPI_Type_size(datatype, &type_size) == MPI_SUCCESS)
+            nbytes = (long long)count * (long long)type_size;
+        mpiio_record(TRACE_MPI_FILE_WRITE_AT, start, h5tuner_wtime(), nbytes);
+    }
+
+    return ret;
+}
+
+
+int DECL(MPI_File_write_at_all)(MPI_File fh, MPI_Offset offset, const void *buf, int count, MPI_Datatype datatype, MPI_Status *status) {
+    int ret;
+    double start;
+    long long nbytes = 0;
+    int type_size;
+
+    MAP_OR_FAIL(MPI_File_write_at_all);
+
+    set_mpiio();
+
+    if(!mpiio_enabled_g)
+        return __fake_MPI_File_write_at_all(fh, offset, buf, count, datatype, status);
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_File_write_at_all()\n");
+
+    start = h5tuner_wtime();
+    ret = __fake_MPI_File_write_at_all(fh, offset, buf, count, datatype, status);
+    if(ret == MPI_SUCCESS) {
+        if(MPI_Type_size(datatype, &type_size) == MPI_SUCCESS)
+            nbytes = (long long)count * (long long)type_size;
+        mpiio_record(TRACE_MPI_FILE_WRITE_AT_ALL, start, h5tuner_wtime(), nbytes);
+    }
+
+    return ret;
+}
+
+
+int DECL(MPI_File_read_at)(MPI_File fh, MPI_Offset offset, void *buf, int count, MPI_Datatype datatype, MPI_Status *status) {
+    int ret;
+    double start;
+    long long nbytes = 0;
+    int type_size;
+
+    MAP_OR_FAIL(MPI_File_read_at);
+
+    set_mpiio();
+
+    if(!mpiio_enabled_g)
+        return __fake_MPI_File_read_at(fh, offset, buf, count, datatype, status);
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_File_read_at()\n");
+
+    start = h5tuner_wtime();
+    ret = __fake_MPI_File_read_at(fh, offset, buf, count, datatype, status);
+    if(ret == MPI_SUCCESS) {
+        if(MPI_Type_size(datatype, &type_size) == MPI_SUCCESS)
+            nbytes = (long long)count * (long long)type_size;
+        mpiio_record(TRACE_MPI_FILE_READ_AT, start, h5tuner_wtime(), nbytes);
+    }
+
+    return ret;
+}
+
+
+int DECL(MPI_File_read_at_all)(MPI_File fh, MPI_Offset offset, void *buf, int count, MPI_Datatype datatype, MPI_Status *status) {
+    int ret;
+    double start;
+    long long nbytes = 0;
+    int type_size;
+
+    MAP_OR_FAIL(MPI_File_read_at_all);
+
+    set_mpiio();
+
+    if(!mpiio_enabled_g)
+        return __fake_MPI_File_read_at_all(fh, offset, buf, count, datatype, status);
+
+    if(verbose_g >= 2)
+        printf("Entering H5Tuner/MPI_File_read_at_all()\n");
+
+    start = h5tuner_wtime();
+    ret = __fake_MPI_File_read_at_all(fh, offset, buf, count, datatype, status);
+    if(ret == MPI_SUCCESS) {
+        if(MPI_Type_size(datatype, &type_size) == MPI_SUCCESS)
+            nbytes = (long long)count * (long long)type_size;
+        mpiio_record(TRACE_MPI_FILE_READ_AT_ALL, start, h5tuner_wtime(), nbytes);
+    }
+
+    return ret;
+}
@@ -0,0 +1,269 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Live metrics.  With H5TUNER_LIVE=1 each process publishes its running
+ * per-file write and read counters in the POSIX shared memory segment
+ * "/h5tuner-<pid>" (layout in autotuner_live.h), which h5tuner-top reads to
+ * show the I/O progress of the processes on a node.  The segment is removed
+ * when the process exits.
+ *
+ * Publishing never waits: the sequence lock is taken with a single
+ * compare-and-swap.  An update that finds it held by another thread of the
+ * process is kept in a small per-thread table instead, and published with
+ * the thread's next update that gets the lock.  Only updates that find the
+ * table full are counted as dropped.
+ */
+
+#include "autotuner_private.h"
+#include "autotuner_live.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* Global to indicate live metrics are enabled */
+int live_enabled_g = 0;
+
+/* Datasets whose updates a thread keeps while the lock is held */
+#define LIVE_NPENDING 8
+
+typedef struct live_pending_t {
+    dset_stats_t *stats;        /* NULL if the entry is free */
+    uint64_t write_ops;
+    uint64_t write_bytes;
+    uint64_t read_ops;
+    uint64_t read_bytes;
+    double write_time;
+    double read_time;
+} live_pending_t;
+
+static live_segment_t *live_seg_g = NULL;
+static char live_name_g[64];
+
+static __thread live_pending_t live_pending_g[LIVE_NPENDING];
+static __thread int live_npending_g = 0;
+
+
+static double live_realtime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+
+static void live_atexit(void)
+{
+    live_finalize();
+
+    return;
+}
+
+
+static herr_t live_open(void)
+{
+    int fd = -1;
+    void *addr;
+    herr_t ret_value = SUCCEED;
+
+    snprintf(live_name_g, sizeof(live_name_g), "%s%d", LIVE_SHM_PREFIX, (int)getpid());
+
+    if((fd = shm_open(live_name_g, O_CREAT | O_TRUNC | O_RDWR, 0644)) < 0)
+        ERROR("Unable to create shared memory segment");
+    if(ftruncate(fd, (off_t)sizeof(live_segment_t)) < 0) {
+        shm_unlink(live_name_g);
+        ERROR("Unable to size shared memory segment");
+    }
+    if(MAP_FAILED == (addr = mmap(NULL, sizeof(live_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))) {
+        shm_unlink(live_name_g);
+        ERROR("Unable to map shared memory segment");
+    }
+    live_seg_g = (live_segment_t *)addr;
+
+    /* The segment is zero filled; readers ignore it until the magic is set */
+    live_seg_g->version = LIVE_VERSION;
+    live_seg_g->rank = -1;
+    live_seg_g->pid = (int32_t)getpid();
+    live_seg_g->start_time = live_realtime();
+    live_seg_g->update_time = live_seg_g->start_time;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(live_seg_g->magic, LIVE_MAGIC, sizeof(LIVE_MAGIC));
+
+done:
+    if(fd >= 0)
+        close(fd);
+
+    return ret_value;
+}
+
+
+void set_live(void)
+{
+    static int live_set = 0;
+    char *live = getenv("H5TUNER_LIVE");
+
+    if(live_set)
+        return;
+    live_set = 1;
+
+    if(live && strtol(live, NULL, 10) > 0) {
+        if(live_open() < 0)
+            DONE_ERROR("Unable to create H5Tuner live metrics segment");
+        else {
+            live_enabled_g = 1;
+            atexit(live_atexit);
+        }
+    }
+
+    return;
+}
+
+
+/* Add an update to a thread's pending entry of the dataset */
+static void live_add(live_pending_t *pending, int is_write, hssize_t nbytes, double elapsed)
+{
+    if(is_write) {
+        pending->write_ops++;
+        pending->write_bytes += (uint64_t)nbytes;
+        pending->write_time += elapsed;
+    }
+    else {
+        pending->read_ops++;
+        pending->read_bytes += (uint64_t)nbytes;
+        pending->read_time += elapsed;
+    }
+
+    return;
+}
+
+
+/* Add the counters of an entry to its file's slot, with the lock held */
+static void live_publish(live_segment_t *seg, const live_pending_t *pending)
+{
+    dset_stats_t *stats = pending->stats;
+    live_file_t *file;
+
+    /* Find the file's slot.  The slot is kept with the dataset statistics,
+     * which outlive the dataset. */
+    if(stats->live_slot < 0) {
+        uint32_t i;
+
+        for(i = 0; i < seg->nfiles; i++)
+            if(!strncmp(seg->files[i].name, stats->filename, LIVE_NAME_LEN - 1))
+                break;
+        if(i == seg->nfiles && seg->nfiles < LIVE_MAX_FILES) {
+            strncpy(seg->files[i].name, stats->filename, LIVE_NAME_LEN - 1);
+            seg->nfiles++;
+        }
+        if(i < seg->nfiles)
+            stats->live_slot = (int)i;
+    }
+
+    if(stats->live_slot < 0) {
+        __atomic_add_fetch(&seg->dropped, pending->write_ops + pending->read_ops, __ATOMIC_RELAXED);
+        return;
+    }
+
+    file = &seg->files[stats->live_slot];
+    file->write_ops += pending->write_ops;
+    file->write_bytes += pending->write_bytes;
+    file->write_time += pending->write_time;
+    file->read_ops += pending->read_ops;
+    file->read_bytes += pending->read_bytes;
+    file->read_time += pending->read_time;
+
+    return;
+}
+
+
+herr_t live_record(hid_t dset_id, int is_write, hssize_t nbytes, double elapsed)
+{
+    live_segment_t *seg = live_seg_g;
+    dset_stats_t *stats;
+    live_pending_t update;
+    uint64_t seq;
+    int i;
+    herr_t ret_value = SUCCEED;
+
+    if(!seg)
+        return ret_value;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+
+    /* Take the sequence lock, without waiting.  If another thread holds it,
+     * keep the update for this thread's next one. */
+    seq = __atomic_load_n(&seg->seq, __ATOMIC_RELAXED);
+    if((seq & 1) || !__atomic_compare_exchange_n(&seg->seq, &seq, seq + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        for(i = 0; i < live_npending_g; i++)
+            if(live_pending_g[i].stats == stats)
+                break;
+        if(i == live_npending_g) {
+            if(live_npending_g == LIVE_NPENDING) {
+                __atomic_add_fetch(&seg->dropped, 1, __ATOMIC_RELAXED);
+                return ret_value;
+            }
+            memset(&live_pending_g[i], 0, sizeof(live_pending_t));
+            live_pending_g[i].stats = stats;
+            live_npending_g++;
+        }
+        live_add(&live_pending_g[i], is_write, nbytes, elapsed);
+        return ret_value;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memset(&update, 0, sizeof(update));
+    update.stats = stats;
+    live_add(&update, is_write, nbytes, elapsed);
+    live_publish(seg, &update);
+
+    /* Publish the updates kept while the lock was held */
+    for(i = 0; i < live_npending_g; i++)
+        live_publish(seg, &live_pending_g[i]);
+    live_npending_g = 0;
+
+    if(seg->rank < 0) {
+        int mpi_initialized = 0;
+        int mpi_finalized = 0;
+        int mpi_rank;
+
+        MPI_Initialized(&mpi_initialized);
+        if(mpi_initialized)
+            MPI_Finalized(&mpi_finalized);
+        if(mpi_initialized && !mpi_finalized && (MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank) == MPI_SUCCESS))
+            seg->rank = (int32_t)mpi_rank;
+    }
+    seg->update_time = live_realtime();
+
+    /* Release the sequence lock */
+    __atomic_store_n(&seg->seq, seq + 2, __ATOMIC_RELEASE);
+
+done:
+    return ret_value;
+}
+
+
+void live_finalize(void)
+{
+    if(!live_seg_g)
+        return;
+
+    munmap(live_seg_g, sizeof(live_segment_t));
+    live_seg_g = NULL;
+    if(shm_unlink(live_name_g) < 0)
+        DONE_ERROR("Unable to remove H5Tuner live metrics segment");
+
+    return;
+}
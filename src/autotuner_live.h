@@ -0,0 +1,61 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Layout of the POSIX shared memory segment "/h5tuner-<pid>" in which the
+ * H5Tuner library publishes the running counters of a process
+ * (H5TUNER_LIVE=1), read by h5tuner-top.
+ *
+ * The segment is protected by a sequence lock: the writer makes seq odd
+ * before it updates the segment and even again after.  A reader copies the
+ * segment and retries if seq was odd or changed during the copy.  Readers
+ * never write to the segment, so they cannot delay the writer.
+ */
+
+#ifndef _autotuner_live_H
+#define _autotuner_live_H
+
+#include <stdint.h>
+
+#define LIVE_MAGIC "H5TLIVE"
+#define LIVE_VERSION 1
+
+/* Segment names are LIVE_SHM_PREFIX followed by the process ID */
+#define LIVE_SHM_PREFIX "/h5tuner-"
+
+#define LIVE_MAX_FILES 64
+#define LIVE_NAME_LEN 256
+
+typedef struct live_file_t {
+    char name[LIVE_NAME_LEN];
+    uint64_t write_ops;
+    uint64_t write_bytes;
+    uint64_t read_ops;
+    uint64_t read_bytes;
+    double write_time;          /* Seconds in H5Dwrite */
+    double read_time;           /* Seconds in H5Dread */
+} live_file_t;
+
+typedef struct live_segment_t {
+    char magic[8];
+    uint32_t version;
+    int32_t rank;               /* -1 until MPI is initialized */
+    int32_t pid;
+    uint32_t nfiles;
+    uint64_t seq;               /* Odd while the writer updates */
+    uint64_t dropped;           /* Updates dropped, files beyond LIVE_MAX_FILES
+                                 * or kept updates beyond a thread's table */
+    double start_time;          /* Real time, seconds since the epoch */
+    double update_time;         /* Real time of the last update */
+    live_file_t files[LIVE_MAX_FILES];
+} live_segment_t;
+
+#endif /* _autotuner_live_H */
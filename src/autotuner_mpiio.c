@@ -0,0 +1,260 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * MPI-IO attribution.  With H5TUNER_MPIIO=1 the MPI_File_* calls made by
+ * HDF5 are timed and attributed to the intercepted HDF5 call that made
+ * them.  Each HDF5 wrapper sets the calling thread's context (operation,
+ * dataset, file) around its forwarded call.  MPI-IO time and bytes are
+ * added to the per-dataset statistics (H5TUNER_STATS), traced as events
+ * nested in the HDF5 call (H5TUNER_TRACE), and summarized per HDF5 call at
+ * MPI_Finalize, so the effect of hints such as cb_nodes on the time spent
+ * in MPI-IO can be seen.
+ */
+
+#include "autotuner_private.h"
+
+#define MPIIO_NFUNCS (TRACE_NOPS - TRACE_NHDF5_OPS)
+
+/* Row of the attribution table for MPI-IO calls made outside any
+ * intercepted HDF5 call */
+#define MPIIO_NO_CONTEXT TRACE_NHDF5_OPS
+
+typedef struct mpiio_ctx_t {
+    int active;
+    trace_op_t op;
+    hid_t dset_id;
+    const char *filename;
+    dset_stats_t *stats;
+    int trace_file_id;          /* Name ID of filename, -1 if none */
+} mpiio_ctx_t;
+
+/* Global to indicate MPI-IO attribution is enabled */
+int mpiio_enabled_g = 0;
+
+static int mpiio_finalized_g = 0;
+static __thread mpiio_ctx_t mpiio_ctx_g = {0, TRACE_H5FCREATE, -1, NULL, NULL, -1};
+
+/* Per HDF5 call (plus no context): calls and time of the HDF5 call, and
+ * calls, bytes and time of each MPI-IO function */
+static double hdf5_calls_g[TRACE_NHDF5_OPS + 1];
+static double hdf5_time_g[TRACE_NHDF5_OPS + 1];
+static double mpiio_calls_g[TRACE_NHDF5_OPS + 1][MPIIO_NFUNCS];
+static double mpiio_bytes_g[TRACE_NHDF5_OPS + 1][MPIIO_NFUNCS];
+static double mpiio_time_g[TRACE_NHDF5_OPS + 1][MPIIO_NFUNCS];
+
+static const char *op_names_g[TRACE_NOPS] = TRACE_OP_NAMES;
+
+
+static void mpiio_atexit(void)
+{
+    if(mpiio_finalize() < 0)
+        DONE_ERROR("Unable to write H5Tuner MPI-IO summary");
+
+    return;
+}
+
+
+void set_mpiio(void)
+{
+    static int mpiio_set = 0;
+    char *mpiio = getenv("H5TUNER_MPIIO");
+
+    if(mpiio_set)
+        return;
+    mpiio_set = 1;
+
+    if(mpiio && strtol(mpiio, NULL, 10) > 0) {
+        mpiio_enabled_g = 1;
+        atexit(mpiio_atexit);
+    }
+
+    return;
+}
+
+
+void mpiio_enter(trace_op_t op, hid_t dset_id, const char *filename)
+{
+    mpiio_ctx_g.active = 1;
+    mpiio_ctx_g.op = op;
+    mpiio_ctx_g.dset_id = dset_id;
+    mpiio_ctx_g.filename = filename;
+    mpiio_ctx_g.stats = NULL;
+    mpiio_ctx_g.trace_file_id = -1;
+
+    /* Look up the dataset now, so the MPI-IO wrappers (called from inside
+     * HDF5) never call back into HDF5 */
+    if(dset_id >= 0 && (stats_enabled_g || trace_enabled_g))
+        if(stats_get_dset(dset_id, &mpiio_ctx_g.stats) < 0) {
+            DONE_ERROR("Unable to get dataset statistics");
+            mpiio_ctx_g.stats = NULL;
+        }
+
+    /* Intern the names once per HDF5 call, not for each MPI-IO call under
+     * it */
+    if(trace_enabled_g) {
+        if(mpiio_ctx_g.stats)
+            trace_names_dset(mpiio_ctx_g.stats);
+        else if(filename)
+            mpiio_ctx_g.trace_file_id = trace_intern(filename);
+    }
+
+    return;
+}
+
+
+void mpiio_leave(double start)
+{
+    if(mpiio_ctx_g.active) {
+        hdf5_calls_g[mpiio_ctx_g.op] += 1.0;
+        hdf5_time_g[mpiio_ctx_g.op] += h5tuner_wtime() - start;
+    }
+    mpiio_ctx_g.active = 0;
+
+    return;
+}
+
+
+void mpiio_record(trace_op_t op, double start, double end, long long nbytes)
+{
+    int row = mpiio_ctx_g.active ? (int)mpiio_ctx_g.op : MPIIO_NO_CONTEXT;
+    int func = (int)op - TRACE_NHDF5_OPS;
+
+    mpiio_calls_g[row][func] += 1.0;
+    mpiio_bytes_g[row][func] += (double)nbytes;
+    mpiio_time_g[row][func] += end - start;
+
+    if(!mpiio_ctx_g.active)
+        return;
+
+    if(stats_enabled_g && mpiio_ctx_g.stats) {
+        if(op == TRACE_MPI_FILE_WRITE_AT || op == TRACE_MPI_FILE_WRITE_AT_ALL) {
+            mpiio_ctx_g.stats->val[STAT_MPIIO_WRITE_CALLS] += 1.0;
+            mpiio_ctx_g.stats->val[STAT_MPIIO_WRITE_BYTES] += (double)nbytes;
+            mpiio_ctx_g.stats->val[STAT_MPIIO_WRITE_TIME] += end - start;
+        }
+        else if(op == TRACE_MPI_FILE_READ_AT || op == TRACE_MPI_FILE_READ_AT_ALL) {
+            mpiio_ctx_g.stats->val[STAT_MPIIO_READ_CALLS] += 1.0;
+            mpiio_ctx_g.stats->val[STAT_MPIIO_READ_BYTES] += (double)nbytes;
+            mpiio_ctx_g.stats->val[STAT_MPIIO_READ_TIME] += end - start;
+        }
+    }
+
+    /* The names were interned by mpiio_enter() */
+    if(trace_enabled_g) {
+        if(mpiio_ctx_g.stats)
+            trace_event_names(op, mpiio_ctx_g.stats->trace_file_id, mpiio_ctx_g.stats->trace_dset_id, start, end, (hssize_t)nbytes);
+        else
+            trace_event_names(op, mpiio_ctx_g.trace_file_id, -1, start, end, (hssize_t)nbytes);
+    }
+
+    return;
+}
+
+
+/* Print the MPI-IO time and bytes under each HDF5 call.  Calls and bytes
+ * are summed over ranks, times are given as maximum and mean over ranks. */
+herr_t mpiio_finalize(void)
+{
+    int mpi_initialized = 0;
+    int mpi_finalized = 0;
+    int mpi_rank = 0;
+    int mpi_size = 1;
+    int nrows = TRACE_NHDF5_OPS + 1;
+    int ncols = 2 + 3 * MPIIO_NFUNCS;
+    double *local = NULL;
+    double *max = NULL;
+    double *sum = NULL;
+    int row, func;
+    herr_t ret_value = SUCCEED;
+
+    if(!mpiio_enabled_g || mpiio_finalized_g)
+        return ret_value;
+    mpiio_finalized_g = 1;
+
+    if(NULL == (local = (double *)malloc((size_t)(nrows * ncols) * sizeof(double))))
+        ERROR("Unable to allocate MPI-IO summary buffer");
+    for(row = 0; row < nrows; row++) {
+        double *vals = &local[row * ncols];
+
+        vals[0] = hdf5_calls_g[row];
+        vals[1] = hdf5_time_g[row];
+        for(func = 0; func < MPIIO_NFUNCS; func++) {
+            vals[2 + func] = mpiio_calls_g[row][func];
+            vals[2 + MPIIO_NFUNCS + func] = mpiio_bytes_g[row][func];
+            vals[2 + 2 * MPIIO_NFUNCS + func] = mpiio_time_g[row][func];
+        }
+    }
+
+    MPI_Initialized(&mpi_initialized);
+    if(mpi_initialized)
+        MPI_Finalized(&mpi_finalized);
+
+    if(mpi_initialized && !mpi_finalized) {
+        if(MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank) != MPI_SUCCESS)
+            ERROR("Unable to get MPI rank");
+        if(MPI_Comm_size(MPI_COMM_WORLD, &mpi_size) != MPI_SUCCESS)
+            ERROR("Unable to get MPI size");
+        if(mpi_rank == 0) {
+            if(NULL == (max = (double *)malloc((size_t)(nrows * ncols) * sizeof(double))))
+                ERROR("Unable to allocate MPI-IO summary buffer");
+            if(NULL == (sum = (double *)malloc((size_t)(nrows * ncols) * sizeof(double))))
+                ERROR("Unable to allocate MPI-IO summary buffer");
+        }
+        if(MPI_Reduce(local, max, nrows * ncols, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+            ERROR("Unable to reduce MPI-IO summary maximum");
+        if(MPI_Reduce(local, sum, nrows * ncols, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+            ERROR("Unable to reduce MPI-IO summary sum");
+    }
+    else {
+        max = local;
+        sum = local;
+    }
+
+    if(mpi_rank == 0) {
+        printf("# H5Tuner MPI-IO attribution: %d ranks\n", mpi_size);
+        printf("# hdf5_call calls time_max time_mean\n");
+        printf("#   mpi_function calls bytes time_max time_mean\n");
+        for(row = 0; row < nrows; row++) {
+            const double *rmax = &max[row * ncols];
+            const double *rsum = &sum[row * ncols];
+            int any = 0;
+
+            for(func = 0; func < MPIIO_NFUNCS; func++)
+                if(rsum[2 + func] > 0.0)
+                    any = 1;
+            if(!any)
+                continue;
+
+            if(row == MPIIO_NO_CONTEXT)
+                printf("none\n");
+            else
+                printf("%s %.0f %.9f %.9f\n", op_names_g[row], rsum[0], rmax[1], rsum[1] / (double)mpi_size);
+            for(func = 0; func < MPIIO_NFUNCS; func++)
+                if(rsum[2 + func] > 0.0)
+                    printf("  %s %.0f %.0f %.9f %.9f\n", op_names_g[TRACE_NHDF5_OPS + func], rsum[2 + func],
+                            rsum[2 + MPIIO_NFUNCS + func], rmax[2 + 2 * MPIIO_NFUNCS + func],
+                            rsum[2 + 2 * MPIIO_NFUNCS + func] / (double)mpi_size);
+        }
+        fflush(stdout);
+    }
+
+done:
+    if(max != local) {
+        free(max);
+        free(sum);
+    }
+    max = sum = NULL;
+    free(local);
+    local = NULL;
+
+    return ret_value;
+}
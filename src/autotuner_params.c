@@ -0,0 +1,740 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Recording of the applied parameters.  The set_*_parameter() functions
+ * record every parameter they apply in a pending list, which H5Fcreate,
+ * H5Fopen and prepare_dcpl() then commit to the record of the file.  A
+ * deferred dataset keeps its pending parameters until it is created.  At
+ * H5Fclose the record is written in config.xml format, either as the
+ * H5TUNER_PARAMS_ATTR attribute of the root group or as the sidecar file
+ * "<file>.h5tuner.xml", so the file can be traced back to its tuning (and
+ * the tuning reproduced).  A file opened again for writing keeps the record
+ * it already has, with the parameters applied again replaced.
+ */
+
+#include "autotuner_private.h"
+
+/* Compact attributes must fit in the object header */
+#define PARAMS_MAX_ATTR_SIZE 60000
+
+typedef struct param_entry_t {
+    char *name;
+    char *dset_name;            /* NULL for file parameters */
+    char *value;
+} param_entry_t;
+
+struct param_list_t {
+    param_entry_t *entries;
+    size_t nentries;
+    size_t alloc;
+};
+
+typedef struct file_params_t {
+    char *filename;
+    param_list_t list;
+} file_params_t;
+
+/* Global to indicate how applied parameters are recorded */
+int record_params_g = PARAMS_RECORD_NONE;
+
+static param_list_t pending_g = {NULL, 0, 0};
+static file_params_t *file_params_g = NULL;
+static size_t nfile_params_g = 0;
+static size_t file_params_alloc_g = 0;
+
+/* Layers of the parameters, as in config.xml */
+static const char *params_layers_g[] = {
+    "High_Level_IO_Library",
+    "Middleware_Layer",
+    "Parallel_File_System"
+};
+
+
+void set_record_params(void)
+{
+    static int record_params_set = 0;
+    char *record_params = getenv("H5TUNER_RECORD_PARAMS");
+
+    if(record_params_set)
+        return;
+    record_params_set = 1;
+
+    if(!record_params)
+        record_params_g = PARAMS_RECORD_NONE;
+    else if(!strcmp(record_params, "attribute"))
+        record_params_g = PARAMS_RECORD_ATTRIBUTE;
+    else if(!strcmp(record_params, "sidecar"))
+        record_params_g = PARAMS_RECORD_SIDECAR;
+    else if(strcmp(record_params, "none") != 0)
+        DONE_ERROR("Unknown value for H5TUNER_RECORD_PARAMS, expected \"attribute\", \"sidecar\" or \"none\"");
+
+    return;
+}
+
+
+static int params_layer(const char *name)
+{
+    if(!strcmp(name, "sieve_buf_size") || !strcmp(name, "alignment") || !strcmp(name, "chunk")
+            || !strcmp(name, "aggregate") || !strcmp(name, "transfer"))
+        return 0;
+    if(!strncmp(name, "cb_", 3))
+        return 1;
+
+    return 2;
+}
+
+
+static herr_t params_list_set(param_list_t *list, const char *name, const char *dset_name, const char *value)
+{
+    param_entry_t *entry = NULL;
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    /* A parameter applied again replaces the earlier value, as it does in
+     * the property list */
+    for(i = 0; i < list->nentries; i++)
+        if(!strcmp(list->entries[i].name, name)
+                && ((!dset_name && !list->entries[i].dset_name)
+                    || (dset_name && list->entries[i].dset_name && !strcmp(dset_name, list->entries[i].dset_name)))) {
+            entry = &list->entries[i];
+            free(entry->value);
+            entry->value = NULL;
+            break;
+        }
+
+    if(!entry) {
+        if(list->nentries == list->alloc) {
+            size_t new_alloc = list->alloc ? 2 * list->alloc : 16;
+            param_entry_t *new_entries;
+
+            if(NULL == (new_entries = (param_entry_t *)realloc(list->entries, new_alloc * sizeof(param_entry_t))))
+                ERROR("Unable to grow parameter list");
+            list->entries = new_entries;
+            list->alloc = new_alloc;
+        }
+        entry = &list->entries[list->nentries];
+        memset(entry, 0, sizeof(*entry));
+        if(NULL == (entry->name = strdup(name)))
+            ERROR("Unable to copy parameter name");
+        if(dset_name && NULL == (entry->dset_name = strdup(dset_name))) {
+            free(entry->name);
+            ERROR("Unable to copy dataset name");
+        }
+        list->nentries++;
+    }
+
+    if(NULL == (entry->value = strdup(value)))
+        ERROR("Unable to copy parameter value");
+
+done:
+    return ret_value;
+}
+
+
+static void params_list_free(param_list_t *list)
+{
+    size_t i;
+
+    for(i = 0; i < list->nentries; i++) {
+        free(list->entries[i].name);
+        free(list->entries[i].dset_name);
+        free(list->entries[i].value);
+    }
+    free(list->entries);
+    list->entries = NULL;
+    list->nentries = 0;
+    list->alloc = 0;
+
+    return;
+}
+
+
+herr_t params_record(const char *name, const char *dset_name, const char *value)
+{
+    if(record_params_g == PARAMS_RECORD_NONE)
+        return SUCCEED;
+
+    return params_list_set(&pending_g, name, dset_name, value);
+}
+
+
+void params_discard(void)
+{
+    params_list_free(&pending_g);
+
+    return;
+}
+
+
+/* Take the pending parameters, for an object whose creation is deferred.
+ * Returns NULL if there are none (or they could not be kept). */
+param_list_t *params_take(void)
+{
+    param_list_t *list;
+
+    if(pending_g.nentries == 0)
+        return NULL;
+
+    if(NULL == (list = (param_list_t *)malloc(sizeof(param_list_t)))) {
+        DONE_ERROR("Unable to allocate parameter list");
+        params_discard();
+        return NULL;
+    }
+    *list = pending_g;
+    memset(&pending_g, 0, sizeof(pending_g));
+
+    return list;
+}
+
+
+/* Make parameters taken by params_take() pending again, and free them */
+herr_t params_restore(param_list_t *list)
+{
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    if(!list)
+        return ret_value;
+
+    for(i = 0; i < list->nentries; i++)
+        if(params_list_set(&pending_g, list->entries[i].name, list->entries[i].dset_name, list->entries[i].value) < 0)
+            ERROR("Unable to record parameter");
+
+done:
+    params_free(list);
+
+    return ret_value;
+}
+
+
+void params_free(param_list_t *list)
+{
+    if(!list)
+        return;
+
+    params_list_free(list);
+    free(list);
+
+    return;
+}
+
+
+static file_params_t *params_find_file(const char *filename, int create)
+{
+    size_t i;
+
+    for(i = 0; i < nfile_params_g; i++)
+        if(!strcmp(file_params_g[i].filename, filename))
+            return &file_params_g[i];
+
+    if(!create)
+        return NULL;
+
+    if(nfile_params_g == file_params_alloc_g) {
+        size_t new_alloc = file_params_alloc_g ? 2 * file_params_alloc_g : 16;
+        file_params_t *new_files;
+
+        if(NULL == (new_files = (file_params_t *)realloc(file_params_g, new_alloc * sizeof(file_params_t))))
+            return NULL;
+        file_params_g = new_files;
+        file_params_alloc_g = new_alloc;
+    }
+    memset(&file_params_g[nfile_params_g], 0, sizeof(file_params_t));
+    if(NULL == (file_params_g[nfile_params_g].filename = strdup(filename)))
+        return NULL;
+
+    return &file_params_g[nfile_params_g++];
+}
+
+
+herr_t params_commit(hid_t obj_id)
+{
+    file_params_t *file;
+    char *filename = NULL;
+    ssize_t filename_len;
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    if(record_params_g == PARAMS_RECORD_NONE)
+        return ret_value;
+
+    /* Files are identified by the name HDF5 reports, which includes any
+     * prefix added by H5Tuner */
+    if((filename_len = H5Fget_name(obj_id, NULL, 0)) < 0)
+        ERROR("Unable to get HDF5 file name length");
+    if(NULL == (filename = (char *)malloc((size_t)filename_len + 1)))
+        ERROR("Unable to allocate HDF5 file name buffer");
+    if(H5Fget_name(obj_id, filename, (size_t)filename_len + 1) < 0)
+        ERROR("Unable to get HDF5 file name");
+
+    if(NULL == (file = params_find_file(filename, 1)))
+        ERROR("Unable to add file to parameter records");
+
+    for(i = 0; i < pending_g.nentries; i++)
+        if(params_list_set(&file->list, pending_g.entries[i].name, pending_g.entries[i].dset_name, pending_g.entries[i].value) < 0)
+            ERROR("Unable to record parameter");
+
+done:
+    params_discard();
+
+    free(filename);
+    filename = NULL;
+
+    return ret_value;
+}
+
+
+/* Escape the XML special characters of a string into dst, if not NULL.
+ * Returns the length of the escaped string. */
+static size_t params_escape(char *dst, const char *src)
+{
+    size_t len = 0;
+
+    for(; *src; src++) {
+        const char *entity = NULL;
+
+        switch(*src) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            case '\'': entity = "&apos;"; break;
+            default: break;
+        }
+
+        if(entity) {
+            if(dst)
+                memcpy(dst + len, entity, strlen(entity));
+            len += strlen(entity);
+        }
+        else {
+            if(dst)
+                dst[len] = *src;
+            len++;
+        }
+    }
+    if(dst)
+        dst[len] = '\0';
+
+    return len;
+}
+
+
+/* Format a file's parameters in config.xml format.  Dataset parameters
+ * keep their dataset name as VariableName.  Names and values are escaped,
+ * so the record parses whatever they contain.  Returns a string the caller
+ * must free. */
+static char *params_format(const file_params_t *file)
+{
+    const char *basename;
+    char *buf = NULL;
+    size_t len = 0;
+    size_t alloc = 0;
+    int layer;
+
+    if(NULL == (basename = strrchr(file->filename, '/')))
+        basename = file->filename;
+    else
+        basename++;
+
+    for(layer = 0; layer <= 2; layer++) {
+        size_t i;
+
+        /* Reserve room for the element tags */
+        alloc += 2 * strlen(params_layers_g[layer]) + 16;
+        for(i = 0; i < file->list.nentries; i++)
+            alloc += 2 * strlen(file->list.entries[i].name) + params_escape(NULL, basename)
+                + (file->list.entries[i].dset_name ? params_escape(NULL, file->list.entries[i].dset_name) : 0)
+                + params_escape(NULL, file->list.entries[i].value) + 64;
+    }
+    alloc += 32;
+
+    if(NULL == (buf = (char *)malloc(alloc)))
+        return NULL;
+
+    len += (size_t)sprintf(buf + len, "<Parameters>\n");
+    for(layer = 0; layer <= 2; layer++) {
+        size_t i;
+
+        len += (size_t)sprintf(buf + len, "<%s>\n", params_layers_g[layer]);
+        for(i = 0; i < file->list.nentries; i++) {
+            const param_entry_t *entry = &file->list.entries[i];
+
+            if(params_layer(entry->name) != layer)
+                continue;
+
+            len += (size_t)sprintf(buf + len, "<%s FileName=\"", entry->name);
+            len += params_escape(buf + len, basename);
+            if(entry->dset_name) {
+                len += (size_t)sprintf(buf + len, "\" VariableName=\"");
+                len += params_escape(buf + len, entry->dset_name);
+            }
+            len += (size_t)sprintf(buf + len, "\">");
+            len += params_escape(buf + len, entry->value);
+            len += (size_t)sprintf(buf + len, "</%s>\n", entry->name);
+        }
+        len += (size_t)sprintf(buf + len, "</%s>\n", params_layers_g[layer]);
+    }
+    sprintf(buf + len, "</Parameters>\n");
+
+    return buf;
+}
+
+
+/* Undo params_escape() in place */
+static void params_unescape(char *str)
+{
+    static const char *entities[][2] = {
+        {"&amp;", "&"}, {"&lt;", "<"}, {"&gt;", ">"}, {"&quot;", "\""}, {"&apos;", "'"}
+    };
+    char *src = str;
+    char *dst = str;
+    size_t i;
+
+    while(*src) {
+        for(i = 0; i < sizeof(entities) / sizeof(entities[0]); i++)
+            if(!strncmp(src, entities[i][0], strlen(entities[i][0])))
+                break;
+        if(i < sizeof(entities) / sizeof(entities[0])) {
+            *dst++ = entities[i][1][0];
+            src += strlen(entities[i][0]);
+        }
+        else
+            *dst++ = *src++;
+    }
+    *dst = '\0';
+
+    return;
+}
+
+
+/* Add the entries of a record written by params_format() to list, one
+ * "<name FileName=... [VariableName=...]>value</name>" element per line.
+ * The str buffer is modified. */
+static herr_t params_parse(char *str, param_list_t *list)
+{
+    char *line;
+    char *next;
+    herr_t ret_value = SUCCEED;
+
+    for(line = str; line && *line; line = next) {
+        char *name;
+        char *dset_name = NULL;
+        char *value;
+        char *end;
+        char *attr;
+
+        if(NULL != (next = strchr(line, '\n')))
+            *next++ = '\0';
+
+        /* Skip the layer and Parameters tags */
+        if(line[0] != '<' || NULL == (attr = strstr(line, " FileName=\"")))
+            continue;
+        name = line + 1;
+        *attr = '\0';
+        attr += strlen(" FileName=\"");
+        if(NULL == (attr = strchr(attr, '"')))
+            continue;
+        attr++;
+
+        if(!strncmp(attr, " VariableName=\"", strlen(" VariableName=\""))) {
+            dset_name = attr + strlen(" VariableName=\"");
+            if(NULL == (attr = strchr(dset_name, '"')))
+                continue;
+            *attr++ = '\0';
+            params_unescape(dset_name);
+        }
+        if(*attr != '>')
+            continue;
+        value = attr + 1;
+        if(NULL == (end = strstr(value, "</")))
+            continue;
+        *end = '\0';
+        params_unescape(value);
+
+        if(params_list_set(list, name, dset_name, value) < 0)
+            ERROR("Unable to record parameter");
+    }
+
+done:
+    return ret_value;
+}
+
+
+/* Get the sidecar file name of a file, which the caller must free */
+static char *params_sidecar_name(const char *filename)
+{
+    const char *real_filename = filename;
+    char *sidecar;
+
+    /* Skip file name prefixes such as "bglockless:" */
+    if(strchr(real_filename, ':'))
+        real_filename = strrchr(real_filename, ':') + 1;
+
+    if(NULL == (sidecar = (char *)malloc(strlen(real_filename) + sizeof(PARAMS_SIDECAR_SUFFIX))))
+        return NULL;
+    strcpy(sidecar, real_filename);
+    strcat(sidecar, PARAMS_SIDECAR_SUFFIX);
+
+    return sidecar;
+}
+
+
+/* Read the record already in a file, from its attribute or else its
+ * sidecar file, into list.  Nothing is added if there is none. */
+static herr_t params_read(hid_t file_id, const char *filename, param_list_t *list)
+{
+    hid_t attr_id = -1;
+    hid_t type_id = -1;
+    char *sidecar = NULL;
+    FILE *fp = NULL;
+    char *params_str = NULL;
+    size_t size = 0;
+    htri_t exists;
+    herr_t ret_value = SUCCEED;
+
+    if((exists = H5Aexists_by_name(file_id, "/", PARAMS_ATTR_NAME, H5P_DEFAULT)) < 0)
+        ERROR("Unable to check for parameter attribute");
+    if(exists) {
+        if((attr_id = H5Aopen_by_name(file_id, "/", PARAMS_ATTR_NAME, H5P_DEFAULT, H5P_DEFAULT)) < 0)
+            ERROR("Unable to open parameter attribute");
+        if((type_id = H5Aget_type(attr_id)) < 0)
+            ERROR("Unable to get parameter attribute datatype");
+        if(0 == (size = H5Tget_size(type_id)))
+            ERROR("Unable to get parameter attribute size");
+        if(NULL == (params_str = (char *)malloc(size + 1)))
+            ERROR("Unable to allocate parameter record");
+        if(H5Aread(attr_id, type_id, params_str) < 0)
+            ERROR("Unable to read parameter attribute");
+    }
+    else {
+        long len;
+
+        if(NULL == (sidecar = params_sidecar_name(filename)))
+            ERROR("Unable to allocate sidecar file name");
+        if(NULL == (fp = fopen(sidecar, "r")))
+            goto done;
+        if(fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+            ERROR("Unable to get parameter sidecar file size");
+        if(NULL == (params_str = (char *)malloc((size_t)len + 1)))
+            ERROR("Unable to allocate parameter record");
+        if((size = fread(params_str, 1, (size_t)len, fp)) != (size_t)len)
+            ERROR("Unable to read parameter sidecar file");
+    }
+    params_str[size] = '\0';
+
+    if(params_parse(params_str, list) < 0)
+        ERROR("Unable to parse parameter record");
+
+done:
+    if(fp && (fclose(fp) != 0))
+        DONE_ERROR("Failure closing parameter sidecar file");
+    if((type_id >= 0) && (H5Tclose(type_id) < 0))
+        DONE_ERROR("Failure closing datatype");
+    if((attr_id >= 0) && (H5Aclose(attr_id) < 0))
+        DONE_ERROR("Failure closing parameter attribute");
+
+    free(params_str);
+    params_str = NULL;
+    free(sidecar);
+    sidecar = NULL;
+
+    return ret_value;
+}
+
+
+static herr_t params_write_sidecar(const char *filename, const char *params_str)
+{
+    char *sidecar = NULL;
+    FILE *fp = NULL;
+    herr_t ret_value = SUCCEED;
+
+    if(NULL == (sidecar = params_sidecar_name(filename)))
+        ERROR("Unable to allocate sidecar file name");
+
+    if(NULL == (fp = fopen(sidecar, "w")))
+        ERROR("Unable to open parameter sidecar file");
+    if(fputs(params_str, fp) < 0)
+        ERROR("Unable to write parameter sidecar file");
+
+done:
+    if(fp && (fclose(fp) != 0))
+        DONE_ERROR("Failure closing parameter sidecar file");
+
+    free(sidecar);
+    sidecar = NULL;
+
+    return ret_value;
+}
+
+
+static herr_t params_write_attr(hid_t file_id, const char *params_str)
+{
+    hid_t type_id = -1;
+    hid_t space_id = -1;
+    hid_t attr_id = -1;
+    htri_t exists;
+    herr_t ret_value = SUCCEED;
+
+    if((exists = H5Aexists_by_name(file_id, "/", PARAMS_ATTR_NAME, H5P_DEFAULT)) < 0)
+        ERROR("Unable to check for parameter attribute");
+    if(exists && (H5Adelete_by_name(file_id, "/", PARAMS_ATTR_NAME, H5P_DEFAULT) < 0))
+        ERROR("Unable to delete old parameter attribute");
+
+    if((type_id = H5Tcopy(H5T_C_S1)) < 0)
+        ERROR("Unable to copy string datatype");
+    if(H5Tset_size(type_id, strlen(params_str) + 1) < 0)
+        ERROR("Unable to set string datatype size");
+    if((space_id = H5Screate(H5S_SCALAR)) < 0)
+        ERROR("Unable to create scalar dataspace");
+    if((attr_id = H5Acreate_by_name(file_id, "/", PARAMS_ATTR_NAME, type_id, space_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT)) < 0)
+        ERROR("Unable to create parameter attribute");
+    if(H5Awrite(attr_id, type_id, params_str) < 0)
+        ERROR("Unable to write parameter attribute");
+
+done:
+    if((attr_id >= 0) && (H5Aclose(attr_id) < 0))
+        DONE_ERROR("Failure closing parameter attribute");
+    if((space_id >= 0) && (H5Sclose(space_id) < 0))
+        DONE_ERROR("Failure closing dataspace");
+    if((type_id >= 0) && (H5Tclose(type_id) < 0))
+        DONE_ERROR("Failure closing datatype");
+
+    return ret_value;
+}
+
+
+/* Format the record of a file merged into the record it already has, so
+ * that opening it again for writing keeps the parameters applied at
+ * creation.  Entries applied again replace the earlier ones.  Returns a
+ * string the caller must free, NULL on failure. */
+static char *params_format_merged(hid_t file_id, const file_params_t *file)
+{
+    file_params_t merged;
+    char *params_str = NULL;
+    size_t i;
+
+    merged.filename = file->filename;
+    memset(&merged.list, 0, sizeof(merged.list));
+
+    if(params_read(file_id, file->filename, &merged.list) < 0) {
+        DONE_ERROR("Unable to read parameter record");
+        goto done;
+    }
+    for(i = 0; i < file->list.nentries; i++)
+        if(params_list_set(&merged.list, file->list.entries[i].name, file->list.entries[i].dset_name,
+                file->list.entries[i].value) < 0) {
+            DONE_ERROR("Unable to record parameter");
+            goto done;
+        }
+
+    params_str = params_format(&merged);
+
+done:
+    params_list_free(&merged.list);
+
+    return params_str;
+}
+
+
+herr_t params_write(hid_t file_id)
+{
+    file_params_t *file;
+    char *filename = NULL;
+    ssize_t filename_len;
+    char *params_str = NULL;
+    int params_len = 0;
+    unsigned intent;
+    hid_t fapl_id = -1;
+    MPI_Comm comm = MPI_COMM_NULL;
+    MPI_Info info = MPI_INFO_NULL;
+    int mpi_rank = 0;
+    herr_t ret_value = SUCCEED;
+
+    if(record_params_g == PARAMS_RECORD_NONE)
+        return ret_value;
+
+    /* Only files opened for writing can be annotated */
+    if(H5Fget_intent(file_id, &intent) < 0)
+        ERROR("Unable to get file intent");
+    if(!(intent & H5F_ACC_RDWR))
+        goto done;
+
+    if((filename_len = H5Fget_name(file_id, NULL, 0)) < 0)
+        ERROR("Unable to get HDF5 file name length");
+    if(NULL == (filename = (char *)malloc((size_t)filename_len + 1)))
+        ERROR("Unable to allocate HDF5 file name buffer");
+    if(H5Fget_name(file_id, filename, (size_t)filename_len + 1) < 0)
+        ERROR("Unable to get HDF5 file name");
+
+    /* For files opened with MPI-IO, all ranks write the record formatted
+     * by rank 0, so the (collective) attribute write sees identical data
+     * and only rank 0 writes a sidecar.  Whether there is a record at all is
+     * rank 0's decision too, so the ranks never disagree on the collective
+     * calls. */
+    if((fapl_id = H5Fget_access_plist(file_id)) < 0)
+        ERROR("Unable to get FAPL");
+    if(H5Pget_driver(fapl_id) == H5FD_MPIO) {
+        if(H5Pget_fapl_mpio(fapl_id, &comm, &info) < 0)
+            ERROR("Unable to get MPIO file driver info");
+        if(MPI_Comm_rank(comm, &mpi_rank) != MPI_SUCCESS)
+            ERROR("Unable to get MPI rank");
+    }
+
+    if(mpi_rank == 0 && NULL != (file = params_find_file(filename, 0))) {
+        /* Still tell the other ranks, with an empty record */
+        if(NULL == (params_str = params_format_merged(file_id, file))) {
+            DONE_ERROR("Unable to format parameters");
+            ret_value = FAIL;
+        }
+        else
+            params_len = (int)strlen(params_str) + 1;
+    }
+    if(comm != MPI_COMM_NULL) {
+        if(MPI_Bcast(&params_len, 1, MPI_INT, 0, comm) != MPI_SUCCESS)
+            ERROR("Unable to broadcast parameter record length");
+        if(params_len == 0)
+            goto done;
+        if(mpi_rank != 0 && NULL == (params_str = (char *)malloc((size_t)params_len)))
+            ERROR("Unable to allocate parameter record");
+        if(MPI_Bcast(params_str, params_len, MPI_CHAR, 0, comm) != MPI_SUCCESS)
+            ERROR("Unable to broadcast parameter record");
+    }
+    if(params_len == 0)
+        goto done;
+
+    if(record_params_g == PARAMS_RECORD_ATTRIBUTE && params_len <= PARAMS_MAX_ATTR_SIZE) {
+        if(params_write_attr(file_id, params_str) < 0)
+            ERROR("Unable to write parameter attribute");
+    }
+    else {
+        if(record_params_g == PARAMS_RECORD_ATTRIBUTE && mpi_rank == 0 && verbose_g)
+            printf("H5Tuner: parameter record of %s too large for an attribute, writing sidecar file\n", filename);
+        if(mpi_rank == 0 && params_write_sidecar(filename, params_str) < 0)
+            ERROR("Unable to write parameter sidecar file");
+    }
+
+done:
+    free(params_str);
+    params_str = NULL;
+    free(filename);
+    filename = NULL;
+
+    if((comm != MPI_COMM_NULL) && (MPI_Comm_free(&comm) != MPI_SUCCESS))
+        DONE_ERROR("Failure freeing MPI comm");
+    if((info != MPI_INFO_NULL) && (MPI_Info_free(&info) != MPI_SUCCESS))
+        DONE_ERROR("Failure freeing MPI info");
+    if((fapl_id >= 0) && (H5Pclose(fapl_id) < 0))
+        DONE_ERROR("Failure closing FAPL");
+
+    return ret_value;
+}
@@ -0,0 +1,479 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Access pattern classifier.  With H5TUNER_PATTERN=1, every H5Dwrite and
+ * H5Dread updates a small fixed-size state of its dataset (one for writes
+ * and one for reads) from the file
+ * space selection: where the access starts and ends (as row-major element
+ * offsets), and whether it starts where the previous access ended or at the
+ * same offset delta as the previous access.  At H5Dclose, which is
+ * collective for files opened with MPI-IO, the ranks exchange their local
+ * classes to detect N-to-1 interleaved access.  Rank 0 then reports the
+ * class with a suggested chunk rule and transfer mode.
+ *
+ * With H5TUNER_PATTERN=adaptive the agreed transfer mode is also used for
+ * later H5Dwrite/H5Dread calls on the same dataset (e.g. when it is opened
+ * again in the next time step), but only to make collective transfers
+ * independent, and only for datasets without filters (parallel writes of
+ * filtered datasets must be collective) that every rank accessed with
+ * independent transfers in the classified open.  A collective call that
+ * some ranks do not make would hang, so transfers are never made
+ * collective, and collective transfers the application chose for a
+ * dataset are kept, e.g. for the collective buffering of N-to-1 writes.
+ */
+
+#include "autotuner_private.h"
+
+/* Share of accesses that must follow a class for the dataset to be
+ * classified as such */
+#define PATTERN_MAJORITY 0.8
+
+/* Values exchanged at close */
+#define PATTERN_VAL_CLASS 0
+#define PATTERN_VAL_CALLS 1
+#define PATTERN_VAL_FIRST_START 2
+#define PATTERN_VAL_DELTA 3
+#define PATTERN_VAL_SIZE 4
+#define PATTERN_VAL_COLLECTIVE 5     /* Calls with a collective DXPL */
+#define PATTERN_VAL_FILTERED 6
+#define PATTERN_NVALS 7
+
+/* Global to indicate the classifier is enabled (PATTERN_CLASSIFY or
+ * PATTERN_ADAPTIVE) */
+int pattern_enabled_g = 0;
+
+static const char *pattern_dir_names_g[2] = {"read", "write"};
+
+static const char *pattern_names_g[PATTERN_NCLASSES] = {
+    "none",
+    "contiguous",
+    "strided",
+    "interleaved",
+    "random"
+};
+
+
+void set_pattern(void)
+{
+    static int pattern_set = 0;
+    char *pattern = getenv("H5TUNER_PATTERN");
+
+    if(pattern_set)
+        return;
+    pattern_set = 1;
+
+    if(!pattern || !*pattern)
+        return;
+    if(!strcmp(pattern, "adaptive"))
+        pattern_enabled_g = PATTERN_ADAPTIVE;
+    else if(strtol(pattern, NULL, 10) > 0)
+        pattern_enabled_g = PATTERN_CLASSIFY;
+
+    return;
+}
+
+
+herr_t pattern_record(hid_t dset_id, int is_write, hid_t xfer_plist_id, hid_t file_space_id)
+{
+    dset_stats_t *stats;
+    pattern_state_t *ps;
+    hid_t space_id = file_space_id;
+    H5S_sel_type sel_type = H5S_SEL_ALL;
+    hsize_t dims[SHAPE_MAX_RANK];
+    hsize_t start[SHAPE_MAX_RANK];
+    hsize_t end[SHAPE_MAX_RANK];
+    hssize_t npoints;
+    H5FD_mpio_xfer_t xfer_mode;
+    double start_lin = 0.0;
+    double end_lin = 0.0;
+    int ndims;
+    int d;
+    herr_t ret_value = SUCCEED;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+    ps = &stats->pattern[is_write ? 1 : 0];
+
+    /* Counted for empty selections too, which take part in collective
+     * transfers */
+    if(xfer_plist_id != H5P_DEFAULT) {
+        if(H5Pget_dxpl_mpio(xfer_plist_id, &xfer_mode) < 0)
+            ERROR("Unable to get transfer mode");
+        if(xfer_mode == H5FD_MPIO_COLLECTIVE)
+            ps->ncollective += 1.0;
+    }
+
+    if(file_space_id == H5S_ALL) {
+        if((space_id = H5Dget_space(dset_id)) < 0)
+            ERROR("Unable to get dataset dataspace");
+    }
+    else if((sel_type = H5Sget_select_type(file_space_id)) < 0)
+        ERROR("Unable to get selection type");
+
+    if(sel_type == H5S_SEL_NONE)
+        goto done;
+
+    if((ndims = H5Sget_simple_extent_ndims(space_id)) < 0)
+        ERROR("Unable to get number of space dimensions");
+    if((npoints = H5Sget_select_npoints(space_id)) < 0)
+        ERROR("Unable to get number of selected points");
+
+    ps->ncalls += 1.0;
+    if(ndims > SHAPE_MAX_RANK || sel_type == H5S_SEL_POINTS) {
+        ps->nirregular += 1.0;
+        goto done;
+    }
+
+    /* Find the first and last selected element */
+    if(ndims > 0) {
+        if(H5Sget_simple_extent_dims(space_id, dims, NULL) < 0)
+            ERROR("Unable to get space dimensions");
+        if(sel_type == H5S_SEL_ALL)
+            for(d = 0; d < ndims; d++) {
+                start[d] = 0;
+                end[d] = dims[d] - 1;
+            }
+        else if(H5Sget_select_bounds(space_id, start, end) < 0)
+            ERROR("Unable to get selection bounds");
+
+        for(d = 0; d < ndims; d++) {
+            start_lin = start_lin * (double)dims[d] + (double)start[d];
+            end_lin = end_lin * (double)dims[d] + (double)end[d];
+        }
+    }
+    end_lin += 1.0;
+
+    if(end_lin - start_lin != (double)npoints)
+        ps->nsparse += 1.0;
+
+    /* Compare with the previous access.  The first delta defines the
+     * stride. */
+    if(ps->ncalls > 1.0) {
+        double delta = start_lin - ps->prev_start;
+
+        if(start_lin == ps->prev_end)
+            ps->ncontig += 1.0;
+        else if(ps->ncalls == 2.0 || delta == ps->prev_delta)
+            ps->nstrided += 1.0;
+        ps->prev_delta = delta;
+    }
+    else
+        ps->first_start = start_lin;
+
+    ps->prev_start = start_lin;
+    ps->prev_end = end_lin;
+    ps->access_size = (double)npoints;
+    ps->extent_rank = ndims;
+    for(d = 0; d < ndims; d++)
+        ps->extent[d] = end[d] - start[d] + 1;
+
+done:
+    if((file_space_id == H5S_ALL) && (space_id >= 0) && (H5Sclose(space_id) < 0))
+        DONE_ERROR("Failure closing dataset dataspace");
+
+    return ret_value;
+}
+
+
+/* Classify this rank's accesses */
+static pattern_class_t pattern_local_class(const pattern_state_t *ps)
+{
+    double ndeltas = ps->ncalls - 1.0;
+
+    if(ps->ncalls <= 0.0)
+        return PATTERN_NONE;
+    if(ps->nirregular > ps->ncalls / 2.0)
+        return PATTERN_RANDOM;
+
+    if(ndeltas <= 0.0)
+        return ps->nsparse > 0.0 ? PATTERN_STRIDED : PATTERN_CONTIGUOUS;
+
+    if(ps->ncontig >= PATTERN_MAJORITY * ndeltas)
+        return ps->nsparse > ps->ncalls / 2.0 ? PATTERN_STRIDED : PATTERN_CONTIGUOUS;
+    if(ps->ncontig + ps->nstrided >= PATTERN_MAJORITY * ndeltas)
+        return PATTERN_STRIDED;
+
+    return PATTERN_RANDOM;
+}
+
+
+/* Combine the classes of all ranks.  Ranks are interleaved if every rank
+ * that accessed the dataset is strided with the same delta and access size,
+ * the delta covers one access of each rank and the ranks start at
+ * different offsets.  Otherwise the most common class wins. */
+static pattern_class_t pattern_agree(const double *all, int nranks, /* OUT */ int *nparticipants, /* OUT */ int *equal_calls)
+{
+    int counts[PATTERN_NCLASSES];
+    const double *ref = NULL;
+    int interleaved = 1;
+    int best = PATTERN_NONE;
+    int r, q;
+
+    memset(counts, 0, sizeof(counts));
+    *nparticipants = 0;
+    *equal_calls = 1;
+
+    for(r = 0; r < nranks; r++) {
+        const double *vals = &all[r * PATTERN_NVALS];
+        int cls = (int)vals[PATTERN_VAL_CLASS];
+
+        if(cls == PATTERN_NONE)
+            continue;
+        (*nparticipants)++;
+        counts[cls]++;
+
+        if(!ref)
+            ref = vals;
+        else {
+            if(vals[PATTERN_VAL_CALLS] != ref[PATTERN_VAL_CALLS])
+                *equal_calls = 0;
+            if(vals[PATTERN_VAL_DELTA] != ref[PATTERN_VAL_DELTA] || vals[PATTERN_VAL_SIZE] != ref[PATTERN_VAL_SIZE])
+                interleaved = 0;
+        }
+        if(cls != PATTERN_STRIDED)
+            interleaved = 0;
+    }
+
+    if(*nparticipants > 1 && interleaved
+            && ref[PATTERN_VAL_DELTA] == (double)*nparticipants * ref[PATTERN_VAL_SIZE]) {
+        for(r = 0; r < nranks && interleaved; r++)
+            for(q = r + 1; q < nranks && interleaved; q++)
+                if((int)all[r * PATTERN_NVALS + PATTERN_VAL_CLASS] != PATTERN_NONE
+                        && (int)all[q * PATTERN_NVALS + PATTERN_VAL_CLASS] != PATTERN_NONE
+                        && all[r * PATTERN_NVALS + PATTERN_VAL_FIRST_START] == all[q * PATTERN_NVALS + PATTERN_VAL_FIRST_START])
+                    interleaved = 0;
+        if(interleaved)
+            return PATTERN_INTERLEAVED;
+    }
+
+    for(r = PATTERN_CONTIGUOUS; r < PATTERN_NCLASSES; r++)
+        if(counts[r] > counts[best])
+            best = r;
+
+    return (pattern_class_t)best;
+}
+
+
+static void pattern_report(const dset_stats_t *stats, int dir, pattern_class_t cls, int nparticipants)
+{
+    const pattern_state_t *ps = &stats->pattern[dir];
+    const char *file_basename;
+    const char *dset_basename;
+    int d;
+
+    if(NULL == (file_basename = strrchr(stats->filename, '/')))
+        file_basename = stats->filename;
+    else
+        file_basename++;
+    if(NULL == (dset_basename = strrchr(stats->dset_name, '/')))
+        dset_basename = stats->dset_name;
+    else
+        dset_basename++;
+
+    printf("H5Tuner pattern: dataset %s %s %s %s ranks %d calls %.0f\n", stats->filename, stats->dset_name,
+            pattern_dir_names_g[dir], pattern_names_g[cls], nparticipants, ps->ncalls);
+
+    if(cls == PATTERN_CONTIGUOUS)
+        printf("  suggested: contiguous layout (no chunk rule)\n");
+    else if(ps->extent_rank > 0) {
+        printf("  suggested: <chunk FileName=\"%s\" VariableName=\"%s\">", file_basename, dset_basename);
+        for(d = 0; d < ps->extent_rank; d++)
+            printf("%s%llu", d ? "," : "", (unsigned long long)ps->extent[d]);
+        printf("</chunk>\n");
+    }
+
+    if(cls == PATTERN_STRIDED || cls == PATTERN_INTERLEAVED)
+        printf("  suggested transfer: collective\n");
+    else
+        printf("  suggested transfer: independent\n");
+
+    return;
+}
+
+
+/* Whether a dataset has filters.  On failure the dataset is taken as
+ * filtered, which keeps its transfers as they are. */
+static int pattern_filtered(hid_t dset_id)
+{
+    hid_t dcpl_id;
+    int nfilters;
+
+    if((dcpl_id = H5Dget_create_plist(dset_id)) < 0)
+        return 1;
+    nfilters = H5Pget_nfilters(dcpl_id);
+    if(H5Pclose(dcpl_id) < 0)
+        return 1;
+
+    return nfilters != 0;
+}
+
+
+herr_t pattern_close(hid_t dset_id)
+{
+    dset_stats_t *stats = NULL;
+    double local[2 * PATTERN_NVALS];
+    double *all = NULL;
+    double *dir_all = NULL;
+    MPI_Comm comm = MPI_COMM_NULL;
+    int mpi_rank = 0;
+    int mpi_size = 1;
+    int local_err = 0;
+    int dir;
+    int r;
+    herr_t ret_value = SUCCEED;
+
+    /* The communicator is duplicated at the first close of the file, then
+     * cached.  A dataset whose state cannot be read must not keep this rank
+     * out of the exchange, or the other ranks would hang, so this rank
+     * sends class "none" for it instead. */
+    if(stats_get_comm(dset_id, &comm) < 0)
+        ERROR("Unable to get file communicator");
+    if(comm != MPI_COMM_NULL) {
+        if(MPI_Comm_rank(comm, &mpi_rank) != MPI_SUCCESS)
+            ERROR("Unable to get MPI rank");
+        if(MPI_Comm_size(comm, &mpi_size) != MPI_SUCCESS)
+            ERROR("Unable to get MPI size");
+    }
+
+    memset(local, 0, sizeof(local));
+    if(stats_get_dset(dset_id, &stats) < 0) {
+        local_err = 1;
+        stats = NULL;
+    }
+    for(dir = 0; dir < 2; dir++) {
+        double *vals = &local[dir * PATTERN_NVALS];
+
+        if(stats) {
+            const pattern_state_t *ps = &stats->pattern[dir];
+
+            vals[PATTERN_VAL_CLASS] = (double)pattern_local_class(ps);
+            vals[PATTERN_VAL_CALLS] = ps->ncalls;
+            vals[PATTERN_VAL_FIRST_START] = ps->first_start;
+            vals[PATTERN_VAL_DELTA] = ps->prev_delta;
+            vals[PATTERN_VAL_SIZE] = ps->access_size;
+            vals[PATTERN_VAL_COLLECTIVE] = ps->ncollective;
+            vals[PATTERN_VAL_FILTERED] = (double)pattern_filtered(dset_id);
+        }
+        else {
+            vals[PATTERN_VAL_CLASS] = (double)PATTERN_NONE;
+            vals[PATTERN_VAL_FILTERED] = 1.0;
+        }
+    }
+
+    if(NULL == (all = (double *)malloc((size_t)mpi_size * 2 * PATTERN_NVALS * sizeof(double))))
+        ERROR("Unable to allocate pattern buffer");
+    if(NULL == (dir_all = (double *)malloc((size_t)mpi_size * PATTERN_NVALS * sizeof(double))))
+        ERROR("Unable to allocate pattern buffer");
+
+    /* Exchange classes over the file's communicator */
+    if(comm != MPI_COMM_NULL) {
+        if(MPI_Allgather(local, 2 * PATTERN_NVALS, MPI_DOUBLE, all, 2 * PATTERN_NVALS, MPI_DOUBLE, comm) != MPI_SUCCESS)
+            ERROR("Unable to exchange access patterns");
+    }
+    else
+        memcpy(all, local, sizeof(local));
+
+    if(local_err)
+        ERROR("Unable to get dataset statistics");
+
+    for(dir = 0; dir < 2; dir++) {
+        pattern_state_t *ps = &stats->pattern[dir];
+        int nparticipants;
+        int equal_calls;
+        int relax = 1;
+        pattern_class_t cls;
+
+        for(r = 0; r < mpi_size; r++) {
+            memcpy(&dir_all[r * PATTERN_NVALS], &all[(r * 2 + dir) * PATTERN_NVALS], PATTERN_NVALS * sizeof(double));
+            if(dir_all[r * PATTERN_NVALS + PATTERN_VAL_COLLECTIVE] > 0.0
+                    || dir_all[r * PATTERN_NVALS + PATTERN_VAL_FILTERED] != 0.0)
+                relax = 0;
+        }
+
+        /* Every rank computes the same class */
+        cls = pattern_agree(dir_all, mpi_size, &nparticipants, &equal_calls);
+
+        if(mpi_rank == 0 && cls != PATTERN_NONE)
+            pattern_report(stats, dir, cls, nparticipants);
+
+        if(pattern_enabled_g == PATTERN_ADAPTIVE && comm != MPI_COMM_NULL && cls != PATTERN_NONE) {
+            if(relax && cls != PATTERN_STRIDED && cls != PATTERN_INTERLEAVED)
+                ps->xfer_mode = H5FD_MPIO_INDEPENDENT;
+            else
+                ps->xfer_mode = -1;
+        }
+    }
+
+done:
+    /* Start over for the next open, keeping the adaptive transfer modes */
+    if(stats)
+        for(dir = 0; dir < 2; dir++) {
+            pattern_state_t *ps = &stats->pattern[dir];
+            int xfer_mode = ps->xfer_mode;
+
+            memset(ps, 0, sizeof(*ps));
+            ps->xfer_mode = xfer_mode;
+        }
+
+    free(all);
+    all = NULL;
+    free(dir_all);
+    dir_all = NULL;
+
+    return ret_value;
+}
+
+
+herr_t pattern_adapt_dxpl(hid_t dset_id, int is_write, hid_t xfer_plist_id, /* OUT */ hid_t *adapted_dxpl_id)
+{
+    dset_stats_t *stats;
+    pattern_state_t *ps;
+    H5FD_mpio_xfer_t xfer_mode;
+    hid_t dxpl_id = -1;
+    herr_t ret_value = SUCCEED;
+
+    *adapted_dxpl_id = -1;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+    ps = &stats->pattern[is_write ? 1 : 0];
+    if(ps->xfer_mode < 0)
+        goto done;
+
+    if(xfer_plist_id == H5P_DEFAULT) {
+        if((dxpl_id = H5Pcreate(H5P_DATASET_XFER)) < 0)
+            ERROR("Unable to create DXPL");
+    }
+    else if((dxpl_id = H5Pcopy(xfer_plist_id)) < 0)
+        ERROR("Unable to copy DXPL");
+
+    if(H5Pget_dxpl_mpio(dxpl_id, &xfer_mode) < 0)
+        ERROR("Unable to get transfer mode");
+    if((int)xfer_mode == ps->xfer_mode)
+        goto done;
+
+    if(verbose_g >= 3)
+        printf("  Switching %s %ss to %s transfers\n", stats->dset_name, pattern_dir_names_g[is_write ? 1 : 0],
+                ps->xfer_mode == H5FD_MPIO_COLLECTIVE ? "collective" : "independent");
+
+    if(H5Pset_dxpl_mpio(dxpl_id, (H5FD_mpio_xfer_t)ps->xfer_mode) < 0)
+        ERROR("Unable to set transfer mode");
+
+    *adapted_dxpl_id = dxpl_id;
+    dxpl_id = -1;
+
+done:
+    if((dxpl_id >= 0) && (H5Pclose(dxpl_id) < 0))
+        DONE_ERROR("Failure closing DXPL");
+
+    return ret_value;
+}
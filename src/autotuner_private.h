@@ -23,6 +23,7 @@
 #include "hdf5.h"
 #include "autotuner.h"
 #include "mxml.h"
+#include "autotuner_trace.h"
 
 /* Error macros */
 #define SUCCEED 0
@@ -38,5 +39,298 @@ do { \
     goto done; \
 } while(0)
 
-#endif /* _autotuner_private_H */
+/* Per-dataset statistics */
+typedef enum stat_type_t {
+    STAT_WRITE_CALLS = 0,
+    STAT_WRITE_BYTES,
+    STAT_WRITE_TIME,
+    STAT_READ_CALLS,
+    STAT_READ_BYTES,
+    STAT_READ_TIME,
+    STAT_MPIIO_WRITE_CALLS,     /* MPI-IO calls made by H5Dwrite/H5Dread */
+    STAT_MPIIO_WRITE_BYTES,
+    STAT_MPIIO_WRITE_TIME,
+    STAT_MPIIO_READ_CALLS,
+    STAT_MPIIO_READ_BYTES,
+    STAT_MPIIO_READ_TIME,
+    STAT_NTYPES
+} stat_type_t;
+
+/* Number of log2 request size histogram bins.  Bin k counts calls that
+ * transferred [2^k, 2^(k+1)) bytes (bin 0 also counts empty transfers). */
+#define HIST_NBINS 48
+
+/* File space selection types */
+typedef enum sel_type_t {
+    SEL_ALL = 0,
+    SEL_REGULAR,
+    SEL_IRREGULAR,
+    SEL_POINTS,
+    SEL_NONE,
+    SEL_NTYPES
+} sel_type_t;
+
+/* Regular hyperslab parameters tracked for selection shapes */
+typedef enum shape_param_t {
+    SHAPE_START = 0,
+    SHAPE_COUNT,
+    SHAPE_STRIDE,
+    SHAPE_BLOCK,
+    SHAPE_NPARAMS
+} shape_param_t;
+
+/* Maximum dataset rank for which selection shapes are tracked */
+#define SHAPE_MAX_RANK 8
+
+/* Access pattern classes */
+typedef enum pattern_class_t {
+    PATTERN_NONE = 0,           /* Not accessed */
+    PATTERN_CONTIGUOUS,         /* Each access starts where the last ended */
+    PATTERN_STRIDED,            /* Constant offset between accesses */
+    PATTERN_INTERLEAVED,        /* N-to-1, ranks' strided blocks interleave */
+    PATTERN_RANDOM,
+    PATTERN_NCLASSES
+} pattern_class_t;
+
+/* Access pattern state of a dataset.  Offsets are in elements, in the
+ * row-major order of the dataset. */
+typedef struct pattern_state_t {
+    double ncalls;
+    double ncontig;             /* Accesses starting where the last ended */
+    double nstrided;            /* Accesses with the same delta as the last */
+    double nsparse;             /* Selections that are not one dense run */
+    double nirregular;          /* Point selections */
+    double first_start;
+    double prev_start;
+    double prev_end;
+    double prev_delta;
+    double access_size;         /* Elements in the last access */
+    double ncollective;         /* Calls with a collective DXPL */
+    int extent_rank;
+    hsize_t extent[SHAPE_MAX_RANK];     /* Bounding box of the last access */
+    int xfer_mode;              /* Transfer mode for adaptive mode, -1 if none */
+} pattern_state_t;
+
+/* Transfer rules */
+#define COLLECTIVE_RULE_NONE 0
+#define COLLECTIVE_RULE_LOCKSTEP 1
+#define COLLECTIVE_RULE_INDEPENDENT 2
+
+/* Lockstep state of a dataset's writes, for promotion to collective */
+typedef struct collective_state_t {
+    int rule;                   /* COLLECTIVE_RULE_* of the dataset */
+    int nranks;                 /* Ranks sharing the file, 0 if not known yet */
+    double nwrites;             /* Independent writes since the last sync point */
+    double ncollective;         /* Of which promoted */
+    long long order;            /* Hash of the positions of these writes */
+    int nlockstep;              /* Sync points in a row in lockstep */
+    double lockstep_calls;      /* Writes per rank at those sync points */
+    int promoted;
+    int diverged;               /* Ranks diverged after promotion */
+} collective_state_t;
+
+typedef struct dset_stats_t {
+    char *filename;
+    char *dset_name;
+    double val[STAT_NTYPES];
+    double write_hist[HIST_NBINS];
+    double read_hist[HIST_NBINS];
+    double sel[SEL_NTYPES];
+    int shape_rank;
+    double shape_min[SHAPE_NPARAMS][SHAPE_MAX_RANK];
+    double shape_max[SHAPE_NPARAMS][SHAPE_MAX_RANK];
+    int trace_file_id;
+    int trace_dset_id;
+    pattern_state_t pattern[2];         /* Reads, writes */
+    collective_state_t collective;
+    int live_slot;                      /* File slot in the live segment, -1 if none */
+    int skeleton_rank;                  /* Rank of the extent in the skeleton, -1 if not described */
+    hsize_t skeleton_extent[H5S_MAX_RANK];
+} dset_stats_t;
+
+/* Phases of the H5Tuner self profile */
+typedef enum prof_phase_t {
+    PROF_CONFIG_LOAD = 0,
+    PROF_RULE_MATCH,
+    PROF_PROPERTY_COPY,
+    PROF_MPI_INFO,
+    PROF_HDF5_CALL,
+    PROF_NPHASES
+} prof_phase_t;
+
+/* Intercepted calls covered by the self profile */
+typedef enum prof_func_t {
+    PROF_H5FCREATE = 0,
+    PROF_H5FOPEN,
+    PROF_H5DCREATE,
+    PROF_NFUNCS
+} prof_func_t;
+
+/* Globals */
+extern int verbose_g;
+extern int stats_enabled_g;
+extern int trace_enabled_g;
+extern int cost_enabled_g;
+extern int record_params_g;
+extern int self_profile_g;
+extern int mpiio_enabled_g;
+extern int pattern_enabled_g;
+extern int live_enabled_g;
+extern int skeleton_enabled_g;
+extern int async_enabled_g;
+extern int collective_enabled_g;
+
+/* Whether intercepted calls need to be timed */
+#define TIMING_ENABLED (stats_enabled_g || trace_enabled_g || cost_enabled_g || mpiio_enabled_g || live_enabled_g || skeleton_enabled_g)
+
+/* Forwarded calls (autotuner_hdf5.c) */
+herr_t forward_write(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void * buf);
+herr_t call_write(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void * buf);
+void record_write(hid_t dataset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, double start, double end);
+
+/* Statistics (autotuner_stats.c) */
+double h5tuner_wtime(void);
+void set_stats(void);
+herr_t stats_get_dset(hid_t dset_id, /* OUT */ dset_stats_t **stats_out);
+void stats_close_dset(hid_t dset_id);
+herr_t stats_get_comm(hid_t obj_id, /* OUT */ MPI_Comm *comm);
+herr_t stats_free_comm(hid_t file_id);
+hssize_t get_io_bytes(hid_t dset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id);
+herr_t stats_record_io(hid_t dset_id, int is_write, hid_t file_space_id, hssize_t nbytes, double elapsed);
+herr_t stats_finalize(void);
+void set_cost(void);
+void cost_add_io_time(double elapsed);
+void cost_add_transfer_time(int is_write, double elapsed);
+herr_t cost_is_size_owner(hid_t file_id, /* OUT */ int *owner);
+herr_t cost_add_file_size(const char *filename);
+herr_t cost_finalize(void);
+
+/* Tracing (autotuner_trace.c) */
+void set_trace(void);
+int trace_intern(const char *name);
+void trace_event(trace_op_t op, hid_t dset_id, const char *filename, double start, double end, hssize_t nbytes);
+void trace_names_dset(dset_stats_t *stats);
+void trace_event_names(trace_op_t op, int file_name_id, int dset_name_id, double start, double end, hssize_t nbytes);
+herr_t trace_finalize(void);
 
+/* Recording of applied parameters (autotuner_params.c) */
+#define PARAMS_RECORD_NONE 0
+#define PARAMS_RECORD_ATTRIBUTE 1
+#define PARAMS_RECORD_SIDECAR 2
+#define PARAMS_ATTR_NAME "H5Tuner_parameters"
+#define PARAMS_SIDECAR_SUFFIX ".h5tuner.xml"
+void set_record_params(void);
+herr_t params_record(const char *name, const char *dset_name, const char *value);
+herr_t params_commit(hid_t obj_id);
+void params_discard(void);
+typedef struct param_list_t param_list_t;
+param_list_t *params_take(void);
+herr_t params_restore(param_list_t *list);
+void params_free(param_list_t *list);
+herr_t params_write(hid_t file_id);
+
+/* Self profile (autotuner_profile.c).  PROFILE_PHASE charges the time since
+ * T to PHASE and restarts T. */
+#define PROFILE_START(T) \
+do { \
+    if(self_profile_g) \
+        (T) = h5tuner_wtime(); \
+} while(0)
+#define PROFILE_PHASE(FUNC, PHASE, T) \
+do { \
+    if(self_profile_g) { \
+        double profile_now_ = h5tuner_wtime(); \
+        profile_add(FUNC, PHASE, profile_now_ - (T)); \
+        (T) = profile_now_; \
+    } \
+} while(0)
+void set_self_profile(void);
+void profile_add(prof_func_t func, prof_phase_t phase, double elapsed);
+herr_t profile_finalize(void);
+
+/* MPI-IO attribution (autotuner_mpiio.c) */
+void set_mpiio(void);
+void mpiio_enter(trace_op_t op, hid_t dset_id, const char *filename);
+void mpiio_leave(double start);
+void mpiio_record(trace_op_t op, double start, double end, long long nbytes);
+herr_t mpiio_finalize(void);
+
+/* Access pattern classifier (autotuner_pattern.c) */
+#define PATTERN_CLASSIFY 1
+#define PATTERN_ADAPTIVE 2
+void set_pattern(void);
+herr_t pattern_record(hid_t dset_id, int is_write, hid_t xfer_plist_id, hid_t file_space_id);
+herr_t pattern_adapt_dxpl(hid_t dset_id, int is_write, hid_t xfer_plist_id, /* OUT */ hid_t *adapted_dxpl_id);
+herr_t pattern_close(hid_t dset_id);
+
+/* Live metrics in shared memory (autotuner_live.c) */
+void set_live(void);
+herr_t live_record(hid_t dset_id, int is_write, hssize_t nbytes, double elapsed);
+void live_finalize(void);
+
+/* I/O skeleton capture (autotuner_skeleton.c) */
+void set_skeleton(void);
+herr_t skeleton_file(const char *op, const char *filename, unsigned flags, hid_t fapl_id, double start, double end);
+herr_t skeleton_fclose(const char *filename, double start, double end);
+herr_t skeleton_dcreate(hid_t dset_id, hid_t type_id, hid_t space_id, hid_t dcpl_id, double start, double end);
+herr_t skeleton_io(hid_t dset_id, int is_write, hid_t file_space_id, hid_t xfer_plist_id, double start, double end);
+herr_t skeleton_dclose(hid_t dset_id, double start, double end);
+herr_t skeleton_finalize(void);
+
+/* Deferred dataset creation (autotuner_defer.c).  The creation arguments
+ * are released once the dataset is created. */
+typedef struct defer_dset_t {
+    hid_t proxy_id;
+    hid_t dset_id;              /* Real dataset, -1 until created */
+    char *filename;
+    char *name;
+    hid_t loc_id;
+    hid_t type_id;
+    hid_t space_id;             /* Current extent */
+    hid_t lcpl_id;
+    hid_t dcpl_id;              /* DCPL with the tuned parameters */
+    hid_t app_dcpl_id;          /* DCPL passed by the application */
+    hid_t dapl_id;
+    MPI_Comm comm;              /* File communicator, shared by the datasets
+                                 * of the file, MPI_COMM_NULL if not MPI-IO */
+    param_list_t *params;       /* Parameters applied by H5Dcreate */
+    size_t aggregate;           /* Aggregation buffer size, 0 if none */
+    int transfer;               /* COLLECTIVE_RULE_* */
+    struct defer_dset_t *next;  /* Next dataset not created yet */
+} defer_dset_t;
+hid_t defer_register(hid_t loc_id, const char *name, hid_t type_id, hid_t space_id, hid_t lcpl_id, hid_t dcpl_id, hid_t app_dcpl_id, hid_t dapl_id,
+    size_t aggregate, int transfer);
+defer_dset_t *defer_lookup(hid_t id);
+hid_t defer_next_pending(const char *filename);
+int defer_has_pending(void);
+herr_t defer_set_extent(defer_dset_t *dd, const hsize_t size[]);
+herr_t defer_chunk(defer_dset_t *dd, hid_t file_space_id);
+void defer_created(defer_dset_t *dd, hid_t dset_id);
+
+/* Small-write aggregation (autotuner_aggregate.c) */
+void set_aggregate(void);
+herr_t aggregate_register(hid_t dset_id, size_t capacity);
+herr_t aggregate_write(hid_t dset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void *buf,
+    /* OUT */ int *buffered);
+herr_t aggregate_flush(hid_t dset_id);
+herr_t aggregate_flush_file(const char *filename);
+int aggregate_has_data(void);
+herr_t aggregate_close(hid_t dset_id);
+
+/* Write-behind (autotuner_async.c) */
+void set_async(void);
+herr_t async_write(hid_t dset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id, hid_t xfer_plist_id, const void *buf,
+    /* OUT */ int *queued);
+herr_t async_drain(hid_t dset_id);
+herr_t async_finalize(void);
+
+/* Promotion to collective writes (autotuner_collective.c) */
+#define COLLECTIVE_ALL 1
+#define COLLECTIVE_RULES 2
+void set_collective(void);
+herr_t collective_set_rule(hid_t dset_id, int rule);
+herr_t collective_adapt_dxpl(hid_t dset_id, hid_t xfer_plist_id, /* OUT */ hid_t *adapted_dxpl_id);
+herr_t collective_sync(hid_t dset_id);
+
+
+#endif /* _autotuner_private_H */
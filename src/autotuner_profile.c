@@ -0,0 +1,146 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Self profile.  With H5TUNER_SELF_PROFILE=1 the library times its own work
+ * in the intercepted calls that apply parameters (loading the config file,
+ * matching rules, copying property lists and building the MPI_Info), and the
+ * forwarded HDF5 call separately, so the overhead of H5Tuner can be checked.
+ */
+
+#include "autotuner_private.h"
+
+/* Global to indicate the self profile is enabled */
+int self_profile_g = 0;
+
+static int profile_finalized_g = 0;
+
+/* Time per phase, and the number of forwarded calls, per function */
+static double profile_time_g[PROF_NFUNCS][PROF_NPHASES];
+static double profile_calls_g[PROF_NFUNCS];
+
+static const char *profile_func_names_g[PROF_NFUNCS] = {
+    "H5Fcreate",
+    "H5Fopen",
+    "H5Dcreate"
+};
+
+static const char *profile_phase_names_g[PROF_NPHASES] = {
+    "config_load",
+    "rule_match",
+    "property_copy",
+    "mpi_info",
+    "hdf5_call"
+};
+
+
+static void profile_atexit(void)
+{
+    if(profile_finalize() < 0)
+        DONE_ERROR("Unable to write H5Tuner self profile");
+
+    return;
+}
+
+
+void set_self_profile(void)
+{
+    static int self_profile_set = 0;
+    char *self_profile = getenv("H5TUNER_SELF_PROFILE");
+
+    if(self_profile_set)
+        return;
+    self_profile_set = 1;
+
+    if(self_profile && strtol(self_profile, NULL, 10) > 0) {
+        self_profile_g = 1;
+        atexit(profile_atexit);
+    }
+
+    return;
+}
+
+
+void profile_add(prof_func_t func, prof_phase_t phase, double elapsed)
+{
+    profile_time_g[func][phase] += elapsed;
+    if(phase == PROF_HDF5_CALL)
+        profile_calls_g[func] += 1.0;
+
+    return;
+}
+
+
+/* Print the self profile: for each function and phase, the maximum over
+ * ranks of the total time and the mean time per call.  The H5Tuner overhead
+ * is the time of all phases except the forwarded HDF5 call. */
+herr_t profile_finalize(void)
+{
+    int mpi_initialized = 0;
+    int mpi_finalized = 0;
+    int mpi_rank = 0;
+    int mpi_size = 1;
+    double local[PROF_NFUNCS * (PROF_NPHASES + 1)];
+    double max[PROF_NFUNCS * (PROF_NPHASES + 1)];
+    int nvals = PROF_NFUNCS * (PROF_NPHASES + 1);
+    int f, p;
+    herr_t ret_value = SUCCEED;
+
+    if(!self_profile_g || profile_finalized_g)
+        return ret_value;
+    profile_finalized_g = 1;
+
+    for(f = 0; f < PROF_NFUNCS; f++) {
+        for(p = 0; p < PROF_NPHASES; p++)
+            local[f * (PROF_NPHASES + 1) + p] = profile_time_g[f][p];
+        local[f * (PROF_NPHASES + 1) + PROF_NPHASES] = profile_calls_g[f];
+    }
+    memcpy(max, local, sizeof(max));
+
+    MPI_Initialized(&mpi_initialized);
+    if(mpi_initialized)
+        MPI_Finalized(&mpi_finalized);
+
+    if(mpi_initialized && !mpi_finalized) {
+        if(MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank) != MPI_SUCCESS)
+            ERROR("Unable to get MPI rank");
+        if(MPI_Comm_size(MPI_COMM_WORLD, &mpi_size) != MPI_SUCCESS)
+            ERROR("Unable to get MPI size");
+        if(MPI_Reduce(local, max, nvals, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+            ERROR("Unable to reduce self profile");
+    }
+
+    if(mpi_rank == 0) {
+        printf("# H5Tuner self profile: %d ranks, maximum over ranks\n", mpi_size);
+        printf("# function phase total_s per_call_us\n");
+        for(f = 0; f < PROF_NFUNCS; f++) {
+            const double *vals = &max[f * (PROF_NPHASES + 1)];
+            double calls = vals[PROF_NPHASES];
+            double tuner = 0.0;
+
+            if(calls <= 0.0)
+                continue;
+
+            printf("%s calls %.0f\n", profile_func_names_g[f], calls);
+            for(p = 0; p < PROF_NPHASES; p++) {
+                printf("  %s %.9f %.3f\n", profile_phase_names_g[p], vals[p], vals[p] * 1.0e6 / calls);
+                if(p != PROF_HDF5_CALL)
+                    tuner += vals[p];
+            }
+            printf("  h5tuner_total %.9f %.3f\n", tuner, tuner * 1.0e6 / calls);
+            printf("  overhead_pct %.2f\n", tuner + vals[PROF_HDF5_CALL] > 0.0 ? 100.0 * tuner / (tuner + vals[PROF_HDF5_CALL]) : 0.0);
+        }
+        fflush(stdout);
+    }
+
+done:
+    return ret_value;
+}
@@ -0,0 +1,527 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * I/O skeleton capture.  With H5TUNER_SKELETON=<prefix> each rank writes the
+ * HDF5 calls it makes to "<prefix>.<rank>.skel": file creation, opening and
+ * closing, dataset creation with the application's type, dataspace and
+ * chunking, and every H5Dwrite/H5Dread with its file selection and transfer
+ * mode, but none of the data.  h5tuner-replay replays the skeletons with
+ * synthetic buffers, so candidate configurations can be evaluated without
+ * running the application.
+ *
+ * The skeleton is a text file with one call per line:
+ *
+ *   h5tuner-skeleton VERSION
+ *   rank RANK size SIZE
+ *   START ELAPSED fcreate LEADER NPROCS FLAGS FILE
+ *   START ELAPSED fopen LEADER NPROCS FLAGS FILE
+ *   START ELAPSED fclose FILE
+ *   START ELAPSED dcreate FILE DSET TYPE RANK DIMS... MAXDIMS... CHUNK_RANK CHUNK...
+ *   START ELAPSED dataset FILE DSET TYPE RANK DIMS... MAXDIMS... CHUNK_RANK CHUNK...
+ *   START ELAPSED extent FILE DSET RANK DIMS...
+ *   START ELAPSED write|read FILE DSET c|i SELECTION
+ *   START ELAPSED dclose FILE DSET
+ *
+ * START is in seconds since H5Tuner was loaded.  LEADER is the MPI_COMM_WORLD
+ * rank of rank 0 of the file's MPI-IO communicator, with NPROCS ranks, or -1
+ * if the file does not use MPI-IO.  "dataset" describes a dataset the
+ * application opened (H5Dopen is not intercepted) the first time it is
+ * accessed, and "extent" records a change of the dataset's extent.  TYPE is
+ * the type class (i, u, f or o for other) followed by the size in bytes.
+ * MAXDIMS of -1 are unlimited.  SELECTION is one of
+ *
+ *   all
+ *   none
+ *   hyper RANK START... STRIDE... COUNT... BLOCK...
+ *   blocks RANK NBLOCKS (START... END...)...
+ *   points RANK NPOINTS (COORD...)...
+ *   bounds RANK NPOINTS START... END...
+ *
+ * where "bounds" replaces block and point lists longer than
+ * SKELETON_MAX_LIST.  Names are written with '%', whitespace and
+ * non-printable characters as %XX.
+ */
+
+#include "autotuner_private.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define SKELETON_VERSION 1
+
+/* Longest block or point list written in full */
+#define SKELETON_MAX_LIST 1024
+
+/* Global to indicate skeleton capture is enabled */
+int skeleton_enabled_g = 0;
+
+static const char *skeleton_prefix_g = NULL;
+static FILE *skeleton_fp_g = NULL;
+static double skeleton_start_g = 0.0;
+static int skeleton_finalized_g = 0;
+static pthread_mutex_t skeleton_mutex_g = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void skeleton_atexit(void)
+{
+    if(skeleton_finalize() < 0)
+        DONE_ERROR("Unable to write H5Tuner skeleton");
+
+    return;
+}
+
+
+void set_skeleton(void)
+{
+    static int skeleton_set = 0;
+
+    if(skeleton_set)
+        return;
+    skeleton_set = 1;
+
+    if(NULL == (skeleton_prefix_g = getenv("H5TUNER_SKELETON")) || !*skeleton_prefix_g)
+        return;
+
+    skeleton_start_g = h5tuner_wtime();
+    skeleton_enabled_g = 1;
+    atexit(skeleton_atexit);
+
+    return;
+}
+
+
+/* Open the skeleton file.  The first intercepted call normally comes after
+ * MPI_Init; processes that never initialize MPI are named by process ID. */
+static herr_t skeleton_open(void)
+{
+    char *skeleton_file = NULL;
+    int mpi_initialized = 0;
+    int mpi_finalized = 0;
+    int rank = -1;
+    int size = 1;
+    herr_t ret_value = SUCCEED;
+
+    MPI_Initialized(&mpi_initialized);
+    if(mpi_initialized)
+        MPI_Finalized(&mpi_finalized);
+    if(mpi_initialized && !mpi_finalized) {
+        if(MPI_Comm_rank(MPI_COMM_WORLD, &rank) != MPI_SUCCESS)
+            ERROR("Unable to get MPI rank");
+        if(MPI_Comm_size(MPI_COMM_WORLD, &size) != MPI_SUCCESS)
+            ERROR("Unable to get MPI size");
+    }
+
+    if(NULL == (skeleton_file = (char *)malloc(strlen(skeleton_prefix_g) + 32)))
+        ERROR("Unable to allocate skeleton file name");
+    sprintf(skeleton_file, "%s.%d.skel", skeleton_prefix_g, rank >= 0 ? rank : (int)getpid());
+
+    if(NULL == (skeleton_fp_g = fopen(skeleton_file, "w")))
+        ERROR("Unable to open skeleton file");
+    fprintf(skeleton_fp_g, "h5tuner-skeleton %d\nrank %d size %d\n", SKELETON_VERSION, rank >= 0 ? rank : 0, size);
+
+done:
+    free(skeleton_file);
+    skeleton_file = NULL;
+
+    return ret_value;
+}
+
+
+/* Start a record: lock the file and write the times and operation.  On
+ * success the caller must call skeleton_end. */
+static herr_t skeleton_begin(const char *op, double start, double end)
+{
+    herr_t ret_value = SUCCEED;
+
+    pthread_mutex_lock(&skeleton_mutex_g);
+
+    if(skeleton_finalized_g || (!skeleton_fp_g && skeleton_open() < 0)) {
+        pthread_mutex_unlock(&skeleton_mutex_g);
+        ERROR("Unable to open skeleton file");
+    }
+
+    fprintf(skeleton_fp_g, "%.6f %.6f %s", start - skeleton_start_g, end - start, op);
+
+done:
+    return ret_value;
+}
+
+
+static void skeleton_end(void)
+{
+    fputc('\n', skeleton_fp_g);
+    pthread_mutex_unlock(&skeleton_mutex_g);
+
+    return;
+}
+
+
+static void skeleton_put_name(const char *name)
+{
+    const unsigned char *c;
+
+    fputc(' ', skeleton_fp_g);
+    for(c = (const unsigned char *)name; *c; c++)
+        if(*c == '%' || !isgraph(*c))
+            fprintf(skeleton_fp_g, "%%%02X", (unsigned)*c);
+        else
+            fputc(*c, skeleton_fp_g);
+
+    return;
+}
+
+
+static void skeleton_put_dims(int rank, const hsize_t *dims)
+{
+    int d;
+
+    for(d = 0; d < rank; d++)
+        if(dims[d] == H5S_UNLIMITED)
+            fputs(" -1", skeleton_fp_g);
+        else
+            fprintf(skeleton_fp_g, " %llu", (unsigned long long)dims[d]);
+
+    return;
+}
+
+
+/* Write the "dcreate" or "dataset" record and remember the extent */
+static herr_t skeleton_describe(const char *op, dset_stats_t *stats, hid_t type_id, hid_t space_id,
+        hid_t dcpl_id, double start, double end)
+{
+    hsize_t dims[H5S_MAX_RANK];
+    hsize_t maxdims[H5S_MAX_RANK];
+    hsize_t chunk[H5S_MAX_RANK];
+    int chunk_rank = 0;
+    int rank;
+    char type_class;
+    size_t type_size;
+    herr_t ret_value = SUCCEED;
+
+    switch(H5Tget_class(type_id)) {
+        case H5T_INTEGER:
+            type_class = H5Tget_sign(type_id) == H5T_SGN_NONE ? 'u' : 'i';
+            break;
+        case H5T_FLOAT:
+            type_class = 'f';
+            break;
+        case H5T_NO_CLASS:
+            ERROR("Unable to get datatype class");
+        default:
+            type_class = 'o';
+            break;
+    }
+    if(0 == (type_size = H5Tget_size(type_id)))
+        ERROR("Unable to get datatype size");
+
+    if((rank = H5Sget_simple_extent_dims(space_id, dims, maxdims)) < 0)
+        ERROR("Unable to get dataspace dimensions");
+
+    if(dcpl_id != H5P_DEFAULT) {
+        H5D_layout_t layout;
+
+        if((layout = H5Pget_layout(dcpl_id)) < 0)
+            ERROR("Unable to get dataset layout");
+        if(layout == H5D_CHUNKED && (chunk_rank = H5Pget_chunk(dcpl_id, H5S_MAX_RANK, chunk)) < 0)
+            ERROR("Unable to get chunk dimensions");
+    }
+
+    if(skeleton_begin(op, start, end) < 0)
+        ERROR("Unable to start skeleton record");
+    skeleton_put_name(stats->filename);
+    skeleton_put_name(stats->dset_name);
+    fprintf(skeleton_fp_g, " %c%lu %d", type_class, (unsigned long)type_size, rank);
+    skeleton_put_dims(rank, dims);
+    skeleton_put_dims(rank, maxdims);
+    fprintf(skeleton_fp_g, " %d", chunk_rank);
+    skeleton_put_dims(chunk_rank, chunk);
+    skeleton_end();
+
+    stats->skeleton_rank = rank;
+    memcpy(stats->skeleton_extent, dims, (size_t)rank * sizeof(hsize_t));
+
+done:
+    return ret_value;
+}
+
+
+herr_t skeleton_file(const char *op, const char *filename, unsigned flags, hid_t fapl_id, double start, double end)
+{
+    MPI_Comm comm = MPI_COMM_NULL;
+    MPI_Info info = MPI_INFO_NULL;
+    int leader = -1;
+    int nprocs = 1;
+    herr_t ret_value = SUCCEED;
+
+    /* Identify the communicator by its rank 0 and size, which is enough
+     * for h5tuner-replay to rebuild it */
+    if((fapl_id != H5P_DEFAULT) && (H5Pget_driver(fapl_id) == H5FD_MPIO)) {
+        MPI_Group group = MPI_GROUP_NULL;
+        MPI_Group world_group = MPI_GROUP_NULL;
+        int zero = 0;
+
+        if(H5Pget_fapl_mpio(fapl_id, &comm, &info) < 0)
+            ERROR("Unable to get MPIO file driver info");
+        if(MPI_Comm_size(comm, &nprocs) != MPI_SUCCESS)
+            ERROR("Unable to get communicator size");
+        if(MPI_Comm_group(comm, &group) != MPI_SUCCESS || MPI_Comm_group(MPI_COMM_WORLD, &world_group) != MPI_SUCCESS
+                || MPI_Group_translate_ranks(group, 1, &zero, world_group, &leader) != MPI_SUCCESS)
+            leader = 0;
+        if(group != MPI_GROUP_NULL)
+            MPI_Group_free(&group);
+        if(world_group != MPI_GROUP_NULL)
+            MPI_Group_free(&world_group);
+    }
+
+    if(skeleton_begin(op, start, end) < 0)
+        ERROR("Unable to start skeleton record");
+    fprintf(skeleton_fp_g, " %d %d %u", leader, nprocs, flags);
+    skeleton_put_name(filename);
+    skeleton_end();
+
+done:
+    if(comm != MPI_COMM_NULL)
+        MPI_Comm_free(&comm);
+    if(info != MPI_INFO_NULL)
+        MPI_Info_free(&info);
+
+    return ret_value;
+}
+
+
+herr_t skeleton_fclose(const char *filename, double start, double end)
+{
+    herr_t ret_value = SUCCEED;
+
+    if(skeleton_begin("fclose", start, end) < 0)
+        ERROR("Unable to start skeleton record");
+    skeleton_put_name(filename);
+    skeleton_end();
+
+done:
+    return ret_value;
+}
+
+
+herr_t skeleton_dcreate(hid_t dset_id, hid_t type_id, hid_t space_id, hid_t dcpl_id, double start, double end)
+{
+    dset_stats_t *stats;
+    herr_t ret_value = SUCCEED;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+    if(skeleton_describe("dcreate", stats, type_id, space_id, dcpl_id, start, end) < 0)
+        ERROR("Unable to describe dataset");
+
+done:
+    return ret_value;
+}
+
+
+/* Write the file selection of an H5Dwrite/H5Dread */
+static herr_t skeleton_put_selection(hid_t space_id)
+{
+    H5S_sel_type sel_type;
+    hsize_t *list = NULL;
+    hssize_t n = 0;
+    int rank;
+    herr_t ret_value = SUCCEED;
+
+    if((sel_type = H5Sget_select_type(space_id)) < 0)
+        ERROR("Unable to get selection type");
+    if(sel_type == H5S_SEL_ALL) {
+        fputs(" all", skeleton_fp_g);
+        goto done;
+    }
+    if(sel_type == H5S_SEL_NONE) {
+        fputs(" none", skeleton_fp_g);
+        goto done;
+    }
+    if((rank = H5Sget_simple_extent_ndims(space_id)) < 0)
+        ERROR("Unable to get number of space dimensions");
+
+    if(sel_type == H5S_SEL_HYPERSLABS) {
+#if H5_VERSION_GE(1, 10, 0)
+        htri_t is_regular;
+
+        if((is_regular = H5Sis_regular_hyperslab(space_id)) < 0)
+            ERROR("Unable to check for regular hyperslab");
+        if(is_regular) {
+            hsize_t start[H5S_MAX_RANK], stride[H5S_MAX_RANK], count[H5S_MAX_RANK], block[H5S_MAX_RANK];
+
+            if(H5Sget_regular_hyperslab(space_id, start, stride, count, block) < 0)
+                ERROR("Unable to get regular hyperslab");
+            fprintf(skeleton_fp_g, " hyper %d", rank);
+            skeleton_put_dims(rank, start);
+            skeleton_put_dims(rank, stride);
+            skeleton_put_dims(rank, count);
+            skeleton_put_dims(rank, block);
+            goto done;
+        }
+#endif
+        if((n = H5Sget_select_hyper_nblocks(space_id)) < 0)
+            ERROR("Unable to get number of hyperslab blocks");
+        if(n <= SKELETON_MAX_LIST) {
+            if(NULL == (list = (hsize_t *)malloc((size_t)(n * 2 * rank) * sizeof(hsize_t) + 1)))
+                ERROR("Unable to allocate block list");
+            if(H5Sget_select_hyper_blocklist(space_id, 0, (hsize_t)n, list) < 0)
+                ERROR("Unable to get block list");
+            fprintf(skeleton_fp_g, " blocks %d %lld", rank, (long long)n);
+            skeleton_put_dims((int)(n * 2 * rank), list);
+            goto done;
+        }
+    }
+    else if(sel_type == H5S_SEL_POINTS) {
+        if((n = H5Sget_select_elem_npoints(space_id)) < 0)
+            ERROR("Unable to get number of selected points");
+        if(n <= SKELETON_MAX_LIST) {
+            if(NULL == (list = (hsize_t *)malloc((size_t)(n * rank) * sizeof(hsize_t) + 1)))
+                ERROR("Unable to allocate point list");
+            if(H5Sget_select_elem_pointlist(space_id, 0, (hsize_t)n, list) < 0)
+                ERROR("Unable to get point list");
+            fprintf(skeleton_fp_g, " points %d %lld", rank, (long long)n);
+            skeleton_put_dims((int)(n * rank), list);
+            goto done;
+        }
+    }
+
+    /* Too long to list, replayed as the bounding box */
+    {
+        hsize_t start[H5S_MAX_RANK], end[H5S_MAX_RANK];
+
+        if((n = H5Sget_select_npoints(space_id)) < 0)
+            ERROR("Unable to get number of selected points");
+        if(H5Sget_select_bounds(space_id, start, end) < 0)
+            ERROR("Unable to get selection bounds");
+        fprintf(skeleton_fp_g, " bounds %d %lld", rank, (long long)n);
+        skeleton_put_dims(rank, start);
+        skeleton_put_dims(rank, end);
+    }
+
+done:
+    free(list);
+    list = NULL;
+
+    return ret_value;
+}
+
+
+herr_t skeleton_io(hid_t dset_id, int is_write, hid_t file_space_id, hid_t xfer_plist_id, double start, double end)
+{
+    dset_stats_t *stats;
+    hid_t space_id = -1;
+    hid_t type_id = -1;
+    hid_t dcpl_id = -1;
+    hsize_t dims[H5S_MAX_RANK];
+    int rank;
+    H5FD_mpio_xfer_t xfer_mode = H5FD_MPIO_INDEPENDENT;
+    herr_t ret_value = SUCCEED;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+
+    if((space_id = H5Dget_space(dset_id)) < 0)
+        ERROR("Unable to get dataset dataspace");
+
+    /* Describe datasets the application opened itself */
+    if(stats->skeleton_rank < 0) {
+        if((type_id = H5Dget_type(dset_id)) < 0)
+            ERROR("Unable to get dataset datatype");
+        if((dcpl_id = H5Dget_create_plist(dset_id)) < 0)
+            ERROR("Unable to get dataset creation property list");
+        if(skeleton_describe("dataset", stats, type_id, space_id, dcpl_id, start, start) < 0)
+            ERROR("Unable to describe dataset");
+    }
+
+    /* Record extent changes made with H5Dset_extent */
+    if((rank = H5Sget_simple_extent_dims(space_id, dims, NULL)) < 0)
+        ERROR("Unable to get dataspace dimensions");
+    if(rank != stats->skeleton_rank || memcmp(dims, stats->skeleton_extent, (size_t)rank * sizeof(hsize_t))) {
+        if(skeleton_begin("extent", start, start) < 0)
+            ERROR("Unable to start skeleton record");
+        skeleton_put_name(stats->filename);
+        skeleton_put_name(stats->dset_name);
+        fprintf(skeleton_fp_g, " %d", rank);
+        skeleton_put_dims(rank, dims);
+        skeleton_end();
+
+        stats->skeleton_rank = rank;
+        memcpy(stats->skeleton_extent, dims, (size_t)rank * sizeof(hsize_t));
+    }
+
+    if((xfer_plist_id != H5P_DEFAULT) && (H5Pget_dxpl_mpio(xfer_plist_id, &xfer_mode) < 0))
+        ERROR("Unable to get transfer mode");
+
+    if(skeleton_begin(is_write ? "write" : "read", start, end) < 0)
+        ERROR("Unable to start skeleton record");
+    skeleton_put_name(stats->filename);
+    skeleton_put_name(stats->dset_name);
+    fputs(xfer_mode == H5FD_MPIO_COLLECTIVE ? " c" : " i", skeleton_fp_g);
+    if(file_space_id == H5S_ALL)
+        fputs(" all", skeleton_fp_g);
+    else if(skeleton_put_selection(file_space_id) < 0) {
+        skeleton_end();
+        ERROR("Unable to write selection");
+    }
+    skeleton_end();
+
+done:
+    if((space_id >= 0) && (H5Sclose(space_id) < 0))
+        DONE_ERROR("Failure closing dataspace");
+    if((type_id >= 0) && (H5Tclose(type_id) < 0))
+        DONE_ERROR("Failure closing datatype");
+    if((dcpl_id >= 0) && (H5Pclose(dcpl_id) < 0))
+        DONE_ERROR("Failure closing DCPL");
+
+    return ret_value;
+}
+
+
+/* The dataset is already closed; its names come from the statistics cache */
+herr_t skeleton_dclose(hid_t dset_id, double start, double end)
+{
+    dset_stats_t *stats;
+    herr_t ret_value = SUCCEED;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+
+    if(skeleton_begin("dclose", start, end) < 0)
+        ERROR("Unable to start skeleton record");
+    skeleton_put_name(stats->filename);
+    skeleton_put_name(stats->dset_name);
+    skeleton_end();
+
+done:
+    return ret_value;
+}
+
+
+herr_t skeleton_finalize(void)
+{
+    herr_t ret_value = SUCCEED;
+
+    pthread_mutex_lock(&skeleton_mutex_g);
+
+    if(!skeleton_enabled_g || skeleton_finalized_g)
+        goto done;
+    skeleton_finalized_g = 1;
+
+    if(skeleton_fp_g && (fclose(skeleton_fp_g) != 0))
+        ERROR("Unable to close skeleton file");
+    skeleton_fp_g = NULL;
+
+done:
+    pthread_mutex_unlock(&skeleton_mutex_g);
+
+    return ret_value;
+}
@@ -0,0 +1,1160 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+#include "autotuner_private.h"
+#include <time.h>
+#include <math.h>
+#include <sys/stat.h>
+
+/* Names of the per-dataset statistics, in stat_type_t order */
+static const char *stat_names_g[STAT_NTYPES] = {
+    "write_calls",
+    "write_bytes",
+    "write_time",
+    "read_calls",
+    "read_bytes",
+    "read_time",
+    "mpiio_write_calls",
+    "mpiio_write_bytes",
+    "mpiio_write_time",
+    "mpiio_read_calls",
+    "mpiio_read_bytes",
+    "mpiio_read_time"
+};
+
+/* Names of the selection types, in sel_type_t order */
+static const char *sel_names_g[SEL_NTYPES] = {
+    "all",
+    "regular",
+    "irregular",
+    "points",
+    "none"
+};
+
+/* Names of the selection shape parameters, in shape_param_t order */
+static const char *shape_names_g[SHAPE_NPARAMS] = {
+    "sel_start",
+    "sel_count",
+    "sel_stride",
+    "sel_block"
+};
+
+/* Layout of the per-dataset columns reduced across ranks */
+#define COL_VAL         0
+#define COL_PRESENT     (COL_VAL + STAT_NTYPES)
+#define COL_WRITE_HIST  (COL_PRESENT + 1)
+#define COL_READ_HIST   (COL_WRITE_HIST + HIST_NBINS)
+#define COL_SEL         (COL_READ_HIST + HIST_NBINS)
+#define COL_SHAPE_RANK  (COL_SEL + SEL_NTYPES)
+#define COL_SHAPE_MIN   (COL_SHAPE_RANK + 1)
+#define COL_SHAPE_MAX   (COL_SHAPE_MIN + SHAPE_NPARAMS * SHAPE_MAX_RANK)
+#define NCOLS           (COL_SHAPE_MAX + SHAPE_NPARAMS * SHAPE_MAX_RANK)
+
+/* Global to indicate statistics collection is enabled */
+int stats_enabled_g = 0;
+
+/* Global to keep track of whether the statistics have been reduced and
+ * reported */
+static int stats_finalized_g = 0;
+
+/* Global to indicate the I/O time cost file is enabled */
+int cost_enabled_g = 0;
+
+/* Time spent in intercepted HDF5 calls, and in H5Dwrite and H5Dread, for
+ * the cost file */
+static double io_time_g = 0.0;
+static double write_time_g = 0.0;
+static double read_time_g = 0.0;
+static int cost_finalized_g = 0;
+
+/* Size of each file this process closed after writing, for the cost file */
+typedef struct cost_file_t {
+    char *filename;
+    double size;
+} cost_file_t;
+
+static cost_file_t *cost_files_g = NULL;
+static size_t ncost_files_g = 0;
+static size_t cost_files_alloc_g = 0;
+
+/* Table of all datasets seen by this process */
+static dset_stats_t **dset_stats_g = NULL;
+static size_t ndset_stats_g = 0;
+static size_t dset_stats_alloc_g = 0;
+
+/* Cache of open dataset IDs, so the names only need to be looked up once
+ * per open dataset */
+typedef struct open_dset_t {
+    hid_t dset_id;
+    dset_stats_t *stats;
+} open_dset_t;
+
+static open_dset_t *open_dsets_g = NULL;
+static size_t nopen_dsets_g = 0;
+static size_t open_dsets_alloc_g = 0;
+
+/* Communicators of the open files, duplicated once per file for the
+ * exchanges at H5Dclose and H5Dset_extent */
+typedef struct file_comm_t {
+    char *filename;
+    MPI_Comm comm;              /* MPI_COMM_NULL if not opened with MPI-IO */
+} file_comm_t;
+
+static file_comm_t *file_comms_g = NULL;
+static size_t nfile_comms_g = 0;
+static size_t file_comms_alloc_g = 0;
+
+
+double h5tuner_wtime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+
+static void stats_atexit(void)
+{
+    /* Report local statistics for applications that never initialized MPI
+     * (or finalized it without going through H5Tuner) */
+    if(stats_finalize() < 0)
+        DONE_ERROR("Unable to report H5Tuner statistics");
+
+    return;
+}
+
+
+void set_stats(void)
+{
+    static int stats_set = 0;
+    char *stats = getenv("H5TUNER_STATS");
+
+    if(stats_set)
+        return;
+    stats_set = 1;
+
+    if(stats)
+        stats_enabled_g = (int)strtol(stats, NULL, 10);
+
+    if(stats_enabled_g)
+        atexit(stats_atexit);
+
+    return;
+}
+
+
+static void cost_atexit(void)
+{
+    if(cost_finalize() < 0)
+        DONE_ERROR("Unable to write H5Tuner cost file");
+
+    return;
+}
+
+
+void set_cost(void)
+{
+    static int cost_set = 0;
+    char *cost_file = getenv("H5TUNER_COST_FILE");
+
+    if(cost_set)
+        return;
+    cost_set = 1;
+
+    if(cost_file && *cost_file) {
+        cost_enabled_g = 1;
+        atexit(cost_atexit);
+    }
+
+    return;
+}
+
+
+void cost_add_io_time(double elapsed)
+{
+    io_time_g += elapsed;
+
+    return;
+}
+
+
+void cost_add_transfer_time(int is_write, double elapsed)
+{
+    io_time_g += elapsed;
+    if(is_write)
+        write_time_g += elapsed;
+    else
+        read_time_g += elapsed;
+
+    return;
+}
+
+
+/* Whether this process should count the size of the file when it is
+ * closed: the file was opened for writing, and with the MPI-IO driver this
+ * is rank 0 of the file's communicator, so a shared file is counted once */
+herr_t cost_is_size_owner(hid_t file_id, /* OUT */ int *owner)
+{
+    hid_t fapl_id = -1;
+    MPI_Comm comm = MPI_COMM_NULL;
+    MPI_Info info = MPI_INFO_NULL;
+    unsigned intent;
+    herr_t ret_value = SUCCEED;
+
+    *owner = 0;
+
+    if(H5Fget_intent(file_id, &intent) < 0)
+        ERROR("Unable to get file intent");
+    if(!(intent & H5F_ACC_RDWR))
+        goto done;
+
+    if((fapl_id = H5Fget_access_plist(file_id)) < 0)
+        ERROR("Unable to get file access property list");
+    if(H5Pget_driver(fapl_id) == H5FD_MPIO) {
+        int comm_rank;
+
+        if(H5Pget_fapl_mpio(fapl_id, &comm, &info) < 0)
+            ERROR("Unable to get MPIO file driver info");
+        if(MPI_Comm_rank(comm, &comm_rank) != MPI_SUCCESS)
+            ERROR("Unable to get communicator rank");
+        *owner = (comm_rank == 0);
+    }
+    else
+        *owner = 1;
+
+done:
+    if(comm != MPI_COMM_NULL)
+        MPI_Comm_free(&comm);
+    if(info != MPI_INFO_NULL)
+        MPI_Info_free(&info);
+    if((fapl_id >= 0) && (H5Pclose(fapl_id) < 0))
+        DONE_ERROR("Failure closing file access property list");
+
+    return ret_value;
+}
+
+
+/* Record the size of a closed file.  A file closed again keeps its last
+ * size. */
+herr_t cost_add_file_size(const char *filename)
+{
+    struct stat st;
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    if(stat(filename, &st) < 0)
+        ERROR("Unable to get file size");
+
+    for(i = 0; i < ncost_files_g; i++)
+        if(!strcmp(cost_files_g[i].filename, filename))
+            break;
+
+    if(i == ncost_files_g) {
+        if(ncost_files_g == cost_files_alloc_g) {
+            size_t new_alloc = cost_files_alloc_g ? 2 * cost_files_alloc_g : 8;
+            cost_file_t *new_files;
+
+            if(NULL == (new_files = (cost_file_t *)realloc(cost_files_g, new_alloc * sizeof(cost_file_t))))
+                ERROR("Unable to grow file size table");
+            cost_files_g = new_files;
+            cost_files_alloc_g = new_alloc;
+        }
+        if(NULL == (cost_files_g[i].filename = strdup(filename)))
+            ERROR("Unable to copy file name");
+        ncost_files_g++;
+    }
+
+    cost_files_g[i].size = (double)st.st_size;
+
+done:
+    return ret_value;
+}
+
+
+/* Write the time spent in intercepted HDF5 calls, maximum over all ranks, to
+ * the file named by H5TUNER_COST_FILE.  The first line of the file is the
+ * cost, as read by h5evolve.  It is followed by named metrics h5evolve can
+ * use as objectives: the time in H5Dwrite and in H5Dread, maximum over all
+ * ranks, and the total size of the files written. */
+herr_t cost_finalize(void)
+{
+    int mpi_initialized = 0;
+    int mpi_finalized = 0;
+    int mpi_rank = 0;
+    double times[3];
+    double max_times[3];
+    double file_size = 0.0;
+    double total_file_size;
+    char *cost_file = getenv("H5TUNER_COST_FILE");
+    FILE *fp = NULL;
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    if(!cost_enabled_g || cost_finalized_g)
+        return ret_value;
+    cost_finalized_g = 1;
+
+    MPI_Initialized(&mpi_initialized);
+    if(mpi_initialized)
+        MPI_Finalized(&mpi_finalized);
+
+    times[0] = io_time_g;
+    times[1] = write_time_g;
+    times[2] = read_time_g;
+    for(i = 0; i < ncost_files_g; i++)
+        file_size += cost_files_g[i].size;
+    memcpy(max_times, times, sizeof(times));
+    total_file_size = file_size;
+
+    if(mpi_initialized && !mpi_finalized) {
+        if(MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank) != MPI_SUCCESS)
+            ERROR("Unable to get MPI rank");
+        if(MPI_Reduce(times, max_times, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+            ERROR("Unable to reduce I/O time");
+        if(MPI_Reduce(&file_size, &total_file_size, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+            ERROR("Unable to reduce file size");
+    }
+
+    if(mpi_rank == 0) {
+        if(NULL == (fp = fopen(cost_file, "w")))
+            ERROR("Unable to open cost file");
+        fprintf(fp, "%.9f\n", max_times[0]);
+        fprintf(fp, "write_time %.9f\n", max_times[1]);
+        fprintf(fp, "read_time %.9f\n", max_times[2]);
+        fprintf(fp, "file_size %.0f\n", total_file_size);
+    }
+
+done:
+    if(fp && (fclose(fp) != 0))
+        DONE_ERROR("Failure closing cost file");
+
+    for(i = 0; i < ncost_files_g; i++)
+        free(cost_files_g[i].filename);
+    free(cost_files_g);
+    cost_files_g = NULL;
+    ncost_files_g = cost_files_alloc_g = 0;
+
+    return ret_value;
+}
+
+
+static dset_stats_t *stats_find_or_add(const char *filename, const char *dset_name)
+{
+    dset_stats_t *stats = NULL;
+    size_t i;
+
+    for(i = 0; i < ndset_stats_g; i++)
+        if(!strcmp(dset_stats_g[i]->dset_name, dset_name) && !strcmp(dset_stats_g[i]->filename, filename))
+            return dset_stats_g[i];
+
+    if(ndset_stats_g == dset_stats_alloc_g) {
+        size_t new_alloc = dset_stats_alloc_g ? 2 * dset_stats_alloc_g : 16;
+        dset_stats_t **new_table;
+
+        if(NULL == (new_table = (dset_stats_t **)realloc(dset_stats_g, new_alloc * sizeof(dset_stats_t *))))
+            return NULL;
+        dset_stats_g = new_table;
+        dset_stats_alloc_g = new_alloc;
+    }
+
+    if(NULL == (stats = (dset_stats_t *)calloc(1, sizeof(dset_stats_t))))
+        return NULL;
+    {
+        int p, d;
+
+        for(p = 0; p < SHAPE_NPARAMS; p++)
+            for(d = 0; d < SHAPE_MAX_RANK; d++)
+                stats->shape_min[p][d] = HUGE_VAL;
+    }
+    stats->trace_file_id = -1;
+    stats->trace_dset_id = -1;
+    stats->pattern[0].xfer_mode = -1;
+    stats->pattern[1].xfer_mode = -1;
+    stats->live_slot = -1;
+    stats->skeleton_rank = -1;
+    if(NULL == (stats->filename = strdup(filename))) {
+        free(stats);
+        return NULL;
+    }
+    if(NULL == (stats->dset_name = strdup(dset_name))) {
+        free(stats->filename);
+        free(stats);
+        return NULL;
+    }
+
+    dset_stats_g[ndset_stats_g++] = stats;
+
+    return stats;
+}
+
+
+herr_t stats_get_dset(hid_t dset_id, /* OUT */ dset_stats_t **stats_out)
+{
+    char *filename = NULL;
+    char *dset_name = NULL;
+    ssize_t filename_len;
+    ssize_t dset_name_len;
+    dset_stats_t *stats;
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    /* Check the open dataset cache first */
+    for(i = 0; i < nopen_dsets_g; i++)
+        if(open_dsets_g[i].dset_id == dset_id) {
+            *stats_out = open_dsets_g[i].stats;
+            return ret_value;
+        }
+
+    /* Look up the file and dataset names */
+    if((filename_len = H5Fget_name(dset_id, NULL, 0)) < 0)
+        ERROR("Unable to get HDF5 file name length");
+    if(NULL == (filename = (char *)malloc((size_t)filename_len + 1)))
+        ERROR("Unable to allocate HDF5 file name buffer");
+    if(H5Fget_name(dset_id, filename, (size_t)filename_len + 1) < 0)
+        ERROR("Unable to get HDF5 file name");
+
+    if((dset_name_len = H5Iget_name(dset_id, NULL, 0)) < 0)
+        ERROR("Unable to get dataset name length");
+    if(NULL == (dset_name = (char *)malloc((size_t)dset_name_len + 1)))
+        ERROR("Unable to allocate dataset name buffer");
+    if(H5Iget_name(dset_id, dset_name, (size_t)dset_name_len + 1) < 0)
+        ERROR("Unable to get dataset name");
+
+    if(NULL == (stats = stats_find_or_add(filename, dset_name)))
+        ERROR("Unable to add dataset to statistics table");
+
+    /* Add to open dataset cache */
+    if(nopen_dsets_g == open_dsets_alloc_g) {
+        size_t new_alloc = open_dsets_alloc_g ? 2 * open_dsets_alloc_g : 16;
+        open_dset_t *new_cache;
+
+        if(NULL == (new_cache = (open_dset_t *)realloc(open_dsets_g, new_alloc * sizeof(open_dset_t))))
+            ERROR("Unable to grow open dataset cache");
+        open_dsets_g = new_cache;
+        open_dsets_alloc_g = new_alloc;
+    }
+    open_dsets_g[nopen_dsets_g].dset_id = dset_id;
+    open_dsets_g[nopen_dsets_g].stats = stats;
+    nopen_dsets_g++;
+
+    *stats_out = stats;
+
+done:
+    free(filename);
+    filename = NULL;
+    free(dset_name);
+    dset_name = NULL;
+
+    return ret_value;
+}
+
+
+void stats_close_dset(hid_t dset_id)
+{
+    size_t i;
+
+    /* Remove from the open dataset cache, since the ID may be reused */
+    for(i = 0; i < nopen_dsets_g; i++)
+        if(open_dsets_g[i].dset_id == dset_id) {
+            open_dsets_g[i] = open_dsets_g[--nopen_dsets_g];
+            break;
+        }
+
+    return;
+}
+
+
+static char *stats_get_filename(hid_t obj_id)
+{
+    char *filename = NULL;
+    ssize_t filename_len;
+
+    if((filename_len = H5Fget_name(obj_id, NULL, 0)) < 0)
+        return NULL;
+    if(NULL == (filename = (char *)malloc((size_t)filename_len + 1)))
+        return NULL;
+    if(H5Fget_name(obj_id, filename, (size_t)filename_len + 1) < 0) {
+        free(filename);
+        return NULL;
+    }
+
+    return filename;
+}
+
+
+/* Get the communicator of the file of an object, MPI_COMM_NULL if it is not
+ * opened with MPI-IO.  The communicator is duplicated at the first call for
+ * a file, which is collective, and kept until stats_free_comm() at
+ * H5Fclose.  The caller must not free it. */
+herr_t stats_get_comm(hid_t obj_id, /* OUT */ MPI_Comm *comm)
+{
+    char *filename = NULL;
+    hid_t file_id = -1;
+    hid_t fapl_id = -1;
+    MPI_Comm file_comm = MPI_COMM_NULL;
+    MPI_Info info = MPI_INFO_NULL;
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    *comm = MPI_COMM_NULL;
+
+    if(NULL == (filename = stats_get_filename(obj_id)))
+        ERROR("Unable to get HDF5 file name");
+
+    for(i = 0; i < nfile_comms_g; i++)
+        if(!strcmp(file_comms_g[i].filename, filename)) {
+            *comm = file_comms_g[i].comm;
+            goto done;
+        }
+
+    if((file_id = H5Iget_file_id(obj_id)) < 0)
+        ERROR("Unable to get file ID");
+    if((fapl_id = H5Fget_access_plist(file_id)) < 0)
+        ERROR("Unable to get FAPL");
+    if((H5Pget_driver(fapl_id) == H5FD_MPIO) && (H5Pget_fapl_mpio(fapl_id, &file_comm, &info) < 0))
+        ERROR("Unable to get MPIO file driver info");
+
+    if(nfile_comms_g == file_comms_alloc_g) {
+        size_t new_alloc = file_comms_alloc_g ? 2 * file_comms_alloc_g : 16;
+        file_comm_t *new_comms;
+
+        if(NULL == (new_comms = (file_comm_t *)realloc(file_comms_g, new_alloc * sizeof(file_comm_t))))
+            ERROR("Unable to grow file communicator table");
+        file_comms_g = new_comms;
+        file_comms_alloc_g = new_alloc;
+    }
+    file_comms_g[nfile_comms_g].filename = filename;
+    file_comms_g[nfile_comms_g].comm = file_comm;
+    nfile_comms_g++;
+    filename = NULL;
+
+    *comm = file_comm;
+    file_comm = MPI_COMM_NULL;
+
+done:
+    if((file_comm != MPI_COMM_NULL) && (MPI_Comm_free(&file_comm) != MPI_SUCCESS))
+        DONE_ERROR("Failure freeing MPI comm");
+    if((info != MPI_INFO_NULL) && (MPI_Info_free(&info) != MPI_SUCCESS))
+        DONE_ERROR("Failure freeing MPI info");
+    if((fapl_id >= 0) && (H5Pclose(fapl_id) < 0))
+        DONE_ERROR("Failure closing FAPL");
+    /* Not H5Fclose, which is intercepted */
+    if((file_id >= 0) && (H5Idec_ref(file_id) < 0))
+        DONE_ERROR("Failure releasing file ID");
+
+    free(filename);
+    filename = NULL;
+
+    return ret_value;
+}
+
+
+/* Free the communicator of a file, if stats_get_comm() duplicated it */
+herr_t stats_free_comm(hid_t file_id)
+{
+    char *filename = NULL;
+    size_t i;
+    herr_t ret_value = SUCCEED;
+
+    if(nfile_comms_g == 0)
+        return ret_value;
+
+    if(NULL == (filename = stats_get_filename(file_id)))
+        ERROR("Unable to get HDF5 file name");
+
+    for(i = 0; i < nfile_comms_g; i++)
+        if(!strcmp(file_comms_g[i].filename, filename)) {
+            if((file_comms_g[i].comm != MPI_COMM_NULL) && (MPI_Comm_free(&file_comms_g[i].comm) != MPI_SUCCESS))
+                DONE_ERROR("Failure freeing MPI comm");
+            free(file_comms_g[i].filename);
+            file_comms_g[i] = file_comms_g[--nfile_comms_g];
+            break;
+        }
+
+done:
+    free(filename);
+    filename = NULL;
+
+    return ret_value;
+}
+
+
+hssize_t get_io_bytes(hid_t dset_id, hid_t mem_type_id, hid_t mem_space_id, hid_t file_space_id)
+{
+    hid_t space_id = -1;
+    hssize_t npoints;
+    size_t type_size;
+    hssize_t ret_value = -1;
+
+    /* The number of elements transferred is the number selected in the file
+     * space (or memory space, if the file space is H5S_ALL) */
+    if(file_space_id != H5S_ALL)
+        space_id = file_space_id;
+    else if(mem_space_id != H5S_ALL)
+        space_id = mem_space_id;
+
+    if(space_id >= 0) {
+        if((npoints = H5Sget_select_npoints(space_id)) < 0)
+            ERROR("Unable to get number of selected points");
+    }
+    else {
+        hid_t dset_space_id;
+
+        if((dset_space_id = H5Dget_space(dset_id)) < 0)
+            ERROR("Unable to get dataset dataspace");
+        npoints = H5Sget_simple_extent_npoints(dset_space_id);
+        if(H5Sclose(dset_space_id) < 0)
+            ERROR("Unable to close dataset dataspace");
+        if(npoints < 0)
+            ERROR("Unable to get number of dataset elements");
+    }
+
+    if(0 == (type_size = H5Tget_size(mem_type_id)))
+        ERROR("Unable to get memory datatype size");
+
+    ret_value = npoints * (hssize_t)type_size;
+
+done:
+    return ret_value;
+}
+
+
+/* Update the selection shape summary for a file space selection */
+static herr_t stats_record_selection(dset_stats_t *stats, hid_t file_space_id)
+{
+    H5S_sel_type sel_type;
+    hsize_t start[SHAPE_MAX_RANK];
+    hsize_t stride[SHAPE_MAX_RANK];
+    hsize_t count[SHAPE_MAX_RANK];
+    hsize_t block[SHAPE_MAX_RANK];
+    int ndims;
+    int regular = 0;
+    int d;
+    herr_t ret_value = SUCCEED;
+
+    if(file_space_id == H5S_ALL) {
+        stats->sel[SEL_ALL] += 1.0;
+        goto done;
+    }
+
+    if((sel_type = H5Sget_select_type(file_space_id)) < 0)
+        ERROR("Unable to get selection type");
+
+    if(sel_type == H5S_SEL_ALL) {
+        stats->sel[SEL_ALL] += 1.0;
+        goto done;
+    }
+    else if(sel_type == H5S_SEL_NONE) {
+        stats->sel[SEL_NONE] += 1.0;
+        goto done;
+    }
+    else if(sel_type == H5S_SEL_POINTS) {
+        stats->sel[SEL_POINTS] += 1.0;
+        goto done;
+    }
+
+    if((ndims = H5Sget_simple_extent_ndims(file_space_id)) < 0)
+        ERROR("Unable to get number of space dimensions");
+    if(ndims > SHAPE_MAX_RANK) {
+        stats->sel[SEL_IRREGULAR] += 1.0;
+        goto done;
+    }
+
+#if H5_VERSION_GE(1, 10, 0)
+    {
+        htri_t is_regular;
+
+        if((is_regular = H5Sis_regular_hyperslab(file_space_id)) < 0)
+            ERROR("Unable to check for regular hyperslab");
+        if(is_regular) {
+            if(H5Sget_regular_hyperslab(file_space_id, start, stride, count, block) < 0)
+                ERROR("Unable to get regular hyperslab");
+            regular = 1;
+        }
+    }
+#else
+    {
+        hssize_t nblocks;
+
+        /* Only single block selections can be recognized as regular */
+        if((nblocks = H5Sget_select_hyper_nblocks(file_space_id)) < 0)
+            ERROR("Unable to get number of hyperslab blocks");
+        if(nblocks == 1) {
+            hsize_t end[SHAPE_MAX_RANK];
+
+            if(H5Sget_select_bounds(file_space_id, start, end) < 0)
+                ERROR("Unable to get selection bounds");
+            for(d = 0; d < ndims; d++) {
+                stride[d] = 1;
+                count[d] = 1;
+                block[d] = end[d] - start[d] + 1;
+            }
+            regular = 1;
+        }
+    }
+#endif
+
+    if(!regular) {
+        stats->sel[SEL_IRREGULAR] += 1.0;
+        goto done;
+    }
+
+    stats->sel[SEL_REGULAR] += 1.0;
+    if(ndims > stats->shape_rank)
+        stats->shape_rank = ndims;
+    for(d = 0; d < ndims; d++) {
+        double vals[SHAPE_NPARAMS];
+        int p;
+
+        vals[SHAPE_START] = (double)start[d];
+        vals[SHAPE_COUNT] = (double)count[d];
+        vals[SHAPE_STRIDE] = (double)stride[d];
+        vals[SHAPE_BLOCK] = (double)block[d];
+
+        for(p = 0; p < SHAPE_NPARAMS; p++) {
+            if(vals[p] < stats->shape_min[p][d])
+                stats->shape_min[p][d] = vals[p];
+            if(vals[p] > stats->shape_max[p][d])
+                stats->shape_max[p][d] = vals[p];
+        }
+    }
+
+done:
+    return ret_value;
+}
+
+
+herr_t stats_record_io(hid_t dset_id, int is_write, hid_t file_space_id, hssize_t nbytes, double elapsed)
+{
+    dset_stats_t *stats;
+    int bin = 0;
+    herr_t ret_value = SUCCEED;
+
+    if(stats_get_dset(dset_id, &stats) < 0)
+        ERROR("Unable to get dataset statistics");
+
+    /* Find log2 histogram bin */
+    while((bin < HIST_NBINS - 1) && ((hssize_t)1 << (bin + 1)) <= nbytes)
+        bin++;
+
+    if(is_write) {
+        stats->val[STAT_WRITE_CALLS] += 1.0;
+        stats->val[STAT_WRITE_BYTES] += (double)nbytes;
+        stats->val[STAT_WRITE_TIME] += elapsed;
+        stats->write_hist[bin] += 1.0;
+    }
+    else {
+        stats->val[STAT_READ_CALLS] += 1.0;
+        stats->val[STAT_READ_BYTES] += (double)nbytes;
+        stats->val[STAT_READ_TIME] += elapsed;
+        stats->read_hist[bin] += 1.0;
+    }
+
+    if(stats_record_selection(stats, file_space_id) < 0)
+        ERROR("Unable to record selection shape");
+
+done:
+    return ret_value;
+}
+
+
+/* Pack a dataset's statistics into the columns reduced across ranks.  A NULL
+ * stats packs a dataset this rank never accessed. */
+static void stats_pack(const dset_stats_t *stats, double *cols)
+{
+    int p, d;
+
+    memset(cols, 0, NCOLS * sizeof(double));
+    for(p = 0; p < SHAPE_NPARAMS; p++)
+        for(d = 0; d < SHAPE_MAX_RANK; d++)
+            cols[COL_SHAPE_MIN + p * SHAPE_MAX_RANK + d] = HUGE_VAL;
+
+    if(!stats)
+        return;
+
+    memcpy(&cols[COL_VAL], stats->val, sizeof(stats->val));
+    cols[COL_PRESENT] = 1.0;
+    memcpy(&cols[COL_WRITE_HIST], stats->write_hist, sizeof(stats->write_hist));
+    memcpy(&cols[COL_READ_HIST], stats->read_hist, sizeof(stats->read_hist));
+    memcpy(&cols[COL_SEL], stats->sel, sizeof(stats->sel));
+    cols[COL_SHAPE_RANK] = (double)stats->shape_rank;
+    memcpy(&cols[COL_SHAPE_MIN], stats->shape_min, sizeof(stats->shape_min));
+    memcpy(&cols[COL_SHAPE_MAX], stats->shape_max, sizeof(stats->shape_max));
+
+    return;
+}
+
+
+/* Print a histogram as "bin:count" pairs for the non-empty bins */
+static void stats_print_hist(FILE *fp, const char *name, const double *hist)
+{
+    int bin;
+
+    fprintf(fp, "  %s", name);
+    for(bin = 0; bin < HIST_NBINS; bin++)
+        if(hist[bin] > 0.0)
+            fprintf(fp, " %d:%.0f", bin, hist[bin]);
+    fprintf(fp, "\n");
+
+    return;
+}
+
+
+/* Order of datasets by file name, then dataset name */
+static int stats_name_cmp(const void *a, const void *b)
+{
+    const dset_stats_t *sa = *(const dset_stats_t * const *)a;
+    const dset_stats_t *sb = *(const dset_stats_t * const *)b;
+    int cmp;
+
+    if(0 != (cmp = strcmp(sa->filename, sb->filename)))
+        return cmp;
+
+    return strcmp(sa->dset_name, sb->dset_name);
+}
+
+
+/* The same order for names packed as "filename\0dset_name\0" pairs */
+static int stats_pair_cmp(const char *a, const char *b)
+{
+    int cmp;
+
+    if(0 != (cmp = strcmp(a, b)))
+        return cmp;
+
+    return strcmp(a + strlen(a) + 1, b + strlen(b) + 1);
+}
+
+
+static int stats_pair_len(const char *pair)
+{
+    size_t filename_len = strlen(pair);
+
+    return (int)(filename_len + strlen(pair + filename_len + 1) + 2);
+}
+
+
+/* Merge two sorted name lists into a new sorted list without duplicates */
+static char *stats_merge_sorted(const char *a, int a_len, const char *b, int b_len, /* OUT */ int *merged_len_out)
+{
+    char *merged;
+    int a_pos = 0;
+    int b_pos = 0;
+    int merged_len = 0;
+
+    if(NULL == (merged = (char *)malloc((size_t)a_len + (size_t)b_len + 1)))
+        return NULL;
+
+    while(a_pos < a_len || b_pos < b_len) {
+        const char *pair;
+        int cmp;
+
+        if(a_pos == a_len)
+            cmp = 1;
+        else if(b_pos == b_len)
+            cmp = -1;
+        else
+            cmp = stats_pair_cmp(a + a_pos, b + b_pos);
+
+        pair = cmp <= 0 ? a + a_pos : b + b_pos;
+        memcpy(merged + merged_len, pair, (size_t)stats_pair_len(pair));
+        merged_len += stats_pair_len(pair);
+
+        if(cmp <= 0)
+            a_pos += stats_pair_len(a + a_pos);
+        if(cmp >= 0)
+            b_pos += stats_pair_len(b + b_pos);
+    }
+
+    *merged_len_out = merged_len;
+
+    return merged;
+}
+
+
+/* Build the sorted list of all datasets seen by any rank, and broadcast it
+ * so every rank agrees on the dataset order.  The sorted lists of the ranks
+ * are merged along a binomial tree, so each rank merges at most log2(size)
+ * lists and rank 0 never holds more than the merged list and one other.
+ * local_names is this rank's sorted list.  The names are packed as
+ * "filename\0dset_name\0" pairs. */
+static herr_t stats_merge_names(MPI_Comm comm, int mpi_rank, int mpi_size, const char *local_names, int local_len,
+    char **names_out, int *names_len_out, size_t *nnames_out)
+{
+    char *merged = NULL;
+    int merged_len = local_len;
+    char *recv_names = NULL;
+    char *new_merged;
+    size_t nmerged = 0;
+    int mask;
+    int pos;
+    herr_t ret_value = SUCCEED;
+
+    if(NULL == (merged = (char *)malloc((size_t)local_len + 1)))
+        ERROR("Unable to allocate merged name buffer");
+    memcpy(merged, local_names, (size_t)local_len);
+
+    for(mask = 1; mask < mpi_size; mask <<= 1) {
+        if(mpi_rank & mask) {
+            if(MPI_Send(&merged_len, 1, MPI_INT, mpi_rank - mask, 0, comm) != MPI_SUCCESS)
+                ERROR("Unable to send name length");
+            if(MPI_Send(merged, merged_len, MPI_CHAR, mpi_rank - mask, 0, comm) != MPI_SUCCESS)
+                ERROR("Unable to send names");
+            break;
+        }
+        else if(mpi_rank + mask < mpi_size) {
+            int recv_len;
+
+            if(MPI_Recv(&recv_len, 1, MPI_INT, mpi_rank + mask, 0, comm, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+                ERROR("Unable to receive name length");
+            if(NULL == (recv_names = (char *)malloc((size_t)recv_len + 1)))
+                ERROR("Unable to allocate received name buffer");
+            if(MPI_Recv(recv_names, recv_len, MPI_CHAR, mpi_rank + mask, 0, comm, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+                ERROR("Unable to receive names");
+
+            if(NULL == (new_merged = stats_merge_sorted(merged, merged_len, recv_names, recv_len, &merged_len)))
+                ERROR("Unable to merge names");
+            free(merged);
+            merged = new_merged;
+            free(recv_names);
+            recv_names = NULL;
+        }
+    }
+
+    /* Broadcast merged list */
+    if(MPI_Bcast(&merged_len, 1, MPI_INT, 0, comm) != MPI_SUCCESS)
+        ERROR("Unable to broadcast merged name length");
+    if(mpi_rank != 0) {
+        free(merged);
+        if(NULL == (merged = (char *)malloc((size_t)merged_len + 1)))
+            ERROR("Unable to allocate merged name buffer");
+    }
+    if(MPI_Bcast(merged, merged_len, MPI_CHAR, 0, comm) != MPI_SUCCESS)
+        ERROR("Unable to broadcast merged names");
+
+    for(pos = 0; pos < merged_len; pos += stats_pair_len(merged + pos))
+        nmerged++;
+
+    *names_out = merged;
+    *names_len_out = merged_len;
+    *nnames_out = nmerged;
+    merged = NULL;
+
+done:
+    free(recv_names);
+    recv_names = NULL;
+    free(merged);
+    merged = NULL;
+
+    return ret_value;
+}
+
+
+herr_t stats_finalize(void)
+{
+    MPI_Comm comm = MPI_COMM_NULL;
+    int mpi_initialized = 0;
+    int mpi_finalized = 0;
+    int mpi_rank = 0;
+    int mpi_size = 1;
+    dset_stats_t **sorted = NULL;
+    char *local_names = NULL;
+    int local_len = 0;
+    char *names = NULL;
+    int names_len = 0;
+    size_t nnames = 0;
+    double *local = NULL;
+    double *min = NULL;
+    double *max = NULL;
+    double *sum = NULL;
+    size_t ncols = NCOLS;
+    size_t i, j;
+    char *stats_file = getenv("H5TUNER_STATS_FILE");
+    FILE *fp = NULL;
+    herr_t ret_value = SUCCEED;
+
+    if(!stats_enabled_g || stats_finalized_g)
+        return ret_value;
+    stats_finalized_g = 1;
+
+    /* Sort this process's datasets, and pack their names in that order */
+    if(NULL == (sorted = (dset_stats_t **)malloc((ndset_stats_g + 1) * sizeof(dset_stats_t *))))
+        ERROR("Unable to allocate dataset table");
+    if(ndset_stats_g > 0)
+        memcpy(sorted, dset_stats_g, ndset_stats_g * sizeof(dset_stats_t *));
+    qsort(sorted, ndset_stats_g, sizeof(dset_stats_t *), stats_name_cmp);
+    for(i = 0; i < ndset_stats_g; i++)
+        local_len += (int)(strlen(sorted[i]->filename) + strlen(sorted[i]->dset_name) + 2);
+    if(NULL == (local_names = (char *)malloc((size_t)local_len + 1)))
+        ERROR("Unable to allocate name buffer");
+    local_len = 0;
+    for(i = 0; i < ndset_stats_g; i++) {
+        strcpy(local_names + local_len, sorted[i]->filename);
+        local_len += (int)strlen(sorted[i]->filename) + 1;
+        strcpy(local_names + local_len, sorted[i]->dset_name);
+        local_len += (int)strlen(sorted[i]->dset_name) + 1;
+    }
+
+    MPI_Initialized(&mpi_initialized);
+    if(mpi_initialized)
+        MPI_Finalized(&mpi_finalized);
+
+    if(mpi_initialized && !mpi_finalized) {
+        if(MPI_Comm_dup(MPI_COMM_WORLD, &comm) != MPI_SUCCESS)
+            ERROR("Unable to duplicate MPI communicator");
+        if(MPI_Comm_rank(comm, &mpi_rank) != MPI_SUCCESS)
+            ERROR("Unable to get MPI rank");
+        if(MPI_Comm_size(comm, &mpi_size) != MPI_SUCCESS)
+            ERROR("Unable to get MPI size");
+
+        if(stats_merge_names(comm, mpi_rank, mpi_size, local_names, local_len, &names, &names_len, &nnames) < 0)
+            ERROR("Unable to merge dataset names");
+    }
+    else {
+        /* No MPI, just report this process's statistics */
+        names = local_names;
+        names_len = local_len;
+        nnames = ndset_stats_g;
+        local_names = NULL;
+    }
+
+    /* Fill in local statistics in the agreed order, walking both sorted
+     * lists.  The last column counts the ranks that accessed each
+     * dataset. */
+    if(NULL == (local = (double *)calloc(nnames * ncols + 1, sizeof(double))))
+        ERROR("Unable to allocate statistics buffer");
+    {
+        int pos = 0;
+
+        j = 0;
+        for(i = 0; i < nnames; i++) {
+            const char *filename = names + pos;
+            const char *dset_name = filename + strlen(filename) + 1;
+            const dset_stats_t *stats = NULL;
+
+            if(j < ndset_stats_g && !strcmp(sorted[j]->filename, filename) && !strcmp(sorted[j]->dset_name, dset_name))
+                stats = sorted[j++];
+            stats_pack(stats, &local[i * ncols]);
+
+            pos += (int)(strlen(filename) + strlen(dset_name) + 2);
+        }
+    }
+
+    /* Reduce */
+    if(comm != MPI_COMM_NULL) {
+        if(mpi_rank == 0) {
+            if(NULL == (min = (double *)malloc((nnames * ncols + 1) * sizeof(double))))
+                ERROR("Unable to allocate statistics buffer");
+            if(NULL == (max = (double *)malloc((nnames * ncols + 1) * sizeof(double))))
+                ERROR("Unable to allocate statistics buffer");
+            if(NULL == (sum = (double *)malloc((nnames * ncols + 1) * sizeof(double))))
+                ERROR("Unable to allocate statistics buffer");
+        }
+        if(MPI_Reduce(local, min, (int)(nnames * ncols), MPI_DOUBLE, MPI_MIN, 0, comm) != MPI_SUCCESS)
+            ERROR("Unable to reduce statistics minimum");
+        if(MPI_Reduce(local, max, (int)(nnames * ncols), MPI_DOUBLE, MPI_MAX, 0, comm) != MPI_SUCCESS)
+            ERROR("Unable to reduce statistics maximum");
+        if(MPI_Reduce(local, sum, (int)(nnames * ncols), MPI_DOUBLE, MPI_SUM, 0, comm) != MPI_SUCCESS)
+            ERROR("Unable to reduce statistics sum");
+    }
+    else {
+        min = local;
+        max = local;
+        sum = local;
+    }
+
+    /* Write summary */
+    if(mpi_rank == 0) {
+        int pos = 0;
+
+        if(stats_file) {
+            if(NULL == (fp = fopen(stats_file, "w")))
+                ERROR("Unable to open statistics file");
+        }
+        else
+            fp = stdout;
+
+        fprintf(fp, "# H5Tuner statistics: %d ranks, %llu datasets\n", mpi_size, (unsigned long long)nnames);
+        fprintf(fp, "# metric min max mean imbalance(max/mean)\n");
+        fprintf(fp, "# write_hist/read_hist log2_bin:calls (bin k = [2^k, 2^(k+1)) bytes)\n");
+        fprintf(fp, "# sel_start/sel_count/sel_stride/sel_block min,... max,...\n");
+        for(i = 0; i < nnames; i++) {
+            const char *filename = names + pos;
+            const char *dset_name = filename + strlen(filename) + 1;
+
+            const double *dmin = &min[i * ncols];
+            const double *dmax = &max[i * ncols];
+            const double *dsum = &sum[i * ncols];
+            int shape_rank = (int)dmax[COL_SHAPE_RANK];
+
+            fprintf(fp, "dataset %s %s ranks %d\n", filename, dset_name, (int)dsum[COL_PRESENT]);
+            for(j = 0; j < STAT_NTYPES; j++) {
+                double mean = dsum[COL_VAL + j] / (double)mpi_size;
+
+                /* MPI-IO metrics are only recorded with H5TUNER_MPIIO */
+                if(j >= STAT_MPIIO_WRITE_CALLS && !mpiio_enabled_g)
+                    continue;
+
+                fprintf(fp, "  %s %g %g %g %g\n", stat_names_g[j], dmin[COL_VAL + j], dmax[COL_VAL + j], mean, mean > 0.0 ? dmax[COL_VAL + j] / mean : 0.0);
+            }
+
+            stats_print_hist(fp, "write_hist", &dsum[COL_WRITE_HIST]);
+            stats_print_hist(fp, "read_hist", &dsum[COL_READ_HIST]);
+
+            fprintf(fp, "  selections");
+            for(j = 0; j < SEL_NTYPES; j++)
+                fprintf(fp, " %s:%.0f", sel_names_g[j], dsum[COL_SEL + j]);
+            fprintf(fp, "\n");
+
+            /* Regular hyperslab shapes, as per-dimension minimum and maximum */
+            if(shape_rank > 0) {
+                int p, d;
+
+                for(p = 0; p < SHAPE_NPARAMS; p++) {
+                    fprintf(fp, "  %s", shape_names_g[p]);
+                    for(d = 0; d < shape_rank; d++)
+                        fprintf(fp, "%c%.0f", d ? ',' : ' ', dmin[COL_SHAPE_MIN + p * SHAPE_MAX_RANK + d]);
+                    for(d = 0; d < shape_rank; d++)
+                        fprintf(fp, "%c%.0f", d ? ',' : ' ', dmax[COL_SHAPE_MAX + p * SHAPE_MAX_RANK + d]);
+                    fprintf(fp, "\n");
+                }
+            }
+
+            pos += (int)(strlen(filename) + strlen(dset_name) + 2);
+        }
+    }
+
+done:
+    if(fp && (fp != stdout) && (fclose(fp) != 0))
+        DONE_ERROR("Failure closing statistics file");
+
+    if(min != local) {
+        free(min);
+        free(max);
+        free(sum);
+    }
+    min = max = sum = NULL;
+    free(local);
+    local = NULL;
+    free(names);
+    names = NULL;
+    free(local_names);
+    local_names = NULL;
+    free(sorted);
+    sorted = NULL;
+
+    if((comm != MPI_COMM_NULL) && (MPI_Comm_free(&comm) != MPI_SUCCESS))
+        DONE_ERROR("Failure freeing MPI comm");
+
+    return ret_value;
+}
@@ -0,0 +1,412 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Event tracing.  Every traced call is stored in a ring buffer owned by the
+ * calling thread.  Each ring has a single producer (its thread) and a single
+ * consumer (the flush thread), so recording an event needs no locks and no
+ * allocation once the thread's ring exists; if the ring is full the event is
+ * dropped and counted.  The flush thread periodically drains all rings to
+ * the per-rank file "<H5TUNER_TRACE>.<rank>.trace".  Names are written to
+ * the file as string records the first time an event refers to them.
+ */
+
+#include "autotuner_private.h"
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* Number of records per thread ring, must be a power of two */
+#define TRACE_RING_SIZE 16384
+
+/* Interval between flushes of the rings to the trace file */
+#define TRACE_FLUSH_INTERVAL_NS 100000000L
+
+typedef struct trace_ring_t {
+    trace_record_t records[TRACE_RING_SIZE];
+    uint64_t head;              /* Next record to write, producer owned */
+    uint64_t tail;              /* Next record to flush, consumer owned */
+    uint64_t dropped;
+    uint64_t tid;
+    struct trace_ring_t *next;
+} trace_ring_t;
+
+/* Global to indicate tracing is enabled */
+int trace_enabled_g = 0;
+
+static const char *trace_prefix_g = NULL;
+static int trace_rank_g = -1;
+static int trace_finalized_g = 0;
+
+/* List of all thread rings, pushed to without locks */
+static trace_ring_t *trace_rings_g = NULL;
+static __thread trace_ring_t *trace_ring_g = NULL;
+
+/* Interned names.  Datasets intern their names the first time they are
+ * traced, and file-level HDF5 calls once per call, never per MPI-IO call,
+ * so interning may lock. */
+static pthread_mutex_t trace_names_mutex_g = PTHREAD_MUTEX_INITIALIZER;
+static char **trace_names_g = NULL;
+static uint32_t ntrace_names_g = 0;
+static uint32_t trace_names_alloc_g = 0;
+static uint32_t ntrace_names_written_g = 0;
+
+/* Flush thread, woken early to stop */
+static pthread_t trace_thread_g;
+static int trace_thread_running_g = 0;
+static int trace_stop_g = 0;
+static pthread_mutex_t trace_stop_mutex_g = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trace_stop_cond_g = PTHREAD_COND_INITIALIZER;
+static FILE *trace_fp_g = NULL;
+
+
+static void trace_atexit(void)
+{
+    if(trace_finalize() < 0)
+        DONE_ERROR("Unable to finalize H5Tuner trace");
+
+    return;
+}
+
+
+/* Determine the MPI rank once MPI is initialized.  Only called from
+ * application threads: the flush thread must not call MPI, which may only
+ * allow the main thread to, so it only reads trace_rank_g. */
+static int trace_get_rank(void)
+{
+    int mpi_initialized = 0;
+    int mpi_finalized = 0;
+
+    if(trace_rank_g >= 0)
+        return trace_rank_g;
+
+    MPI_Initialized(&mpi_initialized);
+    if(mpi_initialized) {
+        MPI_Finalized(&mpi_finalized);
+        if(!mpi_finalized) {
+            int rank;
+
+            MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+            __atomic_store_n(&trace_rank_g, rank, __ATOMIC_RELAXED);
+        }
+    }
+
+    return trace_rank_g;
+}
+
+
+static herr_t trace_open_file(void)
+{
+    char *trace_file = NULL;
+    int rank;
+    struct timespec mono, real;
+    trace_header_t header;
+    herr_t ret_value = SUCCEED;
+
+    /* Processes that never initialize MPI are named by process ID */
+    if((rank = __atomic_load_n(&trace_rank_g, __ATOMIC_RELAXED)) < 0)
+        rank = (int)getpid();
+
+    if(NULL == (trace_file = (char *)malloc(strlen(trace_prefix_g) + 32)))
+        ERROR("Unable to allocate trace file name");
+    sprintf(trace_file, "%s.%d.trace", trace_prefix_g, rank);
+
+    if(NULL == (trace_fp_g = fopen(trace_file, "wb")))
+        ERROR("Unable to open trace file");
+
+    /* Timestamps are taken from the monotonic clock, record its offset to
+     * the real time clock so ranks can be aligned */
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.rank = rank;
+    header.clock_offset = ((double)real.tv_sec + (double)real.tv_nsec * 1.0e-9) - ((double)mono.tv_sec + (double)mono.tv_nsec * 1.0e-9);
+
+    if(fwrite(&header, sizeof(header), 1, trace_fp_g) != 1)
+        ERROR("Unable to write trace file header");
+
+done:
+    free(trace_file);
+    trace_file = NULL;
+
+    return ret_value;
+}
+
+
+/* Drain all rings to the trace file.  Only called from one thread at a
+ * time (the flush thread, or the finalizing thread after the flush thread
+ * has stopped). */
+static herr_t trace_flush(void)
+{
+    trace_ring_t *ring;
+    uint32_t nnames;
+    herr_t ret_value = SUCCEED;
+
+    if(!trace_fp_g) {
+        /* Wait for MPI so the file can be named by rank, unless finalizing */
+        if(__atomic_load_n(&trace_rank_g, __ATOMIC_RELAXED) < 0 && !__atomic_load_n(&trace_stop_g, __ATOMIC_ACQUIRE))
+            goto done;
+        if(trace_open_file() < 0)
+            ERROR("Unable to open trace file");
+    }
+
+    /* Write any new names first, so every event refers to a known name */
+    pthread_mutex_lock(&trace_names_mutex_g);
+    nnames = ntrace_names_g;
+    while(ntrace_names_written_g < nnames) {
+        uint32_t tag = TRACE_TAG_NAME;
+        uint32_t len = (uint32_t)strlen(trace_names_g[ntrace_names_written_g]);
+
+        if(fwrite(&tag, sizeof(tag), 1, trace_fp_g) != 1
+                || fwrite(&ntrace_names_written_g, sizeof(uint32_t), 1, trace_fp_g) != 1
+                || fwrite(&len, sizeof(len), 1, trace_fp_g) != 1
+                || fwrite(trace_names_g[ntrace_names_written_g], 1, len, trace_fp_g) != len) {
+            pthread_mutex_unlock(&trace_names_mutex_g);
+            ERROR("Unable to write trace name");
+        }
+        ntrace_names_written_g++;
+    }
+    pthread_mutex_unlock(&trace_names_mutex_g);
+
+    for(ring = __atomic_load_n(&trace_rings_g, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        uint64_t tail = ring->tail;
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        while(tail < head) {
+            uint32_t tag = TRACE_TAG_EVENT;
+            trace_record_t *rec = &ring->records[tail & (TRACE_RING_SIZE - 1)];
+
+            if(fwrite(&tag, sizeof(tag), 1, trace_fp_g) != 1 || fwrite(rec, sizeof(*rec), 1, trace_fp_g) != 1)
+                ERROR("Unable to write trace event");
+            tail++;
+        }
+
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    if(fflush(trace_fp_g) != 0)
+        ERROR("Unable to flush trace file");
+
+done:
+    return ret_value;
+}
+
+
+static void *trace_thread(void *arg)
+{
+    struct timespec wakeup;
+
+    pthread_mutex_lock(&trace_stop_mutex_g);
+    while(!trace_stop_g) {
+        clock_gettime(CLOCK_REALTIME, &wakeup);
+        wakeup.tv_nsec += TRACE_FLUSH_INTERVAL_NS;
+        if(wakeup.tv_nsec >= 1000000000L) {
+            wakeup.tv_sec++;
+            wakeup.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&trace_stop_cond_g, &trace_stop_mutex_g, &wakeup);
+        if(trace_stop_g)
+            break;
+
+        pthread_mutex_unlock(&trace_stop_mutex_g);
+        if(trace_flush() < 0)
+            DONE_ERROR("Unable to flush trace");
+        pthread_mutex_lock(&trace_stop_mutex_g);
+    }
+    pthread_mutex_unlock(&trace_stop_mutex_g);
+
+    return NULL;
+}
+
+
+void set_trace(void)
+{
+    static int trace_set = 0;
+
+    if(trace_set)
+        return;
+    trace_set = 1;
+
+    if(NULL == (trace_prefix_g = getenv("H5TUNER_TRACE")) || !*trace_prefix_g)
+        return;
+
+    (void)trace_get_rank();
+
+    if(pthread_create(&trace_thread_g, NULL, trace_thread, NULL) != 0) {
+        DONE_ERROR("Unable to start trace flush thread");
+        return;
+    }
+    trace_thread_running_g = 1;
+    trace_enabled_g = 1;
+
+    atexit(trace_atexit);
+
+    return;
+}
+
+
+int trace_intern(const char *name)
+{
+    uint32_t i;
+    int ret_value = -1;
+
+    pthread_mutex_lock(&trace_names_mutex_g);
+
+    for(i = 0; i < ntrace_names_g; i++)
+        if(!strcmp(trace_names_g[i], name)) {
+            ret_value = (int)i;
+            goto done;
+        }
+
+    if(ntrace_names_g == trace_names_alloc_g) {
+        uint32_t new_alloc = trace_names_alloc_g ? 2 * trace_names_alloc_g : 64;
+        char **new_names;
+
+        if(NULL == (new_names = (char **)realloc(trace_names_g, new_alloc * sizeof(char *))))
+            goto done;
+        trace_names_g = new_names;
+        trace_names_alloc_g = new_alloc;
+    }
+    if(NULL == (trace_names_g[ntrace_names_g] = strdup(name)))
+        goto done;
+
+    ret_value = (int)ntrace_names_g++;
+
+done:
+    pthread_mutex_unlock(&trace_names_mutex_g);
+
+    return ret_value;
+}
+
+
+void trace_event(trace_op_t op, hid_t dset_id, const char *filename, double start, double end, hssize_t nbytes)
+{
+    int file_name_id = -1;
+    int dset_name_id = -1;
+
+    if(trace_finalized_g)
+        return;
+
+    /* Look up names.  Datasets cache their name IDs after the first time. */
+    if(dset_id >= 0) {
+        dset_stats_t *stats;
+
+        if(stats_get_dset(dset_id, &stats) >= 0) {
+            trace_names_dset(stats);
+            file_name_id = stats->trace_file_id;
+            dset_name_id = stats->trace_dset_id;
+        }
+    }
+    else if(filename)
+        file_name_id = trace_intern(filename);
+
+    trace_event_names(op, file_name_id, dset_name_id, start, end, nbytes);
+
+    return;
+}
+
+
+void trace_names_dset(dset_stats_t *stats)
+{
+    if(stats->trace_file_id < 0)
+        stats->trace_file_id = trace_intern(stats->filename);
+    if(stats->trace_dset_id < 0)
+        stats->trace_dset_id = trace_intern(stats->dset_name);
+
+    return;
+}
+
+
+void trace_event_names(trace_op_t op, int file_name_id, int dset_name_id, double start, double end, hssize_t nbytes)
+{
+    trace_ring_t *ring = trace_ring_g;
+    trace_record_t *rec;
+    uint64_t head;
+
+    if(trace_finalized_g)
+        return;
+
+    /* First event on this thread, create its ring */
+    if(!ring) {
+        if(NULL == (ring = (trace_ring_t *)calloc(1, sizeof(trace_ring_t))))
+            return;
+        ring->tid = (uint64_t)syscall(SYS_gettid);
+        ring->next = __atomic_load_n(&trace_rings_g, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&trace_rings_g, &ring->next, ring, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+        trace_ring_g = ring;
+    }
+
+    head = ring->head;
+    if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE) {
+        ring->dropped++;
+        return;
+    }
+
+    rec = &ring->records[head & (TRACE_RING_SIZE - 1)];
+    rec->start = start;
+    rec->duration = end - start;
+    rec->bytes = nbytes > 0 ? (uint64_t)nbytes : 0;
+    rec->tid = ring->tid;
+    rec->op = (uint32_t)op;
+    rec->rank = trace_get_rank();
+    rec->file_name_id = (int32_t)file_name_id;
+    rec->dset_name_id = (int32_t)dset_name_id;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return;
+}
+
+
+herr_t trace_finalize(void)
+{
+    trace_ring_t *ring;
+    uint64_t dropped = 0;
+    herr_t ret_value = SUCCEED;
+
+    if(!trace_enabled_g || trace_finalized_g)
+        return ret_value;
+
+    /* Make sure the rank is known before MPI goes away */
+    (void)trace_get_rank();
+
+    /* Stop the flush thread, without waiting for its next flush, and drain
+     * what is left */
+    pthread_mutex_lock(&trace_stop_mutex_g);
+    trace_stop_g = 1;
+    pthread_cond_signal(&trace_stop_cond_g);
+    pthread_mutex_unlock(&trace_stop_mutex_g);
+    if(trace_thread_running_g) {
+        pthread_join(trace_thread_g, NULL);
+        trace_thread_running_g = 0;
+    }
+    if(trace_flush() < 0)
+        ERROR("Unable to flush trace");
+
+    for(ring = trace_rings_g; ring; ring = ring->next)
+        dropped += ring->dropped;
+    if(dropped && verbose_g)
+        printf("H5Tuner trace dropped %llu events, rings were full\n", (unsigned long long)dropped);
+
+done:
+    trace_finalized_g = 1;
+
+    if(trace_fp_g && (fclose(trace_fp_g) != 0))
+        DONE_ERROR("Failure closing trace file");
+    trace_fp_g = NULL;
+
+    return ret_value;
+}
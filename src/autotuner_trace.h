@@ -0,0 +1,92 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Layout of the per-rank binary trace files written by the H5Tuner library
+ * (H5TUNER_TRACE) and read by h5tuner-trace2json.  A file is a
+ * trace_header_t followed by tagged records: TRACE_TAG_NAME is followed by
+ * a uint32_t name ID, a uint32_t length and the name bytes, TRACE_TAG_EVENT
+ * is followed by a trace_record_t.  Files are in the byte order of the
+ * writing process.
+ */
+
+#ifndef _autotuner_trace_H
+#define _autotuner_trace_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "H5TTRACE"
+#define TRACE_VERSION 1
+
+#define TRACE_TAG_NAME 1
+#define TRACE_TAG_EVENT 2
+
+/* Traced operations */
+typedef enum trace_op_t {
+    TRACE_H5FCREATE = 0,
+    TRACE_H5FOPEN,
+    TRACE_H5DCREATE,
+    TRACE_H5DWRITE,
+    TRACE_H5DREAD,
+    TRACE_H5DCLOSE,
+    TRACE_H5FCLOSE,
+    TRACE_MPI_FILE_OPEN,        /* MPI-IO calls made by HDF5 (H5TUNER_MPIIO) */
+    TRACE_MPI_FILE_CLOSE,
+    TRACE_MPI_FILE_SET_VIEW,
+    TRACE_MPI_FILE_SYNC,
+    TRACE_MPI_FILE_WRITE_AT,
+    TRACE_MPI_FILE_WRITE_AT_ALL,
+    TRACE_MPI_FILE_READ_AT,
+    TRACE_MPI_FILE_READ_AT_ALL,
+    TRACE_NOPS
+} trace_op_t;
+
+/* Operations before TRACE_MPI_FILE_OPEN are HDF5 calls */
+#define TRACE_NHDF5_OPS TRACE_MPI_FILE_OPEN
+
+/* Names of the traced operations, in trace_op_t order */
+#define TRACE_OP_NAMES { \
+    "H5Fcreate", \
+    "H5Fopen", \
+    "H5Dcreate", \
+    "H5Dwrite", \
+    "H5Dread", \
+    "H5Dclose", \
+    "H5Fclose", \
+    "MPI_File_open", \
+    "MPI_File_close", \
+    "MPI_File_set_view", \
+    "MPI_File_sync", \
+    "MPI_File_write_at", \
+    "MPI_File_write_at_all", \
+    "MPI_File_read_at", \
+    "MPI_File_read_at_all" \
+}
+
+typedef struct trace_header_t {
+    char magic[8];
+    uint32_t version;
+    int32_t rank;
+    double clock_offset;        /* Add to timestamps to get real time */
+} trace_header_t;
+
+typedef struct trace_record_t {
+    double start;               /* Seconds, monotonic clock */
+    double duration;            /* Seconds */
+    uint64_t bytes;
+    uint64_t tid;
+    uint32_t op;                /* trace_op_t */
+    int32_t rank;               /* -1 if MPI was not initialized yet */
+    int32_t file_name_id;       /* -1 if none */
+    int32_t dset_name_id;       /* -1 if none */
+} trace_record_t;
+
+#endif /* _autotuner_trace_H */
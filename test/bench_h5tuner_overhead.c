@@ -0,0 +1,109 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * Benchmark of the calls in which H5Tuner applies parameters: repeatedly
+ * creates a file with a number of datasets and reopens it, and prints the
+ * mean time per H5Fcreate, H5Fopen and H5Dcreate call.  Run it with and
+ * without libautotuner.so preloaded (see bench_h5tuner_overhead.sh) to
+ * measure the H5Tuner overhead.
+ *
+ * Usage: bench_h5tuner_overhead [iterations [datasets]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hdf5.h"
+
+#define FILENAME "bench_h5tuner_overhead.h5"
+#define DIM0 64
+#define DIM1 64
+
+static double
+wtime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+int
+main(int argc, char **argv)
+{
+    int niters = argc > 1 ? atoi(argv[1]) : 100;
+    int ndsets = argc > 2 ? atoi(argv[2]) : 10;
+    double fcreate_time = 0.0;
+    double fopen_time = 0.0;
+    double dcreate_time = 0.0;
+    hsize_t dims[2] = {DIM0, DIM1};
+    hid_t space_id;
+    int i, d;
+
+    if(niters <= 0 || ndsets <= 0) {
+        fprintf(stderr, "Usage: %s [iterations [datasets]]\n", argv[0]);
+        return 1;
+    }
+
+    if((space_id = H5Screate_simple(2, dims, NULL)) < 0) {
+        fprintf(stderr, "Unable to create dataspace\n");
+        return 1;
+    }
+
+    for(i = 0; i < niters; i++) {
+        hid_t file_id;
+        double t;
+
+        t = wtime();
+        file_id = H5Fcreate(FILENAME, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        fcreate_time += wtime() - t;
+        if(file_id < 0) {
+            fprintf(stderr, "Unable to create file\n");
+            return 1;
+        }
+
+        for(d = 0; d < ndsets; d++) {
+            char name[32];
+            hid_t dset_id;
+
+            sprintf(name, "Data%d", d);
+            t = wtime();
+            dset_id = H5Dcreate2(file_id, name, H5T_NATIVE_INT, space_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+            dcreate_time += wtime() - t;
+            if(dset_id < 0) {
+                fprintf(stderr, "Unable to create dataset\n");
+                return 1;
+            }
+            H5Dclose(dset_id);
+        }
+        H5Fclose(file_id);
+
+        t = wtime();
+        file_id = H5Fopen(FILENAME, H5F_ACC_RDONLY, H5P_DEFAULT);
+        fopen_time += wtime() - t;
+        if(file_id < 0) {
+            fprintf(stderr, "Unable to open file\n");
+            return 1;
+        }
+        H5Fclose(file_id);
+    }
+
+    H5Sclose(space_id);
+    remove(FILENAME);
+
+    /* Mean time per call, in microseconds */
+    printf("bench H5Fcreate %.3f\n", fcreate_time * 1.0e6 / niters);
+    printf("bench H5Fopen %.3f\n", fopen_time * 1.0e6 / niters);
+    printf("bench H5Dcreate %.3f\n", dcreate_time * 1.0e6 / ((double)niters * ndsets));
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Copyright by The HDF Group.
+# All rights reserved.
+#
+# Regression benchmark of the H5Tuner overhead.  Runs bench_h5tuner_overhead
+# without and with libautotuner.so preloaded (with the self profile
+# enabled), and fails if H5Tuner adds more than H5TUNER_BENCH_MAX_US
+# microseconds (default 2000) to the mean time of any intercepted call.
+#
+# Usage: bench_h5tuner_overhead.sh [iterations [datasets]]
+
+BENCH=./bench_h5tuner_overhead
+LIB=${H5TUNER_LIB:-../src/libautotuner.so}
+MAX_US=${H5TUNER_BENCH_MAX_US:-2000}
+BASE_OUT=bench_h5tuner_overhead.base
+TUNED_OUT=bench_h5tuner_overhead.tuned
+
+if test ! -f "$LIB"; then
+    echo "$LIB not found, set H5TUNER_LIB"
+    exit 1
+fi
+
+$BENCH "$@" > $BASE_OUT || exit 1
+H5TUNER_SELF_PROFILE=1 LD_PRELOAD=$LIB $BENCH "$@" > $TUNED_OUT || exit 1
+
+# Self profile from the tuned run
+grep -v '^bench ' $TUNED_OUT
+
+awk -v max_us=$MAX_US '
+    FNR == NR && $1 == "bench" { base[$2] = $3; next }
+    $1 == "bench" {
+        added = $3 - base[$2]
+        printf("%-10s base %10.3f us  tuned %10.3f us  added %10.3f us\n", $2, base[$2], $3, added)
+        if(added > max_us)
+            failed = 1
+    }
+    END {
+        if(failed) {
+            printf("FAILED: H5Tuner adds more than %s us per call\n", max_us)
+            exit 1
+        }
+        print "PASSED"
+    }' $BASE_OUT $TUNED_OUT
+status=$?
+
+rm -f $BASE_OUT $TUNED_OUT
+exit $status
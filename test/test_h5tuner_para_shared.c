@@ -85,6 +85,13 @@ int nerrors = 0;                                /* errors count */
 #define PATH_MAX    512
 #endif  /* !PATH_MAX */
 char    testfiles[3][PATH_MAX];
+char    idlefile[PATH_MAX];             /* rank 0 only I/O test file */
+char    idlestats[PATH_MAX];            /* its H5TUNER_STATS_FILE */
+char    idlecost[PATH_MAX];             /* its H5TUNER_COST_FILE */
+char    deferfile[PATH_MAX];            /* deferred creation test file */
+char    deferfile2[PATH_MAX];           /* file created meanwhile */
+char    collfile[PATH_MAX];             /* collective promotion test file */
+char    collfile2[PATH_MAX];            /* file without a transfer rule */
 
 
 int mpi_size, mpi_rank;                         /* mpi variables */
@@ -105,6 +112,14 @@ void phdf5readInd(char *filename);
 void phdf5writeAll(char *filename);
 void phdf5readAll(char *filename);
 void test_split_comm_access(char filenames[][PATH_MAX]);
+void test_idle_ranks(char *filename);
+void test_idle_ranks_vrfy(void);
+int params_record_has(hid_t fid, const char *text);
+void test_deferred_chunk(char *filename, char *filename2);
+void append_rows(hid_t dataset, int nsteps, int skip_step, int skip_rank);
+int check_rows(hid_t fid, const char *name, int nsteps, int skip_step, int skip_rank);
+void test_collective_promotion(char *filename);
+void test_collective_barrier(char *filename);
 int parse_options(int argc, char **argv);
 void usage(void);
 int mkfilenames(char *prefix);
@@ -1696,6 +1711,546 @@ test_split_comm_access(char filenames[][PATH_MAX])
 }
 
 
+/*
+ * Only process 0 does HDF5 I/O, on a file of its own opened with
+ * MPI_COMM_SELF, while the other processes make no HDF5 call at all.
+ * H5Tuner reduces its statistics, I/O cost, self profile and MPI-IO
+ * summary over MPI_COMM_WORLD in MPI_Finalize, and every process must
+ * take part in that even if it never entered an HDF5 wrapper; otherwise
+ * the test hangs in MPI_Finalize.  main() enables these features, and
+ * test_idle_ranks_vrfy() checks their output after MPI_Finalize.
+ */
+void
+test_idle_ranks(char *filename)
+{
+    hid_t fid1;                 /* HDF5 file IDs */
+    hid_t acc_tpl1;             /* File access templates */
+    hid_t sid1;                 /* Dataspace ID */
+    hid_t dataset1;             /* Dataset ID */
+    hsize_t dims1[SPACE1_RANK] =
+        {SPACE1_DIM1,SPACE1_DIM2}; /* dataspace dim sizes */
+    DATATYPE data_array1[SPACE1_DIM1][SPACE1_DIM2]; /* data buffer */
+    hsize_t start[SPACE1_RANK] = {0, 0};
+    hsize_t stride[SPACE1_RANK] = {1, 1};
+    herr_t ret;                 /* Generic return value */
+
+    if (verbose)
+        printf("Single process write test on file %s\n", filename);
+
+    if (mpi_rank != 0)
+        return;
+
+    acc_tpl1 = H5Pcreate (H5P_FILE_ACCESS);
+    assert(acc_tpl1 != FAIL);
+    ret = H5Pset_fapl_mpio(acc_tpl1, MPI_COMM_SELF, MPI_INFO_NULL);
+    assert(ret != FAIL);
+    fid1 = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, acc_tpl1);
+    assert(fid1 != FAIL);
+    ret = H5Pclose(acc_tpl1);
+    assert(ret != FAIL);
+
+    sid1 = H5Screate_simple(SPACE1_RANK, dims1, NULL);
+    assert(sid1 != FAIL);
+    dataset1 = H5Dcreate2(fid1, DATASETNAME1, H5T_NATIVE_INT, sid1,
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(dataset1 != FAIL);
+
+    dataset_fill(start, dims1, stride, &data_array1[0][0]);
+    ret = H5Dwrite(dataset1, H5T_NATIVE_INT, H5S_ALL, H5S_ALL,
+        H5P_DEFAULT, data_array1);
+    assert(ret != FAIL);
+    MESG("H5Dwrite succeed");
+
+    ret = H5Dclose(dataset1);
+    assert(ret != FAIL);
+    H5Sclose(sid1);
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+}
+
+
+/*
+ * Check, on process 0 after MPI_Finalize, that the statistics summary
+ * covers the dataset written by test_idle_ranks() and that the cost file
+ * was written.
+ */
+void
+test_idle_ranks_vrfy(void)
+{
+    FILE *fp;
+    char line[1024];
+    int found = 0;
+
+    if (mpi_rank != 0)
+        return;
+
+    if (NULL == (fp = fopen(idlestats, "r"))) {
+        nerrors++;
+        printf("FAILED: No statistics summary %s\n", idlestats);
+    }
+    else {
+        while (fgets(line, sizeof(line), fp))
+            if (!strncmp(line, "dataset ", 8) && strstr(line, "ParaIdle.h5")
+                    && strstr(line, "ranks 1"))
+                found = 1;
+        fclose(fp);
+        if (!found) {
+            nerrors++;
+            printf("FAILED: Statistics summary misses %s\n", idlefile);
+        }
+    }
+
+    if (NULL == (fp = fopen(idlecost, "r"))) {
+        nerrors++;
+        printf("FAILED: No cost file %s\n", idlecost);
+    }
+    else
+        fclose(fp);
+
+    if (docleanup) {
+        remove(idlestats);
+        remove(idlecost);
+    }
+}
+
+
+/*
+ * The "auto" chunk rule of ParaDefer.h5 defers the creation of its
+ * datasets to their first access.  Process 0 writes nothing to Data1 (if
+ * there are other processes) and the others write their slab of rows, so
+ * all processes must create it with chunks of the largest slab.  Data2 is
+ * never written and is created at H5Dclose, with the whole extent as the
+ * chunk shape.  The chosen chunk shape must also be what H5Tuner records
+ * in the file, and not the shape of the global chunk rule.  filename2 is
+ * created while the datasets are deferred, and its record must not get
+ * their parameters.
+ */
+void
+test_deferred_chunk(char *filename, char *filename2)
+{
+    hid_t fid1;                 /* HDF5 file IDs */
+    hid_t acc_tpl1;             /* File access templates */
+    hid_t sid1;                 /* Dataspace ID */
+    hid_t file_dataspace;       /* File dataspace ID */
+    hid_t mem_dataspace;        /* memory dataspace ID */
+    hid_t dataset1, dataset2;   /* Dataset IDs */
+    hid_t dcpl;                 /* Dataset creation property list */
+    hid_t fid2;                 /* File created meanwhile */
+    hsize_t dims1[SPACE1_RANK] =
+        {SPACE1_DIM1,SPACE1_DIM2}; /* dataspace dim sizes */
+    hsize_t chunk[SPACE1_RANK]; /* chunk dimensions */
+    hsize_t expected[SPACE1_RANK]; /* expected chunk dimensions of Data1 */
+    DATATYPE data_array1[SPACE1_DIM1][SPACE1_DIM2]; /* data buffer */
+    DATATYPE data_origin1[SPACE1_DIM1][SPACE1_DIM2]; /* expected values */
+    hsize_t start[SPACE1_RANK];
+    hsize_t count[SPACE1_RANK], stride[SPACE1_RANK];
+    char rule[128];             /* expected record of the chunk shape */
+    int writer = (mpi_size == 1 || mpi_rank != 0);
+    herr_t ret;                 /* Generic return value */
+
+    if (verbose)
+        printf("Deferred dataset creation test on file %s\n", filename);
+
+    acc_tpl1 = H5Pcreate (H5P_FILE_ACCESS);
+    assert(acc_tpl1 != FAIL);
+    ret = H5Pset_fapl_mpio(acc_tpl1, MPI_COMM_WORLD, MPI_INFO_NULL);
+    assert(ret != FAIL);
+    fid1 = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, acc_tpl1);
+    assert(fid1 != FAIL);
+
+    sid1 = H5Screate_simple(SPACE1_RANK, dims1, NULL);
+    assert(sid1 != FAIL);
+    dataset1 = H5Dcreate2(fid1, DATASETNAME1, H5T_NATIVE_INT, sid1,
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(dataset1 != FAIL);
+    dataset2 = H5Dcreate2(fid1, DATASETNAME2, H5T_NATIVE_INT, sid1,
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(dataset2 != FAIL);
+
+    fid2 = H5Fcreate(filename2, H5F_ACC_TRUNC, H5P_DEFAULT, acc_tpl1);
+    assert(fid2 != FAIL);
+    ret = H5Fclose(fid2);
+    assert(ret != FAIL);
+
+    /* The first write creates Data1, on every process */
+    slab_set(start, count, stride, BYROW);
+    file_dataspace = H5Dget_space(dataset1);
+    assert(file_dataspace != FAIL);
+    mem_dataspace = H5Screate_simple(SPACE1_RANK, count, NULL);
+    assert(mem_dataspace != FAIL);
+    if (writer) {
+        ret = H5Sselect_hyperslab(file_dataspace, H5S_SELECT_SET, start, stride,
+            count, NULL);
+        assert(ret != FAIL);
+    }
+    else {
+        ret = H5Sselect_none(file_dataspace);
+        assert(ret != FAIL);
+        ret = H5Sselect_none(mem_dataspace);
+        assert(ret != FAIL);
+    }
+    dataset_fill(start, count, stride, &data_origin1[0][0]);
+    ret = H5Dwrite(dataset1, H5T_NATIVE_INT, mem_dataspace, file_dataspace,
+        H5P_DEFAULT, data_origin1);
+    assert(ret != FAIL);
+    MESG("H5Dwrite succeed");
+
+    H5Sclose(file_dataspace);
+    H5Sclose(mem_dataspace);
+    ret = H5Dclose(dataset1);
+    assert(ret != FAIL);
+    ret = H5Dclose(dataset2);
+    assert(ret != FAIL);
+    H5Sclose(sid1);
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+
+    /* Check the chunk shapes and the data */
+    fid1 = H5Fopen(filename, H5F_ACC_RDONLY, acc_tpl1);
+    assert(fid1 != FAIL);
+    ret = H5Pclose(acc_tpl1);
+    assert(ret != FAIL);
+
+    expected[0] = SPACE1_DIM1 / mpi_size;
+    expected[1] = SPACE1_DIM2;
+    dataset1 = H5Dopen2(fid1, DATASETNAME1, H5P_DEFAULT);
+    assert(dataset1 != FAIL);
+    dcpl = H5Dget_create_plist(dataset1);
+    assert(dcpl != FAIL);
+    if (H5Pget_chunk(dcpl, SPACE1_RANK, chunk) != SPACE1_RANK
+            || chunk[0] != expected[0] || chunk[1] != expected[1]) {
+        nerrors++;
+        printf("FAILED: Deferred %s of %s not chunked by {%llu, %llu}\n",
+            DATASETNAME1, filename, (unsigned long long)expected[0],
+            (unsigned long long)expected[1]);
+    }
+    H5Pclose(dcpl);
+
+    if (writer) {
+        file_dataspace = H5Dget_space(dataset1);
+        assert(file_dataspace != FAIL);
+        ret = H5Sselect_hyperslab(file_dataspace, H5S_SELECT_SET, start, stride,
+            count, NULL);
+        assert(ret != FAIL);
+        mem_dataspace = H5Screate_simple(SPACE1_RANK, count, NULL);
+        assert(mem_dataspace != FAIL);
+        ret = H5Dread(dataset1, H5T_NATIVE_INT, mem_dataspace, file_dataspace,
+            H5P_DEFAULT, data_array1);
+        assert(ret != FAIL);
+        ret = dataset_vrfy(start, count, stride, &data_array1[0][0],
+            &data_origin1[0][0]);
+        if (ret) nerrors++;
+        H5Sclose(file_dataspace);
+        H5Sclose(mem_dataspace);
+    }
+    ret = H5Dclose(dataset1);
+    assert(ret != FAIL);
+
+    dataset2 = H5Dopen2(fid1, DATASETNAME2, H5P_DEFAULT);
+    assert(dataset2 != FAIL);
+    dcpl = H5Dget_create_plist(dataset2);
+    assert(dcpl != FAIL);
+    if (H5Pget_chunk(dcpl, SPACE1_RANK, chunk) != SPACE1_RANK
+            || chunk[0] != dims1[0] || chunk[1] != dims1[1]) {
+        nerrors++;
+        printf("FAILED: Deferred %s of %s not chunked by its extent\n",
+            DATASETNAME2, filename);
+    }
+    H5Pclose(dcpl);
+    ret = H5Dclose(dataset2);
+    assert(ret != FAIL);
+
+    /* The record of the applied parameters has the chosen shape */
+    sprintf(rule, "VariableName=\"%s\">%llu,%llu</chunk>", DATASETNAME1,
+        (unsigned long long)expected[0], (unsigned long long)expected[1]);
+    if (params_record_has(fid1, rule) != 1) {
+        nerrors++;
+        printf("FAILED: Parameter record of %s misses %s\n", filename, rule);
+    }
+
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+
+    fid2 = H5Fopen(filename2, H5F_ACC_RDONLY, H5P_DEFAULT);
+    assert(fid2 != FAIL);
+    if (params_record_has(fid2, "VariableName") == 1) {
+        nerrors++;
+        printf("FAILED: Parameter record of %s has dataset parameters of %s\n",
+            filename2, filename);
+    }
+    ret = H5Fclose(fid2);
+    assert(ret != FAIL);
+}
+
+
+/*
+ * Extend the dataset by one row per process nsteps times, each process
+ * writing its row independently, except process skip_rank in step
+ * skip_step (-1 for all steps).  Row i is filled with i*100 + column.
+ */
+void
+append_rows(hid_t dataset, int nsteps, int skip_step, int skip_rank)
+{
+    hid_t file_dataspace;       /* File dataspace ID */
+    hid_t mem_dataspace;        /* memory dataspace ID */
+    hsize_t dims[SPACE1_RANK] = {0, SPACE1_DIM2};
+    hsize_t start[SPACE1_RANK] = {0, 0};
+    hsize_t count[SPACE1_RANK] = {1, SPACE1_DIM2};
+    DATATYPE row[SPACE1_DIM2];
+    int step, j;
+    herr_t ret;                 /* Generic return value */
+
+    mem_dataspace = H5Screate_simple(SPACE1_RANK, count, NULL);
+    assert(mem_dataspace != FAIL);
+
+    for (step = 0; step < nsteps; step++) {
+        dims[0] = (hsize_t)(step + 1) * mpi_size;
+        ret = H5Dset_extent(dataset, dims);
+        assert(ret != FAIL);
+        if (mpi_rank == skip_rank && (skip_step < 0 || step == skip_step))
+            continue;
+
+        start[0] = (hsize_t)step * mpi_size + mpi_rank;
+        for (j = 0; j < SPACE1_DIM2; j++)
+            row[j] = (DATATYPE)(start[0] * 100 + j);
+        file_dataspace = H5Dget_space(dataset);
+        assert(file_dataspace != FAIL);
+        ret = H5Sselect_hyperslab(file_dataspace, H5S_SELECT_SET, start, NULL,
+            count, NULL);
+        assert(ret != FAIL);
+        ret = H5Dwrite(dataset, H5T_NATIVE_INT, mem_dataspace, file_dataspace,
+            H5P_DEFAULT, row);
+        assert(ret != FAIL);
+        H5Sclose(file_dataspace);
+    }
+
+    H5Sclose(mem_dataspace);
+}
+
+
+/*
+ * Count the wrong values in a dataset written by append_rows() with
+ * nsteps, skipping the row of process skip_rank in step skip_step (-1 for
+ * all steps, skip_rank -1 for none).  Unwritten rows are filled with zeros.
+ */
+int
+check_rows(hid_t fid, const char *name, int nsteps, int skip_step, int skip_rank)
+{
+    hid_t dataset;              /* Dataset ID */
+    DATATYPE *data_array1;      /* data buffer */
+    hsize_t i, j;
+    int nerr = 0;
+    herr_t ret;                 /* Generic return value */
+
+    data_array1 = (DATATYPE *)malloc((size_t)nsteps * mpi_size * SPACE1_DIM2 * sizeof(DATATYPE));
+    assert(data_array1 != NULL);
+    dataset = H5Dopen2(fid, name, H5P_DEFAULT);
+    assert(dataset != FAIL);
+    ret = H5Dread(dataset, H5T_NATIVE_INT, H5S_ALL, H5S_ALL,
+        H5P_DEFAULT, data_array1);
+    assert(ret != FAIL);
+    ret = H5Dclose(dataset);
+    assert(ret != FAIL);
+
+    for (i = 0; i < (hsize_t)nsteps * mpi_size; i++) {
+        int skipped = (int)(i % mpi_size) == skip_rank
+            && (skip_step < 0 || (int)(i / mpi_size) == skip_step);
+
+        for (j = 0; j < SPACE1_DIM2; j++)
+            if (data_array1[i * SPACE1_DIM2 + j] != (skipped ? 0 : (DATATYPE)(i * 100 + j)))
+                nerr++;
+    }
+    free(data_array1);
+
+    return nerr;
+}
+
+
+/*
+ * The transfer rule of ParaColl.h5 lets H5Tuner promote the independent
+ * writes of its datasets to collective ones once the processes write in
+ * lockstep.  All processes append rows to Data1, which gets promoted.  In
+ * Data2 the last process skips one step after the promotion, so it must
+ * complete the collective writes of the others with empty ones and the
+ * dataset goes back to independent writes.  The last process never writes
+ * to Data3.  None of this may hang, and every written row must be in the
+ * file.
+ */
+void
+test_collective_promotion(char *filename)
+{
+    hid_t fid1;                 /* HDF5 file IDs */
+    hid_t acc_tpl1;             /* File access templates */
+    hid_t sid1;                 /* Dataspace ID */
+    hid_t dcpl;                 /* Dataset creation property list */
+    hid_t dataset;              /* Dataset ID */
+    hsize_t dims1[SPACE1_RANK] = {0, SPACE1_DIM2}; /* dataspace dim sizes */
+    hsize_t maxdims1[SPACE1_RANK] = {H5S_UNLIMITED, SPACE1_DIM2};
+    hsize_t chunk[SPACE1_RANK] = {1, SPACE1_DIM2};
+    const char *names[3] = {DATASETNAME1, DATASETNAME2, DATASETNAME3};
+    int nsteps = 6;
+    int last = mpi_size - 1;
+    int d, nerr;
+    herr_t ret;                 /* Generic return value */
+
+    if (verbose)
+        printf("Collective promotion test on file %s\n", filename);
+
+    acc_tpl1 = H5Pcreate (H5P_FILE_ACCESS);
+    assert(acc_tpl1 != FAIL);
+    ret = H5Pset_fapl_mpio(acc_tpl1, MPI_COMM_WORLD, MPI_INFO_NULL);
+    assert(ret != FAIL);
+    fid1 = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, acc_tpl1);
+    assert(fid1 != FAIL);
+
+    sid1 = H5Screate_simple(SPACE1_RANK, dims1, maxdims1);
+    assert(sid1 != FAIL);
+    dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    assert(dcpl != FAIL);
+    ret = H5Pset_chunk(dcpl, SPACE1_RANK, chunk);
+    assert(ret != FAIL);
+
+    for (d = 0; d < 3; d++) {
+        dataset = H5Dcreate2(fid1, names[d], H5T_NATIVE_INT, sid1,
+            H5P_DEFAULT, dcpl, H5P_DEFAULT);
+        assert(dataset != FAIL);
+        if (d == 0)
+            append_rows(dataset, nsteps, -1, -1);
+        else if (d == 1)
+            append_rows(dataset, nsteps, 3, mpi_size > 1 ? last : -1);
+        else
+            append_rows(dataset, nsteps, -1, mpi_size > 1 ? last : -1);
+        ret = H5Dclose(dataset);
+        assert(ret != FAIL);
+    }
+
+    H5Pclose(dcpl);
+    H5Sclose(sid1);
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+
+    /* Check the rows, unwritten ones are filled with zeros */
+    fid1 = H5Fopen(filename, H5F_ACC_RDONLY, acc_tpl1);
+    assert(fid1 != FAIL);
+    ret = H5Pclose(acc_tpl1);
+    assert(ret != FAIL);
+
+    for (d = 0; d < 3; d++) {
+        if (d == 0)
+            nerr = check_rows(fid1, names[d], nsteps, -1, -1);
+        else
+            nerr = check_rows(fid1, names[d], nsteps, d == 1 ? 3 : -1, mpi_size > 1 ? last : -1);
+        if (nerr) {
+            nerrors++;
+            printf("FAILED: %d wrong values in %s of %s\n", nerr, names[d], filename);
+        }
+    }
+
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+}
+
+
+/*
+ * ParaColl2.h5 has no transfer rule, so its writes must stay independent
+ * even though the processes write in lockstep.  In the last step the last
+ * process skips its write, and all processes call MPI_Barrier before
+ * H5Dclose.  Had the writes been promoted, the others would wait in a
+ * collective write while the last process waits in the barrier.
+ */
+void
+test_collective_barrier(char *filename)
+{
+    hid_t fid1;                 /* HDF5 file IDs */
+    hid_t acc_tpl1;             /* File access templates */
+    hid_t sid1;                 /* Dataspace ID */
+    hid_t dcpl;                 /* Dataset creation property list */
+    hid_t dataset;              /* Dataset ID */
+    hsize_t dims1[SPACE1_RANK] = {0, SPACE1_DIM2}; /* dataspace dim sizes */
+    hsize_t maxdims1[SPACE1_RANK] = {H5S_UNLIMITED, SPACE1_DIM2};
+    hsize_t chunk[SPACE1_RANK] = {1, SPACE1_DIM2};
+    int nsteps = 6;
+    int last = mpi_size > 1 ? mpi_size - 1 : -1;
+    int nerr;
+    herr_t ret;                 /* Generic return value */
+
+    if (verbose)
+        printf("Collective barrier test on file %s\n", filename);
+
+    acc_tpl1 = H5Pcreate (H5P_FILE_ACCESS);
+    assert(acc_tpl1 != FAIL);
+    ret = H5Pset_fapl_mpio(acc_tpl1, MPI_COMM_WORLD, MPI_INFO_NULL);
+    assert(ret != FAIL);
+    fid1 = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, acc_tpl1);
+    assert(fid1 != FAIL);
+
+    sid1 = H5Screate_simple(SPACE1_RANK, dims1, maxdims1);
+    assert(sid1 != FAIL);
+    dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    assert(dcpl != FAIL);
+    ret = H5Pset_chunk(dcpl, SPACE1_RANK, chunk);
+    assert(ret != FAIL);
+
+    dataset = H5Dcreate2(fid1, DATASETNAME1, H5T_NATIVE_INT, sid1,
+        H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    assert(dataset != FAIL);
+    append_rows(dataset, nsteps, nsteps - 1, last);
+    MPI_Barrier(MPI_COMM_WORLD);
+    ret = H5Dclose(dataset);
+    assert(ret != FAIL);
+
+    H5Pclose(dcpl);
+    H5Sclose(sid1);
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+
+    fid1 = H5Fopen(filename, H5F_ACC_RDONLY, acc_tpl1);
+    assert(fid1 != FAIL);
+    ret = H5Pclose(acc_tpl1);
+    assert(ret != FAIL);
+
+    if ((nerr = check_rows(fid1, DATASETNAME1, nsteps, nsteps - 1, last)) != 0) {
+        nerrors++;
+        printf("FAILED: %d wrong values in %s of %s\n", nerr, DATASETNAME1, filename);
+    }
+
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+}
+
+
+/*
+ * Check if the H5Tuner parameter record of a file contains text.
+ * Returns -1 if the file has no record.
+ */
+int
+params_record_has(hid_t fid, const char *text)
+{
+    hid_t attr, atype;          /* Parameter record attribute and type */
+    char *params;               /* parameter record */
+    int found;
+    herr_t ret;                 /* Generic return value */
+
+    if (H5Aexists(fid, "H5Tuner_parameters") <= 0)
+        return(-1);
+
+    attr = H5Aopen(fid, "H5Tuner_parameters", H5P_DEFAULT);
+    assert(attr != FAIL);
+    atype = H5Aget_type(attr);
+    assert(atype != FAIL);
+    params = (char *)calloc(H5Tget_size(atype) + 1, 1);
+    assert(params != NULL);
+    ret = H5Aread(attr, atype, params);
+    assert(ret != FAIL);
+    found = (strstr(params, text) != NULL);
+    free(params);
+    H5Tclose(atype);
+    H5Aclose(attr);
+
+    return(found);
+}
+
+
 /*
  * Show command usage
  */
@@ -1727,10 +2282,11 @@ mkfilenames(char *prefix)
     int i, n;
     size_t strsize;
 
-    /* filename will be prefix/ParaEgN.h5 where N is 0 to 9. */
-    /* So, string must be big enough to hold the prefix, / and 10 more chars */
+    /* filename will be prefix/ParaEgN.h5 where N is 0 to 9, the longest */
+    /* other file is prefix/ParaIdle.stats. */
+    /* So, string must be big enough to hold the prefix, / and 14 more chars */
     /* and the terminating null. */
-    strsize = strlen(prefix) + 12;
+    strsize = strlen(prefix) + 16;
     if (strsize > PATH_MAX){
         printf("File prefix too long;  Use a short path name.\n");
         return(1);
@@ -1743,6 +2299,13 @@ mkfilenames(char *prefix)
     for (i=0; i<n; i++){
         sprintf(testfiles[i], "%s/ParaEg%d.h5", prefix, i);
     }
+    sprintf(idlefile, "%s/ParaIdle.h5", prefix);
+    sprintf(idlestats, "%s/ParaIdle.stats", prefix);
+    sprintf(idlecost, "%s/ParaIdle.cost", prefix);
+    sprintf(deferfile, "%s/ParaDefer.h5", prefix);
+    sprintf(deferfile2, "%s/ParaDefer2.h5", prefix);
+    sprintf(collfile, "%s/ParaColl.h5", prefix);
+    sprintf(collfile2, "%s/ParaColl2.h5", prefix);
     return(0);
 
 }
@@ -1818,6 +2381,11 @@ cleanup(void)
     for (i=0; i<n; i++){
         MPI_File_delete(testfiles[i], MPI_INFO_NULL);
     }
+    MPI_File_delete(idlefile, MPI_INFO_NULL);
+    MPI_File_delete(deferfile, MPI_INFO_NULL);
+    MPI_File_delete(deferfile2, MPI_INFO_NULL);
+    MPI_File_delete(collfile, MPI_INFO_NULL);
+    MPI_File_delete(collfile2, MPI_INFO_NULL);
 }
 
 
@@ -1844,6 +2412,18 @@ main(int argc, char **argv)
     if (parse_options(argc, argv) != 0)
         goto finish;
 
+    /* Enable the H5Tuner features reduced at MPI_Finalize, before the
+     * first HDF5 call, for test_idle_ranks() */
+    setenv("H5TUNER_STATS", "1", 1);
+    setenv("H5TUNER_STATS_FILE", idlestats, 1);
+    setenv("H5TUNER_COST_FILE", idlecost, 1);
+    setenv("H5TUNER_SELF_PROFILE", "1", 1);
+    setenv("H5TUNER_MPIIO", "1", 1);
+    /* For test_deferred_chunk() */
+    setenv("H5TUNER_RECORD_PARAMS", "attribute", 1);
+    /* For test_collective_barrier(), only the transfer rule promotes */
+    unsetenv("H5TUNER_COLLECTIVE");
+
     /* show test file names */
     n = sizeof(testfiles)/sizeof(testfiles[0]);
     if(mpi_rank == 0) {
@@ -1859,6 +2439,13 @@ main(int argc, char **argv)
         MPI_BANNER("testing PHDF5 dataset collective write...");
         for(i = 0; i < n; i++)
             phdf5writeAll(testfiles[i]);
+        MPI_BANNER("testing H5Tuner with HDF5 I/O on process 0 only...");
+        test_idle_ranks(idlefile);
+        MPI_BANNER("testing H5Tuner deferred dataset creation...");
+        test_deferred_chunk(deferfile, deferfile2);
+        MPI_BANNER("testing H5Tuner collective promotion...");
+        test_collective_promotion(collfile);
+        test_collective_barrier(collfile2);
     }
     if(doread) {
         MPI_BANNER("testing PHDF5 dataset collective read...");
@@ -1885,6 +2472,13 @@ finish:
         cleanup();
     MPI_Finalize();
 
+    /* H5Tuner writes these files in MPI_Finalize */
+    if (dowrite && !nerrors) {
+        test_idle_ranks_vrfy();
+        if (mpi_rank == 0 && nerrors)
+            printf("***H5Tuner tests detected %d errors***\n", nerrors);
+    }
+
     return(nerrors);
 }
 
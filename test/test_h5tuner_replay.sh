@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# Copyright by The HDF Group.
+# All rights reserved.
+#
+# Test of the skeleton and h5tuner-replay.  Runs the serial test with
+# H5TUNER_SKELETON, replays the skeleton with the same configuration, and
+# checks with h5dump that the replayed files have the datasets, shapes and
+# layouts of the application's.  Sizes and data types are not compared,
+# the replay writes synthetic data.
+
+TEST=test_h5tuner_ser_shared
+LIB=${H5TUNER_LIB:-../src/libautotuner.so}
+TOOLS=${H5TUNER_TOOLS:-../tools}
+H5DUMP=${H5DUMP:-h5dump}
+DIR=test_h5tuner_replay.d
+nerrors=0
+
+if test ! -f "$LIB"; then
+    echo "$LIB not found, set H5TUNER_LIB"
+    exit 1
+fi
+# The files are written in $DIR
+LIB=`cd \`dirname $LIB\` && pwd`/`basename $LIB`
+TOOLS=`cd $TOOLS && pwd`
+CONFIG=${H5TUNER_CONFIG_FILE:-config.xml}
+CONFIG=`cd \`dirname $CONFIG\` && pwd`/`basename $CONFIG`
+
+# Print the header lines of $1 that describe its datasets' shapes and layouts
+layout() {
+    $H5DUMP -H -p $1 | grep -E '^ *(DATASET|DATASPACE|CHUNKED|CONTIGUOUS|COMPACT)'
+}
+
+rm -rf $DIR
+mkdir -p $DIR/replay
+cd $DIR
+
+H5TUNER_CONFIG_FILE=$CONFIG H5TUNER_SKELETON=app LD_PRELOAD=$LIB $RUNSERIAL ../$TEST -c > app.log 2>&1 || {
+    cat app.log
+    exit 1
+}
+# The serial test does not initialize MPI, so the skeleton is named by its
+# process ID; the replay of one rank reads rank 0's
+set -- app.*.skel
+if test $# -ne 1 || test ! -f "$1"; then
+    echo "FAILED: expected one skeleton, found $*"
+    exit 1
+fi
+mv $1 app.0.skel
+
+H5TUNER_CONFIG_FILE=$CONFIG LD_PRELOAD=$LIB $RUNSERIAL $TOOLS/h5tuner-replay -d replay app || exit 1
+
+if command -v $H5DUMP > /dev/null 2>&1; then
+    for f in *.h5; do
+        if test ! -f replay/$f; then
+            echo "FAILED: $f not replayed"
+            nerrors=`expr $nerrors + 1`
+            continue
+        fi
+        layout $f > app.layout
+        layout replay/$f > replay.layout
+        if cmp -s app.layout replay.layout; then
+            :
+        else
+            echo "FAILED: $f differs from its replay"
+            diff app.layout replay.layout
+            nerrors=`expr $nerrors + 1`
+        fi
+    done
+else
+    echo "$H5DUMP not found, replayed files not compared, set H5DUMP"
+fi
+
+cd ..
+if test $nerrors -ne 0; then
+    echo "FAILED: $nerrors replayed files"
+    exit 1
+fi
+rm -rf $DIR
+echo "h5tuner-replay test passed"
+exit 0
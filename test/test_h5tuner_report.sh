@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# Copyright by The HDF Group.
+# All rights reserved.
+#
+# Test of the statistics summary and h5tuner-report.  Runs the serial test
+# with H5TUNER_STATS=1 and checks the request size histograms of datasets
+# whose writes have known sizes, and what h5tuner-report suggests for them:
+# the datasets of ParaEg0.h5 are written and read in one 2304 byte call,
+# the first two of SerAsync.h5 in 24 calls of one 96 byte row.
+
+TEST=./test_h5tuner_ser_shared
+LIB=${H5TUNER_LIB:-../src/libautotuner.so}
+TOOLS=${H5TUNER_TOOLS:-../tools}
+STATS=test_h5tuner_report.stats
+REPORT=test_h5tuner_report.out
+nerrors=0
+
+if test ! -f "$LIB"; then
+    echo "$LIB not found, set H5TUNER_LIB"
+    exit 1
+fi
+
+# Print the block of the summary or report $1 that starts with $2
+block() {
+    awk -v head="$2" '/^(dataset|file) / { on = ($0 == head || index($0, head " ") == 1) } on' $1
+}
+
+# Check that the block $2 of $1 has a line matching the extended regular
+# expression $3
+expect() {
+    if block $1 "$2" | grep -E -- "$3" > /dev/null; then
+        :
+    else
+        echo "FAILED: \"$2\" in $1 has no line matching $3"
+        nerrors=`expr $nerrors + 1`
+    fi
+}
+
+rm -f $STATS $REPORT
+H5TUNER_STATS=1 H5TUNER_STATS_FILE=$STATS LD_PRELOAD=$LIB $RUNSERIAL $TEST > test_h5tuner_report.log 2>&1 || {
+    cat test_h5tuner_report.log
+    exit 1
+}
+$TOOLS/h5tuner-report $STATS > $REPORT || exit 1
+cat $REPORT
+
+# log2 bins of the summary, bin k = [2^k, 2^(k+1)) bytes
+expect $STATS "dataset ./ParaEg0.h5 /Data1" "^  write_hist 11:1$"
+expect $STATS "dataset ./ParaEg0.h5 /Data1" "^  read_hist 11:1$"
+expect $STATS "dataset ./SerAsync.h5 /Data1" "^  write_hist 6:24$"
+
+expect $REPORT "dataset ./ParaEg0.h5 /Data1" "^    \[2 KiB, 4 KiB\)[[:space:]]+1 #"
+expect $REPORT "dataset ./SerAsync.h5 /Data1" "^    \[64 B, 128 B\)[[:space:]]+24 #"
+expect $REPORT "dataset ./SerAsync.h5 /Data1" "<chunk FileName=\"SerAsync.h5\" VariableName=\"Data1\">1,24</chunk>"
+expect $REPORT "file ./ParaEg0.h5" "dominant request size: \[2 KiB, 4 KiB\)"
+expect $REPORT "file ./ParaEg0.h5" "<striping_unit FileName=\"ParaEg0.h5\">1048576</striping_unit>"
+expect $REPORT "file ./ParaEg0.h5" "<cb_buffer_size FileName=\"ParaEg0.h5\">1048576</cb_buffer_size>"
+
+if test $nerrors -ne 0; then
+    echo "FAILED: $nerrors report checks"
+    exit 1
+fi
+rm -f $STATS $REPORT test_h5tuner_report.log
+echo "h5tuner-report test passed"
+exit 0
@@ -74,6 +74,8 @@ int nerrors = 0;                                /* errors count */
 #define PATH_MAX    512
 #endif  /* !PATH_MAX */
 char    testfiles[3][PATH_MAX];
+char    aggfile[PATH_MAX];              /* write aggregation test file */
+char    asyncfile[PATH_MAX];            /* write-behind test file */
 
 
 /* option flags */
@@ -88,6 +90,9 @@ void dataset_print(hsize_t dims[], DATATYPE * dataset);
 int dataset_vrfy(hsize_t dims[], DATATYPE *dataset, DATATYPE *original);
 void hdf5writeAll(char *filename);
 void hdf5readAll(char *filename);
+void write_rows(hid_t dataset, hsize_t row, hsize_t nrows, int whole, DATATYPE *buf);
+void test_aggregate(char *filename);
+void test_async(char *filename);
 int parse_options(int argc, char **argv);
 void usage(void);
 int mkfilenames();
@@ -788,6 +793,263 @@ hdf5readAll(char *filename)
 }
 
 
+/*
+ * Write nrows rows of the dataset, starting at row.  If whole is set, buf
+ * has the extent of the dataset and H5S_ALL is passed as memory space;
+ * otherwise buf holds the rows.
+ */
+void
+write_rows(hid_t dataset, hsize_t row, hsize_t nrows, int whole, DATATYPE *buf)
+{
+    hid_t file_space;           /* File dataspace ID */
+    hid_t mem_dataspace;        /* Memory dataspace ID */
+    hsize_t start[SPACE1_RANK] = {row, 0};
+    hsize_t count[SPACE1_RANK] = {nrows, SPACE1_DIM2};
+    herr_t ret;                 /* Generic return value */
+
+    file_space = H5Dget_space(dataset);
+    assert(file_space != FAIL);
+    ret = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+    assert(ret != FAIL);
+    if (whole)
+        mem_dataspace = H5S_ALL;
+    else {
+        mem_dataspace = H5Screate_simple(SPACE1_RANK, count, NULL);
+        assert(mem_dataspace != FAIL);
+    }
+
+    ret = H5Dwrite(dataset, H5T_NATIVE_INT, mem_dataspace, file_space, H5P_DEFAULT, buf);
+    assert(ret != FAIL);
+
+    if (mem_dataspace != H5S_ALL)
+        H5Sclose(mem_dataspace);
+    H5Sclose(file_space);
+}
+
+
+/*
+ * The aggregate rule of SerAgg.h5 buffers the small writes of its
+ * datasets.  Rows written one by one are merged, a write of rows that do
+ * not continue them and a read of the dataset must write them first, a
+ * write with H5S_ALL as memory space must take the selected rows of the
+ * buffer, and H5Dclose must write what is left.  Rows 4 to 7 are never
+ * written.
+ */
+void
+test_aggregate(char *filename)
+{
+    hid_t fid1;                 /* HDF5 file IDs */
+    hid_t sid1;                 /* Dataspace ID */
+    hid_t file_space;           /* File dataspace ID */
+    hid_t mem_dataspace;        /* Memory dataspace ID */
+    hid_t dataset1;             /* Dataset ID */
+    hsize_t dims1[SPACE1_RANK] =
+        {SPACE1_DIM1,SPACE1_DIM2}; /* dataspace dim sizes */
+    hsize_t start[SPACE1_RANK] = {0, 0};
+    hsize_t count[SPACE1_RANK] = {4, SPACE1_DIM2};
+    DATATYPE data_array1[SPACE1_DIM1][SPACE1_DIM2]; /* data buffer */
+    DATATYPE data_origin1[SPACE1_DIM1][SPACE1_DIM2]; /* expected values */
+    hsize_t row;
+    herr_t ret;                 /* Generic return value */
+
+    if (verbose)
+        printf("Aggregation test on file %s\n", filename);
+
+    dataset_fill(dims1, &data_origin1[0][0]);
+
+    fid1 = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    assert(fid1 != FAIL);
+    sid1 = H5Screate_simple(SPACE1_RANK, dims1, NULL);
+    assert(sid1 != FAIL);
+    dataset1 = H5Dcreate2(fid1, DATASETNAME1, H5T_NATIVE_INT, sid1,
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(dataset1 != FAIL);
+
+    /* Merged, then written before rows 8 and 9 are buffered */
+    for (row = 0; row < 4; row++)
+        write_rows(dataset1, row, 1, 0, data_origin1[row]);
+    write_rows(dataset1, 8, 2, 0, data_origin1[8]);
+
+    /* Rows 8 and 9 are written before the read */
+    file_space = H5Dget_space(dataset1);
+    assert(file_space != FAIL);
+    start[0] = 0;
+    count[0] = 10;
+    ret = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+    assert(ret != FAIL);
+    mem_dataspace = H5Screate_simple(SPACE1_RANK, count, NULL);
+    assert(mem_dataspace != FAIL);
+    memset(data_array1, 0, sizeof(data_array1));
+    ret = H5Dread(dataset1, H5T_NATIVE_INT, mem_dataspace, file_space,
+        H5P_DEFAULT, data_array1);
+    assert(ret != FAIL);
+    H5Sclose(mem_dataspace);
+    H5Sclose(file_space);
+    for (row = 0; row < 10; row++)
+        if (row >= 4 && row < 8)
+            memset(data_origin1[row], 0, sizeof(data_origin1[row]));
+    if (dataset_vrfy(count, &data_array1[0][0], &data_origin1[0][0])) {
+        nerrors++;
+        printf("FAILED: Buffered rows of %s not written before a read\n", filename);
+    }
+
+    /* Rows 10 and 11 from the full buffer, then merged rows written at
+     * H5Dclose */
+    write_rows(dataset1, 10, 2, 1, &data_origin1[0][0]);
+    for (row = 12; row < SPACE1_DIM1; row++)
+        write_rows(dataset1, row, 1, 0, data_origin1[row]);
+
+    ret = H5Dclose(dataset1);
+    assert(ret != FAIL);
+    H5Sclose(sid1);
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+
+    fid1 = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    assert(fid1 != FAIL);
+    dataset1 = H5Dopen2(fid1, DATASETNAME1, H5P_DEFAULT);
+    assert(dataset1 != FAIL);
+    memset(data_array1, 0, sizeof(data_array1));
+    ret = H5Dread(dataset1, H5T_NATIVE_INT, H5S_ALL, H5S_ALL,
+        H5P_DEFAULT, data_array1);
+    assert(ret != FAIL);
+    if (dataset_vrfy(dims1, &data_array1[0][0], &data_origin1[0][0])) {
+        nerrors++;
+        printf("FAILED: Aggregated writes of %s not read back\n", filename);
+    }
+    ret = H5Dclose(dataset1);
+    assert(ret != FAIL);
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+}
+
+
+/*
+ * main() sets H5TUNER_ASYNC, so H5Dwrite only queues the writes.  The test
+ * is skipped if the HDF5 library is not thread-safe or H5TUNER_MPIIO is
+ * set, since H5Tuner then writes synchronously.  Rows written to Data1 must
+ * be in the file after H5Dclose, and rows written to Data2 must be seen
+ * through another file ID after H5Fflush.  A queued write that fails (no
+ * conversion from integers to strings) must return success from H5Dwrite,
+ * which shows it was queued, and make the next H5Fflush fail, once.
+ */
+void
+test_async(char *filename)
+{
+    hid_t fid1, fid2;           /* HDF5 file IDs */
+    hid_t sid1;                 /* Dataspace ID */
+    hid_t str_type;             /* String datatype */
+    hid_t dataset1, dataset2, dataset3; /* Dataset IDs */
+    hsize_t dims1[SPACE1_RANK] =
+        {SPACE1_DIM1,SPACE1_DIM2}; /* dataspace dim sizes */
+    DATATYPE data_array1[SPACE1_DIM1][SPACE1_DIM2]; /* data buffer */
+    DATATYPE data_origin1[SPACE1_DIM1][SPACE1_DIM2]; /* expected values */
+    hsize_t row;
+    hbool_t threadsafe = 0;
+    char *mpiio = getenv("H5TUNER_MPIIO");
+    herr_t write_ret, flush_ret;
+    herr_t ret;                 /* Generic return value */
+
+    ret = H5is_library_threadsafe(&threadsafe);
+    assert(ret != FAIL);
+    if (!threadsafe || (mpiio && strtol(mpiio, NULL, 10) > 0)) {
+        printf("SKIPPED: Write-behind test on file %s, writes are not queued "
+            "without a thread-safe HDF5 library or with H5TUNER_MPIIO\n", filename);
+        return;
+    }
+
+    if (verbose)
+        printf("Write-behind test on file %s\n", filename);
+
+    dataset_fill(dims1, &data_origin1[0][0]);
+
+    fid1 = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    assert(fid1 != FAIL);
+    sid1 = H5Screate_simple(SPACE1_RANK, dims1, NULL);
+    assert(sid1 != FAIL);
+    dataset1 = H5Dcreate2(fid1, DATASETNAME1, H5T_NATIVE_INT, sid1,
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(dataset1 != FAIL);
+    dataset2 = H5Dcreate2(fid1, DATASETNAME2, H5T_NATIVE_INT, sid1,
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(dataset2 != FAIL);
+
+    /* Visible after H5Dclose */
+    for (row = 0; row < SPACE1_DIM1; row++)
+        write_rows(dataset1, row, 1, 0, data_origin1[row]);
+    ret = H5Dclose(dataset1);
+    assert(ret != FAIL);
+    dataset1 = H5Dopen2(fid1, DATASETNAME1, H5P_DEFAULT);
+    assert(dataset1 != FAIL);
+    memset(data_array1, 0, sizeof(data_array1));
+    ret = H5Dread(dataset1, H5T_NATIVE_INT, H5S_ALL, H5S_ALL,
+        H5P_DEFAULT, data_array1);
+    assert(ret != FAIL);
+    if (dataset_vrfy(dims1, &data_array1[0][0], &data_origin1[0][0])) {
+        nerrors++;
+        printf("FAILED: Queued writes of %s not written at H5Dclose\n", filename);
+    }
+    ret = H5Dclose(dataset1);
+    assert(ret != FAIL);
+
+    /* Visible after H5Fflush, through a dataset ID that queued nothing */
+    for (row = 0; row < SPACE1_DIM1; row++)
+        write_rows(dataset2, row, 1, 0, data_origin1[row]);
+    ret = H5Fflush(fid1, H5F_SCOPE_GLOBAL);
+    assert(ret != FAIL);
+    fid2 = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    assert(fid2 != FAIL);
+    dataset3 = H5Dopen2(fid2, DATASETNAME2, H5P_DEFAULT);
+    assert(dataset3 != FAIL);
+    memset(data_array1, 0, sizeof(data_array1));
+    ret = H5Dread(dataset3, H5T_NATIVE_INT, H5S_ALL, H5S_ALL,
+        H5P_DEFAULT, data_array1);
+    assert(ret != FAIL);
+    if (dataset_vrfy(dims1, &data_array1[0][0], &data_origin1[0][0])) {
+        nerrors++;
+        printf("FAILED: Queued writes of %s not written at H5Fflush\n", filename);
+    }
+    ret = H5Dclose(dataset3);
+    assert(ret != FAIL);
+    ret = H5Fclose(fid2);
+    assert(ret != FAIL);
+    ret = H5Dclose(dataset2);
+    assert(ret != FAIL);
+
+    /* A failed write is reported at the next sync point, and only there */
+    str_type = H5Tcopy(H5T_C_S1);
+    assert(str_type != FAIL);
+    ret = H5Tset_size(str_type, sizeof(DATATYPE));
+    assert(ret != FAIL);
+    dataset3 = H5Dcreate2(fid1, DATASETNAME3, str_type, sid1,
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    assert(dataset3 != FAIL);
+    H5E_BEGIN_TRY {
+        write_ret = H5Dwrite(dataset3, H5T_NATIVE_INT, H5S_ALL, H5S_ALL,
+            H5P_DEFAULT, data_origin1);
+        flush_ret = H5Fflush(fid1, H5F_SCOPE_GLOBAL);
+    } H5E_END_TRY;
+    if (write_ret < 0) {
+        nerrors++;
+        printf("FAILED: Write to %s not queued\n", filename);
+    }
+    else if (flush_ret >= 0) {
+        nerrors++;
+        printf("FAILED: Failed queued write to %s not reported\n", filename);
+    }
+    ret = H5Dclose(dataset3);
+    if (ret < 0) {
+        nerrors++;
+        printf("FAILED: Failed queued write to %s reported again\n", filename);
+    }
+    H5Tclose(str_type);
+
+    H5Sclose(sid1);
+    ret = H5Fclose(fid1);
+    assert(ret != FAIL);
+}
+
+
 /*
  * Show command usage
  */
@@ -830,6 +1092,8 @@ mkfilenames()
     for (i=0; i<n; i++){
         sprintf(testfiles[i], "./ParaEg%d.h5", i);
     }
+    sprintf(aggfile, "./SerAgg.h5");
+    sprintf(asyncfile, "./SerAsync.h5");
     return(0);
 
 }
@@ -888,6 +1152,8 @@ cleanup(void)
     for (i=0; i<n; i++){
         remove(testfiles[i]);
     }
+    remove(aggfile);
+    remove(asyncfile);
 }
 
 
@@ -897,6 +1163,9 @@ main(int argc, char **argv)
 {
     int i, n;
 
+    /* Queue independent writes, before the first HDF5 call */
+    setenv("H5TUNER_ASYNC", "1", 1);
+
     if (parse_options(argc, argv) != 0)
         goto finish;
 
@@ -911,6 +1180,10 @@ main(int argc, char **argv)
         printf("testing HDF5 dataset write...\n");
         for(i = 0; i < n; i++)
             hdf5writeAll(testfiles[i]);
+        printf("testing H5Tuner write aggregation...\n");
+        test_aggregate(aggfile);
+        printf("testing H5Tuner write-behind...\n");
+        test_async(asyncfile);
     }
     if(doread) {
         printf("testing HDF5 dataset read...\n");
@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# Copyright by The HDF Group.
+# All rights reserved.
+#
+# Test of the trace and h5tuner-trace2json.  Runs the serial test with
+# H5TUNER_TRACE and H5TUNER_STATS=1, converts the trace to JSON and checks
+# that it has one H5Dwrite and H5Dread event per call the statistics
+# counted, and that the JSON parses (if python3 is found).
+
+TEST=./test_h5tuner_ser_shared
+LIB=${H5TUNER_LIB:-../src/libautotuner.so}
+TOOLS=${H5TUNER_TOOLS:-../tools}
+PREFIX=test_h5tuner_trace
+STATS=test_h5tuner_trace.stats
+JSON=test_h5tuner_trace.json
+nerrors=0
+
+if test ! -f "$LIB"; then
+    echo "$LIB not found, set H5TUNER_LIB"
+    exit 1
+fi
+
+# The serial test does not initialize MPI, so the trace is named by its
+# process ID
+rm -f $PREFIX.*.trace $STATS $JSON
+H5TUNER_TRACE=$PREFIX H5TUNER_STATS=1 H5TUNER_STATS_FILE=$STATS LD_PRELOAD=$LIB $RUNSERIAL $TEST > test_h5tuner_trace.log 2>&1 || {
+    cat test_h5tuner_trace.log
+    exit 1
+}
+$TOOLS/h5tuner-trace2json -o $JSON $PREFIX.*.trace || exit 1
+
+for op in write read; do
+    nevents=`grep -c "\"name\":\"H5D$op\"" $JSON`
+    ncalls=`awk -v metric=${op}_calls '$1 == metric { n += $3 } END { print n + 0 }' $STATS`
+    echo "H5D$op: $nevents events, $ncalls calls"
+    if test $ncalls -eq 0 || test $nevents -ne $ncalls; then
+        echo "FAILED: $nevents H5D$op events in $JSON, expected $ncalls"
+        nerrors=`expr $nerrors + 1`
+    fi
+done
+
+if command -v python3 > /dev/null 2>&1; then
+    if python3 -c "import json, sys; json.load(open(sys.argv[1]))" $JSON; then
+        :
+    else
+        echo "FAILED: $JSON does not parse"
+        nerrors=`expr $nerrors + 1`
+    fi
+else
+    echo "python3 not found, JSON syntax not checked"
+fi
+
+if test $nerrors -ne 0; then
+    echo "FAILED: $nerrors trace checks"
+    exit 1
+fi
+rm -f $PREFIX.*.trace $STATS $JSON test_h5tuner_trace.log
+echo "h5tuner-trace2json test passed"
+exit 0
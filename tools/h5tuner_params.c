@@ -0,0 +1,137 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * h5tuner-params: prints the tuning parameters the H5Tuner library applied
+ * to an HDF5 file (H5TUNER_RECORD_PARAMS=attribute or sidecar).  The output
+ * is in config.xml format, so it can be used as H5TUNER_CONFIG_FILE to
+ * reproduce the run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hdf5.h"
+
+/* Must match autotuner_private.h */
+#define PARAMS_ATTR_NAME "H5Tuner_parameters"
+#define PARAMS_SIDECAR_SUFFIX ".h5tuner.xml"
+
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s HDF5_FILE\n", prog);
+    fprintf(stderr, "Print the parameters H5Tuner applied to HDF5_FILE, from its\n");
+    fprintf(stderr, "\"%s\" attribute or its %s sidecar file.\n", PARAMS_ATTR_NAME, PARAMS_SIDECAR_SUFFIX);
+}
+
+
+/* Print the attribute.  Returns 1 if printed, 0 if the file has none and -1
+ * on error. */
+static int
+print_attr(const char *filename)
+{
+    hid_t file_id = -1;
+    hid_t attr_id = -1;
+    hid_t type_id = -1;
+    char *params = NULL;
+    size_t size;
+    htri_t exists;
+    int ret = -1;
+
+    H5E_BEGIN_TRY {
+        file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+    } H5E_END_TRY;
+    if(file_id < 0)
+        return 0;
+
+    if((exists = H5Aexists(file_id, PARAMS_ATTR_NAME)) < 0)
+        goto done;
+    if(!exists) {
+        ret = 0;
+        goto done;
+    }
+
+    if((attr_id = H5Aopen(file_id, PARAMS_ATTR_NAME, H5P_DEFAULT)) < 0)
+        goto done;
+    if((type_id = H5Aget_type(attr_id)) < 0)
+        goto done;
+    if(0 == (size = H5Tget_size(type_id)))
+        goto done;
+    if(NULL == (params = (char *)malloc(size + 1)))
+        goto done;
+    if(H5Aread(attr_id, type_id, params) < 0)
+        goto done;
+    params[size] = '\0';
+
+    fputs(params, stdout);
+    ret = 1;
+
+done:
+    free(params);
+    if(type_id >= 0)
+        H5Tclose(type_id);
+    if(attr_id >= 0)
+        H5Aclose(attr_id);
+    H5Fclose(file_id);
+
+    return ret;
+}
+
+
+static int
+print_sidecar(const char *filename)
+{
+    char *sidecar;
+    FILE *fp;
+    char buf[4096];
+    size_t n;
+
+    if(NULL == (sidecar = (char *)malloc(strlen(filename) + sizeof(PARAMS_SIDECAR_SUFFIX))))
+        return -1;
+    strcpy(sidecar, filename);
+    strcat(sidecar, PARAMS_SIDECAR_SUFFIX);
+
+    fp = fopen(sidecar, "r");
+    free(sidecar);
+    if(!fp)
+        return 0;
+
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        fwrite(buf, 1, n, stdout);
+    fclose(fp);
+
+    return 1;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int ret;
+
+    if(argc != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if((ret = print_attr(argv[1])) < 0) {
+        fprintf(stderr, "Unable to read attribute \"%s\" of %s\n", PARAMS_ATTR_NAME, argv[1]);
+        return 1;
+    }
+    if(ret == 0 && (ret = print_sidecar(argv[1])) <= 0) {
+        fprintf(stderr, "No H5Tuner parameters recorded for %s\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,1146 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * h5tuner-replay: replays the HDF5 I/O skeleton of an application, captured
+ * with H5TUNER_SKELETON=<prefix> (see autotuner_skeleton.c), with synthetic
+ * buffers.  Run with as many MPI ranks as the application had; each rank
+ * replays "<prefix>.<rank>.skel".  Files are created in the output directory
+ * under their base names, and files the application only opened are
+ * created there first, with the datasets it accessed.
+ *
+ * Run under the H5Tuner library, the replay makes the same file, dataset
+ * and transfer calls as the application, so it can replace the
+ * application as the command h5evolve evaluates.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mpi.h"
+#include "hdf5.h"
+
+/* Must match autotuner_skeleton.c */
+#define SKELETON_VERSION 1
+
+/* Communicators other than MPI_COMM_WORLD and MPI_COMM_SELF */
+#define MAX_COMMS 64
+
+typedef enum op_t {
+    OP_FCREATE = 0,
+    OP_FOPEN,
+    OP_FCLOSE,
+    OP_DCREATE,
+    OP_DATASET,
+    OP_EXTENT,
+    OP_WRITE,
+    OP_READ,
+    OP_DCLOSE,
+    OP_NOPS
+} op_t;
+
+static const char *op_names_g[OP_NOPS] = {"fcreate", "fopen", "fclose", "dcreate", "dataset", "extent", "write",
+        "read", "dclose"};
+
+typedef struct record_t {
+    op_t op;
+    double start;
+    double elapsed;
+    char *file;
+    char *dset;
+    int leader;                 /* fcreate, fopen */
+    int nprocs;
+    unsigned flags;
+    char type_class;            /* dcreate, dataset */
+    size_t type_size;
+    int rank;                   /* dcreate, dataset, extent, write, read */
+    hsize_t dims[H5S_MAX_RANK];
+    hsize_t maxdims[H5S_MAX_RANK];
+    int chunk_rank;
+    hsize_t chunk[H5S_MAX_RANK];
+    int collective;             /* write, read */
+    char sel[8];
+    hsize_t start_sel[H5S_MAX_RANK];
+    hsize_t stride[H5S_MAX_RANK];
+    hsize_t count[H5S_MAX_RANK];
+    hsize_t block[H5S_MAX_RANK];
+    long long nlist;            /* Blocks or points */
+    hsize_t *list;
+} record_t;
+
+typedef struct file_t {
+    char *name;
+    char *path;
+    hid_t id;
+    int nopen;                  /* Opens not closed yet, sharing id */
+    int mpio;
+    int writable;
+    int seen;
+    int input;                  /* First opened, not created */
+    int prepared;
+} file_t;
+
+typedef struct dset_t {
+    int file;
+    char *name;
+    hid_t id;
+    hid_t type_id;
+    size_t type_size;
+} dset_t;
+
+typedef struct comm_t {
+    int leader;
+    int nprocs;
+    MPI_Comm comm;
+} comm_t;
+
+static int rank_g = 0;
+static int size_g = 1;
+static const char *skel_name_g = NULL;
+static long line_g = 0;
+
+static char **lines_g = NULL;
+static long nlines_g = 0;
+
+static file_t *files_g = NULL;
+static int nfiles_g = 0;
+static dset_t *dsets_g = NULL;
+static int ndsets_g = 0;
+static comm_t comms_g[MAX_COMMS];
+static int ncomms_g = 0;
+
+static hsize_t *list_g = NULL;
+static size_t list_alloc_g = 0;
+static char *buf_g = NULL;
+static size_t buf_size_g = 0;
+
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-d DIR] [-g] [-p] PREFIX\n", prog);
+    fprintf(stderr, "Replay the HDF5 I/O skeleton PREFIX.<rank>.skel captured with\n");
+    fprintf(stderr, "H5TUNER_SKELETON=PREFIX, with as many ranks as it was captured with.\n");
+    fprintf(stderr, "  -d DIR  Create and open the files in DIR (default .), by base name\n");
+    fprintf(stderr, "  -g      Reproduce the time between calls (the application's compute)\n");
+    fprintf(stderr, "  -p      Only create the files the application opened, then exit\n");
+}
+
+
+static void
+fail(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "h5tuner-replay: rank %d: ", rank_g);
+    if(line_g > 0)
+        fprintf(stderr, "%s:%ld: ", skel_name_g, line_g);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+
+    MPI_Abort(MPI_COMM_WORLD, 1);
+    exit(1);
+}
+
+
+static void *
+xmalloc(size_t size)
+{
+    void *p;
+
+    if(NULL == (p = malloc(size ? size : 1)))
+        fail("out of memory");
+    return p;
+}
+
+
+static char *
+xstrdup(const char *s)
+{
+    return strcpy((char *)xmalloc(strlen(s) + 1), s);
+}
+
+
+/* Read the whole skeleton into lines_g */
+static void
+read_skeleton(const char *filename)
+{
+    FILE *fp;
+    char *text;
+    long size;
+    long alloc = 0;
+    char *p;
+
+    if(NULL == (fp = fopen(filename, "r")))
+        fail("unable to open %s", filename);
+    if(fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+        fail("unable to get size of %s", filename);
+    text = (char *)xmalloc((size_t)size + 1);
+    if(fread(text, 1, (size_t)size, fp) != (size_t)size)
+        fail("unable to read %s", filename);
+    text[size] = '\0';
+    fclose(fp);
+
+    for(p = text; *p; ) {
+        char *nl = strchr(p, '\n');
+
+        if(nlines_g == alloc) {
+            char **new_lines;
+
+            alloc = alloc ? 2 * alloc : 1024;
+            if(NULL == (new_lines = (char **)realloc(lines_g, (size_t)alloc * sizeof(char *))))
+                fail("out of memory");
+            lines_g = new_lines;
+        }
+        lines_g[nlines_g++] = p;
+        if(!nl)
+            break;
+        *nl = '\0';
+        p = nl + 1;
+    }
+}
+
+
+/* Decode %XX escapes in place */
+static char *
+decode_name(char *name)
+{
+    char *in, *out;
+
+    for(in = out = name; *in; in++, out++)
+        if(in[0] == '%' && isxdigit((unsigned char)in[1]) && isxdigit((unsigned char)in[2])) {
+            char hex[3] = {in[1], in[2], '\0'};
+
+            *out = (char)strtol(hex, NULL, 16);
+            in += 2;
+        }
+        else
+            *out = *in;
+    *out = '\0';
+
+    return name;
+}
+
+
+static char *
+next_token(char **save)
+{
+    char *tok = strtok_r(NULL, " \t", save);
+
+    if(!tok)
+        fail("truncated record");
+    return tok;
+}
+
+
+static long long
+next_int(char **save)
+{
+    return strtoll(next_token(save), NULL, 10);
+}
+
+
+static void
+next_dims(char **save, int rank, hsize_t *dims)
+{
+    int d;
+
+    for(d = 0; d < rank; d++) {
+        long long v = next_int(save);
+
+        dims[d] = v < 0 ? H5S_UNLIMITED : (hsize_t)v;
+    }
+}
+
+
+static int
+next_rank(char **save)
+{
+    long long rank = next_int(save);
+
+    if(rank < 0 || rank > H5S_MAX_RANK)
+        fail("invalid rank %lld", rank);
+    return (int)rank;
+}
+
+
+/* Parse a record line.  The line is copied to scratch, which the names in
+ * the record point into. */
+static void
+parse_record(const char *line, char **scratch, size_t *scratch_size, record_t *rec)
+{
+    size_t len = strlen(line) + 1;
+    char *save = NULL;
+    char *tok;
+    int op;
+
+    if(len > *scratch_size) {
+        free(*scratch);
+        *scratch = (char *)xmalloc(len);
+        *scratch_size = len;
+    }
+    memcpy(*scratch, line, len);
+
+    if(NULL == (tok = strtok_r(*scratch, " \t", &save)))
+        fail("empty record");
+    rec->start = strtod(tok, NULL);
+    rec->elapsed = strtod(next_token(&save), NULL);
+    tok = next_token(&save);
+    for(op = 0; op < OP_NOPS; op++)
+        if(!strcmp(tok, op_names_g[op]))
+            break;
+    if(op == OP_NOPS)
+        fail("unknown operation \"%s\"", tok);
+    rec->op = (op_t)op;
+    rec->dset = NULL;
+
+    switch(rec->op) {
+        case OP_FCREATE:
+        case OP_FOPEN:
+            rec->leader = (int)next_int(&save);
+            rec->nprocs = (int)next_int(&save);
+            rec->flags = (unsigned)next_int(&save);
+            rec->file = decode_name(next_token(&save));
+            break;
+
+        case OP_FCLOSE:
+            rec->file = decode_name(next_token(&save));
+            break;
+
+        case OP_DCREATE:
+        case OP_DATASET:
+            rec->file = decode_name(next_token(&save));
+            rec->dset = decode_name(next_token(&save));
+            tok = next_token(&save);
+            rec->type_class = tok[0];
+            rec->type_size = (size_t)strtoul(tok + 1, NULL, 10);
+            if(rec->type_size == 0)
+                fail("invalid type \"%s\"", tok);
+            rec->rank = next_rank(&save);
+            next_dims(&save, rec->rank, rec->dims);
+            next_dims(&save, rec->rank, rec->maxdims);
+            rec->chunk_rank = next_rank(&save);
+            next_dims(&save, rec->chunk_rank, rec->chunk);
+            break;
+
+        case OP_EXTENT:
+            rec->file = decode_name(next_token(&save));
+            rec->dset = decode_name(next_token(&save));
+            rec->rank = next_rank(&save);
+            next_dims(&save, rec->rank, rec->dims);
+            break;
+
+        case OP_WRITE:
+        case OP_READ:
+            rec->file = decode_name(next_token(&save));
+            rec->dset = decode_name(next_token(&save));
+            rec->collective = !strcmp(next_token(&save), "c");
+            strncpy(rec->sel, next_token(&save), sizeof(rec->sel) - 1);
+            rec->sel[sizeof(rec->sel) - 1] = '\0';
+            rec->nlist = 0;
+            if(!strcmp(rec->sel, "all") || !strcmp(rec->sel, "none"))
+                break;
+            rec->rank = next_rank(&save);
+            if(!strcmp(rec->sel, "hyper")) {
+                next_dims(&save, rec->rank, rec->start_sel);
+                next_dims(&save, rec->rank, rec->stride);
+                next_dims(&save, rec->rank, rec->count);
+                next_dims(&save, rec->rank, rec->block);
+            }
+            else if(!strcmp(rec->sel, "blocks") || !strcmp(rec->sel, "points")) {
+                size_t n;
+
+                rec->nlist = next_int(&save);
+                n = (size_t)rec->nlist * (size_t)rec->rank * (rec->sel[0] == 'b' ? 2 : 1);
+                if(n > list_alloc_g) {
+                    free(list_g);
+                    list_g = (hsize_t *)xmalloc(n * sizeof(hsize_t));
+                    list_alloc_g = n;
+                }
+                next_dims(&save, (int)n, list_g);
+                rec->list = list_g;
+            }
+            else if(!strcmp(rec->sel, "bounds")) {
+                /* The end of the box is kept in count */
+                rec->nlist = next_int(&save);
+                next_dims(&save, rec->rank, rec->start_sel);
+                next_dims(&save, rec->rank, rec->count);
+            }
+            else
+                fail("unknown selection \"%s\"", rec->sel);
+            break;
+
+        case OP_DCLOSE:
+            rec->file = decode_name(next_token(&save));
+            rec->dset = decode_name(next_token(&save));
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+static int
+find_file(const char *name, const char *dir)
+{
+    const char *base;
+    int f;
+
+    for(f = 0; f < nfiles_g; f++)
+        if(!strcmp(files_g[f].name, name))
+            return f;
+
+    if(NULL == (files_g = (file_t *)realloc(files_g, (size_t)(nfiles_g + 1) * sizeof(file_t))))
+        fail("out of memory");
+    base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    memset(&files_g[f], 0, sizeof(file_t));
+    files_g[f].name = xstrdup(name);
+    files_g[f].path = (char *)xmalloc(strlen(dir) + strlen(base) + 2);
+    sprintf(files_g[f].path, "%s/%s", dir, base);
+    files_g[f].id = -1;
+    nfiles_g++;
+
+    return f;
+}
+
+
+static dset_t *
+find_dset(int file, const char *name)
+{
+    int d;
+
+    for(d = 0; d < ndsets_g; d++)
+        if(dsets_g[d].file == file && !strcmp(dsets_g[d].name, name))
+            return &dsets_g[d];
+
+    if(NULL == (dsets_g = (dset_t *)realloc(dsets_g, (size_t)(ndsets_g + 1) * sizeof(dset_t))))
+        fail("out of memory");
+    dsets_g[d].file = file;
+    dsets_g[d].name = xstrdup(name);
+    dsets_g[d].id = -1;
+    dsets_g[d].type_id = -1;
+    dsets_g[d].type_size = 0;
+    ndsets_g++;
+
+    return &dsets_g[d];
+}
+
+
+/* Memory and file type for a recorded type.  Integers and floats of native
+ * sizes map to native types, anything else to opaque types of its size. */
+static hid_t
+make_type(char type_class, size_t size)
+{
+    hid_t base = -1;
+    hid_t type_id;
+
+    if(type_class == 'i' || type_class == 'u') {
+        if(size == 1)
+            base = type_class == 'i' ? H5T_NATIVE_INT8 : H5T_NATIVE_UINT8;
+        else if(size == 2)
+            base = type_class == 'i' ? H5T_NATIVE_INT16 : H5T_NATIVE_UINT16;
+        else if(size == 4)
+            base = type_class == 'i' ? H5T_NATIVE_INT32 : H5T_NATIVE_UINT32;
+        else if(size == 8)
+            base = type_class == 'i' ? H5T_NATIVE_INT64 : H5T_NATIVE_UINT64;
+    }
+    else if(type_class == 'f') {
+        if(size == sizeof(float))
+            base = H5T_NATIVE_FLOAT;
+        else if(size == sizeof(double))
+            base = H5T_NATIVE_DOUBLE;
+    }
+
+    if(base >= 0)
+        type_id = H5Tcopy(base);
+    else
+        type_id = H5Tcreate(H5T_OPAQUE, size);
+    if(type_id < 0)
+        fail("unable to create datatype %c%lu", type_class, (unsigned long)size);
+
+    return type_id;
+}
+
+
+/* Create a dataset as described by a dcreate or dataset record */
+static hid_t
+create_dset(hid_t file_id, const record_t *rec, int early_alloc)
+{
+    hid_t type_id = -1;
+    hid_t space_id = -1;
+    hid_t lcpl_id = -1;
+    hid_t dcpl_id = -1;
+    hid_t loc_id = file_id;
+    const char *base;
+    hsize_t maxdims[H5S_MAX_RANK];
+    hsize_t chunk[H5S_MAX_RANK];
+    int chunk_rank = rec->chunk_rank;
+    int d;
+    hid_t dset_id;
+
+    memcpy(chunk, rec->chunk, sizeof(chunk));
+    for(d = 0; d < rec->rank; d++) {
+        maxdims[d] = rec->maxdims[d];
+        if(maxdims[d] != H5S_UNLIMITED && maxdims[d] < rec->dims[d])
+            maxdims[d] = rec->dims[d];
+
+        /* Extendible datasets must be chunked */
+        if(maxdims[d] == H5S_UNLIMITED && chunk_rank == 0) {
+            int c;
+
+            for(c = 0; c < rec->rank; c++)
+                chunk[c] = rec->dims[c] > 0 ? rec->dims[c] : 1;
+            chunk_rank = rec->rank;
+        }
+    }
+
+    type_id = make_type(rec->type_class, rec->type_size);
+    if((space_id = H5Screate_simple(rec->rank, rec->dims, maxdims)) < 0)
+        fail("unable to create dataspace for %s", rec->dset);
+    if((lcpl_id = H5Pcreate(H5P_LINK_CREATE)) < 0 || H5Pset_create_intermediate_group(lcpl_id, 1) < 0)
+        fail("unable to create link creation property list");
+    if((dcpl_id = H5Pcreate(H5P_DATASET_CREATE)) < 0)
+        fail("unable to create dataset creation property list");
+    if(chunk_rank > 0 && H5Pset_chunk(dcpl_id, chunk_rank, chunk) < 0)
+        fail("unable to set chunk dimensions for %s", rec->dset);
+
+    /* Files prepared for reading get their storage, so reads hit the file */
+    if(early_alloc && (H5Pset_alloc_time(dcpl_id, H5D_ALLOC_TIME_EARLY) < 0
+            || H5Pset_fill_time(dcpl_id, H5D_FILL_TIME_NEVER) < 0))
+        fail("unable to set allocation time for %s", rec->dset);
+
+    /* Datasets created in opened files exist from earlier replays */
+    if(!early_alloc) {
+        htri_t exists;
+
+        H5E_BEGIN_TRY {
+            exists = H5Lexists(file_id, rec->dset, H5P_DEFAULT);
+        } H5E_END_TRY;
+        if(exists > 0 && H5Ldelete(file_id, rec->dset, H5P_DEFAULT) < 0)
+            fail("unable to delete dataset %s", rec->dset);
+    }
+
+    /* Create the dataset by its base name in its group, as applications
+     * usually do, so that rules naming the dataset as in the call apply as
+     * they did to the application */
+    if(NULL == (base = strrchr(rec->dset, '/')))
+        base = rec->dset;
+    else {
+        if(base > rec->dset) {
+            char *group = xstrdup(rec->dset);
+            htri_t exists;
+
+            group[base - rec->dset] = '\0';
+            H5E_BEGIN_TRY {
+                exists = H5Lexists(file_id, group, H5P_DEFAULT);
+            } H5E_END_TRY;
+            if(exists > 0)
+                loc_id = H5Gopen2(file_id, group, H5P_DEFAULT);
+            else
+                loc_id = H5Gcreate2(file_id, group, lcpl_id, H5P_DEFAULT, H5P_DEFAULT);
+            if(loc_id < 0)
+                fail("unable to open group %s", group);
+            free(group);
+        }
+        base++;
+    }
+
+    if((dset_id = H5Dcreate2(loc_id, base, type_id, space_id, lcpl_id, dcpl_id, H5P_DEFAULT)) < 0)
+        fail("unable to create dataset %s", rec->dset);
+
+    if(loc_id != file_id)
+        H5Gclose(loc_id);
+    H5Pclose(dcpl_id);
+    H5Pclose(lcpl_id);
+    H5Sclose(space_id);
+    H5Tclose(type_id);
+
+    return dset_id;
+}
+
+
+/* Create the communicators of the files opened with MPI-IO.  Each is
+ * identified by its rank 0 and size; communicators other than the world
+ * and self ones are created with MPI_Comm_split by all ranks together. */
+static void
+setup_comms(void)
+{
+    int local[1 + 2 * MAX_COMMS];
+    int *all;
+    char *scratch = NULL;
+    size_t scratch_size = 0;
+    record_t rec;
+    long l;
+    int r, i, c;
+
+    local[0] = 0;
+    for(l = 2; l < nlines_g; l++) {
+        if(!*lines_g[l])
+            continue;
+        line_g = l + 1;
+        parse_record(lines_g[l], &scratch, &scratch_size, &rec);
+        if((rec.op != OP_FCREATE && rec.op != OP_FOPEN) || rec.leader < 0 || rec.nprocs <= 1 || rec.nprocs == size_g)
+            continue;
+        for(i = 0; i < local[0]; i++)
+            if(local[1 + 2 * i] == rec.leader && local[2 + 2 * i] == rec.nprocs)
+                break;
+        if(i == local[0]) {
+            if(local[0] == MAX_COMMS)
+                fail("more than %d file communicators", MAX_COMMS);
+            local[1 + 2 * i] = rec.leader;
+            local[2 + 2 * i] = rec.nprocs;
+            local[0]++;
+        }
+    }
+    line_g = 0;
+    free(scratch);
+
+    all = (int *)xmalloc((size_t)size_g * sizeof(local));
+    if(MPI_Allgather(local, 1 + 2 * MAX_COMMS, MPI_INT, all, 1 + 2 * MAX_COMMS, MPI_INT, MPI_COMM_WORLD) != MPI_SUCCESS)
+        fail("unable to gather file communicators");
+
+    /* Every rank sees the same union in the same order */
+    for(r = 0; r < size_g; r++) {
+        const int *pairs = &all[r * (1 + 2 * MAX_COMMS)];
+
+        for(i = 0; i < pairs[0]; i++) {
+            for(c = 0; c < ncomms_g; c++)
+                if(comms_g[c].leader == pairs[1 + 2 * i] && comms_g[c].nprocs == pairs[2 + 2 * i])
+                    break;
+            if(c == ncomms_g) {
+                if(ncomms_g == MAX_COMMS)
+                    fail("more than %d file communicators", MAX_COMMS);
+                comms_g[c].leader = pairs[1 + 2 * i];
+                comms_g[c].nprocs = pairs[2 + 2 * i];
+                ncomms_g++;
+            }
+        }
+    }
+
+    for(c = 0; c < ncomms_g; c++) {
+        int member = 0;
+
+        for(i = 0; i < local[0]; i++)
+            if(local[1 + 2 * i] == comms_g[c].leader && local[2 + 2 * i] == comms_g[c].nprocs)
+                member = 1;
+        if(MPI_Comm_split(MPI_COMM_WORLD, member ? comms_g[c].leader : MPI_UNDEFINED, rank_g, &comms_g[c].comm) != MPI_SUCCESS)
+            fail("unable to create file communicator");
+    }
+
+    free(all);
+}
+
+
+static MPI_Comm
+find_comm(int leader, int nprocs)
+{
+    int c;
+
+    if(nprocs <= 1)
+        return MPI_COMM_SELF;
+    if(nprocs == size_g)
+        return MPI_COMM_WORLD;
+    for(c = 0; c < ncomms_g; c++)
+        if(comms_g[c].leader == leader && comms_g[c].nprocs == nprocs)
+            return comms_g[c].comm;
+
+    fail("no communicator for rank %d size %d", leader, nprocs);
+    return MPI_COMM_NULL;
+}
+
+
+/* Create the files the application opened without creating them, with the
+ * datasets it described.  The descriptions of all ranks are gathered on
+ * rank 0, which creates the missing files. */
+static void
+prepare_inputs(const char *dir, int force)
+{
+    char *scratch = NULL;
+    size_t scratch_size = 0;
+    record_t rec;
+    char *local;
+    size_t local_len = 0;
+    int len;
+    int *lens = NULL;
+    int *displs = NULL;
+    char *all = NULL;
+    long l;
+    int f, r;
+
+    /* Lines describing datasets of input files */
+    local = (char *)xmalloc(1);
+    local[0] = '\0';
+    for(l = 2; l < nlines_g; l++) {
+        if(!*lines_g[l])
+            continue;
+        line_g = l + 1;
+        parse_record(lines_g[l], &scratch, &scratch_size, &rec);
+        f = find_file(rec.file, dir);
+        if(!files_g[f].seen) {
+            files_g[f].seen = 1;
+            files_g[f].input = rec.op == OP_FOPEN;
+        }
+        if((rec.op == OP_DATASET || rec.op == OP_EXTENT) && files_g[f].input) {
+            size_t n = strlen(lines_g[l]);
+
+            if(NULL == (local = (char *)realloc(local, local_len + n + 2)))
+                fail("out of memory");
+            memcpy(local + local_len, lines_g[l], n);
+            local[local_len + n] = '\n';
+            local_len += n + 1;
+            local[local_len] = '\0';
+        }
+    }
+    line_g = 0;
+
+    len = (int)local_len;
+    if(rank_g == 0)
+        lens = (int *)xmalloc((size_t)size_g * sizeof(int));
+    if(MPI_Gather(&len, 1, MPI_INT, lens, 1, MPI_INT, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+        fail("unable to gather input file descriptions");
+    if(rank_g == 0) {
+        int total = 0;
+
+        displs = (int *)xmalloc((size_t)size_g * sizeof(int));
+        for(r = 0; r < size_g; r++) {
+            displs[r] = total;
+            total += lens[r];
+        }
+        all = (char *)xmalloc((size_t)total + 1);
+        all[total] = '\0';
+    }
+    if(MPI_Gatherv(local, len, MPI_CHAR, all, lens, displs, MPI_CHAR, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+        fail("unable to gather input file descriptions");
+
+    if(rank_g == 0 && all[0]) {
+        record_t *descs = NULL;
+        char **desc_scratch = NULL;
+        int ndescs = 0;
+        char *save = NULL;
+        char *line;
+        int d, e, k;
+
+        /* Merge the descriptions, the extent being the largest seen */
+        for(line = strtok_r(all, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+            size_t size = 0;
+            char *s = NULL;
+
+            parse_record(line, &s, &size, &rec);
+            for(d = 0; d < ndescs; d++)
+                if(!strcmp(descs[d].file, rec.file) && !strcmp(descs[d].dset, rec.dset))
+                    break;
+            if(d == ndescs) {
+                if(rec.op != OP_DATASET) {
+                    free(s);
+                    continue;
+                }
+                descs = (record_t *)realloc(descs, (size_t)(ndescs + 1) * sizeof(record_t));
+                desc_scratch = (char **)realloc(desc_scratch, (size_t)(ndescs + 1) * sizeof(char *));
+                if(!descs || !desc_scratch)
+                    fail("out of memory");
+                descs[d] = rec;
+                desc_scratch[d] = s;
+                ndescs++;
+                continue;
+            }
+            if(rec.rank == descs[d].rank)
+                for(k = 0; k < rec.rank; k++)
+                    if(rec.dims[k] > descs[d].dims[k])
+                        descs[d].dims[k] = rec.dims[k];
+            free(s);
+        }
+
+        for(d = 0; d < ndescs; d++) {
+            struct stat st;
+            hid_t file_id;
+
+            f = find_file(descs[d].file, dir);
+            if(files_g[f].prepared)
+                continue;
+            files_g[f].prepared = 1;
+            if(!force && stat(files_g[f].path, &st) == 0)
+                continue;
+
+            printf("h5tuner-replay: creating %s\n", files_g[f].path);
+            if((file_id = H5Fcreate(files_g[f].path, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)) < 0)
+                fail("unable to create %s", files_g[f].path);
+            for(e = d; e < ndescs; e++)
+                if(!strcmp(descs[e].file, descs[d].file))
+                    H5Dclose(create_dset(file_id, &descs[e], 1));
+            H5Fclose(file_id);
+        }
+        for(d = 0; d < ndescs; d++)
+            free(desc_scratch[d]);
+        free(desc_scratch);
+        free(descs);
+        fflush(stdout);
+    }
+
+    free(scratch);
+    free(local);
+    free(lens);
+    free(displs);
+    free(all);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+
+static void
+close_dset(dset_t *dset)
+{
+    if(dset->id >= 0 && H5Dclose(dset->id) < 0)
+        fail("unable to close dataset %s", dset->name);
+    if(dset->type_id >= 0)
+        H5Tclose(dset->type_id);
+    dset->id = -1;
+    dset->type_id = -1;
+}
+
+
+static dset_t *
+open_dset(int file, const char *name)
+{
+    dset_t *dset = find_dset(file, name);
+
+    if(dset->id < 0) {
+        if(files_g[file].id < 0)
+            fail("file %s is not open", files_g[file].name);
+        if((dset->id = H5Dopen2(files_g[file].id, name, H5P_DEFAULT)) < 0)
+            fail("unable to open dataset %s", name);
+    }
+    if(dset->type_id < 0) {
+        if((dset->type_id = H5Dget_type(dset->id)) < 0)
+            fail("unable to get type of dataset %s", name);
+        dset->type_size = H5Tget_size(dset->type_id);
+    }
+
+    return dset;
+}
+
+
+/* Select the recorded selection in space_id */
+static void
+select_space(hid_t space_id, const record_t *rec)
+{
+    herr_t status = 0;
+    long long i;
+
+    if(!strcmp(rec->sel, "all"))
+        status = H5Sselect_all(space_id);
+    else if(!strcmp(rec->sel, "none"))
+        status = H5Sselect_none(space_id);
+    else if(!strcmp(rec->sel, "hyper"))
+        status = H5Sselect_hyperslab(space_id, H5S_SELECT_SET, rec->start_sel, rec->stride, rec->count, rec->block);
+    else if(!strcmp(rec->sel, "blocks")) {
+        status = H5Sselect_none(space_id);
+        for(i = 0; i < rec->nlist && status >= 0; i++) {
+            const hsize_t *start = &rec->list[2 * i * rec->rank];
+            const hsize_t *end = start + rec->rank;
+            hsize_t count[H5S_MAX_RANK];
+            int d;
+
+            for(d = 0; d < rec->rank; d++)
+                count[d] = end[d] - start[d] + 1;
+            status = H5Sselect_hyperslab(space_id, i == 0 ? H5S_SELECT_SET : H5S_SELECT_OR, start, NULL, count, NULL);
+        }
+    }
+    else if(!strcmp(rec->sel, "points"))
+        status = H5Sselect_elements(space_id, H5S_SELECT_SET, (size_t)rec->nlist, rec->list);
+    else {
+        /* Bounding box of a selection too long to record */
+        hsize_t count[H5S_MAX_RANK];
+        int d;
+
+        for(d = 0; d < rec->rank; d++)
+            count[d] = rec->count[d] - rec->start_sel[d] + 1;
+        status = H5Sselect_hyperslab(space_id, H5S_SELECT_SET, rec->start_sel, NULL, count, NULL);
+    }
+
+    if(status < 0)
+        fail("unable to select %s", rec->sel);
+}
+
+
+/* Replay one write or read.  Returns the bytes transferred. */
+static double
+replay_io(const record_t *rec, const char *dir, hid_t coll_dxpl_id, hid_t indep_dxpl_id)
+{
+    int f = find_file(rec->file, dir);
+    dset_t *dset = open_dset(f, rec->dset);
+    hid_t space_id;
+    hid_t mem_space_id;
+    hid_t dxpl_id = H5P_DEFAULT;
+    hssize_t npoints;
+    hsize_t mem_dims;
+    size_t nbytes;
+    herr_t status;
+
+    if((space_id = H5Dget_space(dset->id)) < 0)
+        fail("unable to get dataspace of %s", rec->dset);
+    select_space(space_id, rec);
+    if((npoints = H5Sget_select_npoints(space_id)) < 0)
+        fail("unable to get number of selected elements");
+
+    mem_dims = npoints > 0 ? (hsize_t)npoints : 1;
+    if((mem_space_id = H5Screate_simple(1, &mem_dims, NULL)) < 0)
+        fail("unable to create memory dataspace");
+    if(npoints == 0 && H5Sselect_none(mem_space_id) < 0)
+        fail("unable to select memory dataspace");
+
+    nbytes = (size_t)npoints * dset->type_size;
+    if(nbytes > buf_size_g) {
+        free(buf_g);
+        buf_g = (char *)xmalloc(nbytes);
+        memset(buf_g, 'a' + rank_g % 26, nbytes);
+        buf_size_g = nbytes;
+    }
+
+    if(files_g[f].mpio)
+        dxpl_id = rec->collective ? coll_dxpl_id : indep_dxpl_id;
+
+    if(rec->op == OP_WRITE)
+        status = H5Dwrite(dset->id, dset->type_id, mem_space_id, space_id, dxpl_id, buf_g);
+    else
+        status = H5Dread(dset->id, dset->type_id, mem_space_id, space_id, dxpl_id, buf_g);
+    if(status < 0)
+        fail("unable to %s %s", op_names_g[rec->op], rec->dset);
+
+    H5Sclose(mem_space_id);
+    H5Sclose(space_id);
+
+    return (double)nbytes;
+}
+
+
+static void
+sleep_for(double seconds)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1.0e9);
+    nanosleep(&ts, NULL);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    const char *dir = ".";
+    int gaps = 0;
+    int prepare_only = 0;
+    char *skel_name;
+    char *scratch = NULL;
+    size_t scratch_size = 0;
+    record_t rec;
+    hid_t coll_dxpl_id, indep_dxpl_id;
+    double prev_end = -1.0;
+    double counts[4] = {0.0, 0.0, 0.0, 0.0};    /* Writes, reads, bytes written, bytes read */
+    double totals[4];
+    double start, elapsed, max_elapsed;
+    int skel_version, skel_rank, skel_size;
+    long l;
+    int f, d;
+    int opt;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank_g);
+    MPI_Comm_size(MPI_COMM_WORLD, &size_g);
+
+    while((opt = getopt(argc, argv, "d:gph")) != -1)
+        switch(opt) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'g':
+                gaps = 1;
+                break;
+            case 'p':
+                prepare_only = 1;
+                break;
+            default:
+                if(rank_g == 0)
+                    usage(argv[0]);
+                MPI_Finalize();
+                return 1;
+        }
+    if(optind != argc - 1) {
+        if(rank_g == 0)
+            usage(argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    skel_name = (char *)xmalloc(strlen(argv[optind]) + 32);
+    sprintf(skel_name, "%s.%d.skel", argv[optind], rank_g);
+    skel_name_g = skel_name;
+    read_skeleton(skel_name);
+    if(nlines_g < 2 || sscanf(lines_g[0], "h5tuner-skeleton %d", &skel_version) != 1
+            || sscanf(lines_g[1], "rank %d size %d", &skel_rank, &skel_size) != 2)
+        fail("%s is not an H5Tuner skeleton", skel_name);
+    if(skel_version != SKELETON_VERSION)
+        fail("skeleton version %d, expected %d", skel_version, SKELETON_VERSION);
+    if(skel_size != size_g)
+        fail("skeleton was captured with %d ranks, replaying with %d", skel_size, size_g);
+
+    setup_comms();
+    prepare_inputs(dir, prepare_only);
+    if(prepare_only) {
+        MPI_Finalize();
+        return 0;
+    }
+
+    if((coll_dxpl_id = H5Pcreate(H5P_DATASET_XFER)) < 0 || H5Pset_dxpl_mpio(coll_dxpl_id, H5FD_MPIO_COLLECTIVE) < 0)
+        fail("unable to create collective transfer property list");
+    if((indep_dxpl_id = H5Pcreate(H5P_DATASET_XFER)) < 0 || H5Pset_dxpl_mpio(indep_dxpl_id, H5FD_MPIO_INDEPENDENT) < 0)
+        fail("unable to create independent transfer property list");
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+
+    for(l = 2; l < nlines_g; l++) {
+        if(!*lines_g[l])
+            continue;
+        line_g = l + 1;
+        parse_record(lines_g[l], &scratch, &scratch_size, &rec);
+
+        /* The application computed between the end of the last call and the
+         * start of this one */
+        if(gaps && prev_end >= 0.0 && rec.start > prev_end)
+            sleep_for(rec.start - prev_end);
+        prev_end = rec.start + rec.elapsed;
+
+        f = find_file(rec.file, dir);
+        switch(rec.op) {
+            case OP_FCREATE:
+            case OP_FOPEN:
+            {
+                hid_t fapl_id;
+
+                /* The application opened the file again before closing
+                 * it, which HDF5 shares */
+                if(files_g[f].id >= 0) {
+                    files_g[f].nopen++;
+                    break;
+                }
+
+                if((fapl_id = H5Pcreate(H5P_FILE_ACCESS)) < 0)
+                    fail("unable to create file access property list");
+                files_g[f].mpio = rec.leader >= 0;
+                if(files_g[f].mpio && H5Pset_fapl_mpio(fapl_id, find_comm(rec.leader, rec.nprocs), MPI_INFO_NULL) < 0)
+                    fail("unable to set MPI-IO file driver");
+
+                /* Replays overwrite the files of earlier replays */
+                if(rec.op == OP_FCREATE) {
+                    files_g[f].id = H5Fcreate(files_g[f].path, (rec.flags & ~H5F_ACC_EXCL) | H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id);
+                    files_g[f].writable = 1;
+                }
+                else {
+                    files_g[f].id = H5Fopen(files_g[f].path, rec.flags, fapl_id);
+                    files_g[f].writable = (rec.flags & H5F_ACC_RDWR) != 0;
+                }
+                if(files_g[f].id < 0)
+                    fail("unable to %s %s", op_names_g[rec.op], files_g[f].path);
+                files_g[f].nopen = 1;
+                H5Pclose(fapl_id);
+                break;
+            }
+
+            case OP_FCLOSE:
+                if(files_g[f].nopen > 1) {
+                    files_g[f].nopen--;
+                    break;
+                }
+                for(d = 0; d < ndsets_g; d++)
+                    if(dsets_g[d].file == f)
+                        close_dset(&dsets_g[d]);
+                if(files_g[f].id >= 0 && H5Fclose(files_g[f].id) < 0)
+                    fail("unable to close %s", files_g[f].path);
+                files_g[f].id = -1;
+                files_g[f].nopen = 0;
+                break;
+
+            case OP_DCREATE:
+            {
+                dset_t *dset = find_dset(f, rec.dset);
+
+                if(files_g[f].id < 0)
+                    fail("file %s is not open", rec.file);
+                close_dset(dset);
+                dset->id = create_dset(files_g[f].id, &rec, 0);
+                break;
+            }
+
+            case OP_DATASET:
+                /* Opened on first access */
+                break;
+
+            case OP_EXTENT:
+                if(files_g[f].writable && H5Dset_extent(open_dset(f, rec.dset)->id, rec.dims) < 0)
+                    fail("unable to set extent of %s", rec.dset);
+                break;
+
+            case OP_WRITE:
+                counts[0] += 1.0;
+                counts[2] += replay_io(&rec, dir, coll_dxpl_id, indep_dxpl_id);
+                break;
+
+            case OP_READ:
+                counts[1] += 1.0;
+                counts[3] += replay_io(&rec, dir, coll_dxpl_id, indep_dxpl_id);
+                break;
+
+            case OP_DCLOSE:
+                close_dset(find_dset(f, rec.dset));
+                break;
+
+            default:
+                break;
+        }
+    }
+    line_g = 0;
+
+    /* Close what the application left open */
+    for(d = 0; d < ndsets_g; d++)
+        close_dset(&dsets_g[d]);
+    for(f = 0; f < nfiles_g; f++)
+        if(files_g[f].id >= 0) {
+            H5Fclose(files_g[f].id);
+            files_g[f].id = -1;
+        }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    elapsed = MPI_Wtime() - start;
+
+    MPI_Reduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(counts, totals, 4, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if(rank_g == 0)
+        printf("h5tuner-replay: %d ranks, %.0f writes (%.0f bytes), %.0f reads (%.0f bytes) in %.6f s\n", size_g,
+                totals[0], totals[2], totals[1], totals[3], max_elapsed);
+
+    H5Pclose(coll_dxpl_id);
+    H5Pclose(indep_dxpl_id);
+    free(scratch);
+    free(skel_name);
+
+    MPI_Finalize();
+
+    return 0;
+}
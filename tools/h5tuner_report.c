@@ -0,0 +1,374 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * h5tuner-report: reads the statistics summary written by the H5Tuner
+ * library (H5TUNER_STATS=1, H5TUNER_STATS_FILE=<file>), prints the request
+ * size histograms and suggests tuning parameters as config.xml fragments.
+ *
+ * The suggestions are starting points for h5evolve, not final answers:
+ *  - The dominant request size is the byte-weighted median of the log2
+ *    request size histogram of all datasets in a file.
+ *  - striping_unit is the dominant size rounded down to a multiple of
+ *    64 KiB, clamped to [1 MiB, 64 MiB].
+ *  - cb_buffer_size is the smallest multiple of striping_unit that holds a
+ *    dominant request, capped at 128 MiB.
+ *  - alignment aligns objects of at least half the dominant size on
+ *    striping_unit boundaries.
+ *  - chunk follows the regular hyperslab each rank selects, so that each
+ *    write maps to whole chunks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIST_NBINS 48
+#define SHAPE_MAX_RANK 8
+#define MAX_LINE 4096
+
+#define KIB ((double)1024)
+#define MIB (KIB * KIB)
+
+typedef struct report_dset_t {
+    char filename[MAX_LINE];
+    char dset_name[MAX_LINE];
+    int ranks;
+    double write_calls;
+    double write_bytes;
+    double read_calls;
+    double read_bytes;
+    double write_hist[HIST_NBINS];
+    double read_hist[HIST_NBINS];
+    int shape_rank;
+    double count_min[SHAPE_MAX_RANK];
+    double stride_max[SHAPE_MAX_RANK];
+    double block_min[SHAPE_MAX_RANK];
+} report_dset_t;
+
+static report_dset_t *dsets_g = NULL;
+static size_t ndsets_g = 0;
+
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s STATS_FILE\n", prog);
+    fprintf(stderr, "Print request size histograms from an H5Tuner statistics summary\n");
+    fprintf(stderr, "(written with H5TUNER_STATS=1 and H5TUNER_STATS_FILE=STATS_FILE)\n");
+    fprintf(stderr, "and suggest H5Tuner parameters.\n");
+}
+
+
+static void
+parse_hist(char *str, double *hist)
+{
+    char *tok;
+
+    for(tok = strtok(str, " \n"); tok; tok = strtok(NULL, " \n")) {
+        int bin;
+        double calls;
+
+        if(sscanf(tok, "%d:%lf", &bin, &calls) == 2 && bin >= 0 && bin < HIST_NBINS)
+            hist[bin] += calls;
+    }
+}
+
+
+static int
+parse_dims(char *str, double *vals)
+{
+    char *tok;
+    int n = 0;
+
+    for(tok = strtok(str, ","); tok && n < SHAPE_MAX_RANK; tok = strtok(NULL, ","))
+        vals[n++] = strtod(tok, NULL);
+
+    return n;
+}
+
+
+static int
+read_stats(const char *stats_file)
+{
+    FILE *fp;
+    char line[MAX_LINE];
+    report_dset_t *dset = NULL;
+    size_t alloc = 0;
+
+    if(NULL == (fp = fopen(stats_file, "r"))) {
+        fprintf(stderr, "Unable to open statistics file %s\n", stats_file);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), fp)) {
+        char key[64];
+        char rest[MAX_LINE];
+
+        if(line[0] == '#')
+            continue;
+
+        if(!strncmp(line, "dataset ", 8)) {
+            if(ndsets_g == alloc) {
+                alloc = alloc ? 2 * alloc : 16;
+                if(NULL == (dsets_g = (report_dset_t *)realloc(dsets_g, alloc * sizeof(report_dset_t)))) {
+                    fprintf(stderr, "Unable to allocate dataset table\n");
+                    fclose(fp);
+                    return -1;
+                }
+            }
+            dset = &dsets_g[ndsets_g++];
+            memset(dset, 0, sizeof(*dset));
+            if(sscanf(line, "dataset %s %s ranks %d", dset->filename, dset->dset_name, &dset->ranks) != 3) {
+                fprintf(stderr, "Malformed dataset line: %s", line);
+                fclose(fp);
+                return -1;
+            }
+            continue;
+        }
+
+        if(!dset || sscanf(line, " %63s", key) != 1)
+            continue;
+        rest[0] = '\0';
+        {
+            char *p = strstr(line, key) + strlen(key);
+
+            strncpy(rest, p, sizeof(rest) - 1);
+            rest[sizeof(rest) - 1] = '\0';
+        }
+
+        /* Metric lines are "min max mean imbalance", keep the maximum over
+         * ranks */
+        if(!strcmp(key, "write_calls"))
+            sscanf(rest, "%*f %lf", &dset->write_calls);
+        else if(!strcmp(key, "write_bytes"))
+            sscanf(rest, "%*f %lf", &dset->write_bytes);
+        else if(!strcmp(key, "read_calls"))
+            sscanf(rest, "%*f %lf", &dset->read_calls);
+        else if(!strcmp(key, "read_bytes"))
+            sscanf(rest, "%*f %lf", &dset->read_bytes);
+        else if(!strcmp(key, "write_hist"))
+            parse_hist(rest, dset->write_hist);
+        else if(!strcmp(key, "read_hist"))
+            parse_hist(rest, dset->read_hist);
+        else if(!strcmp(key, "sel_count") || !strcmp(key, "sel_stride") || !strcmp(key, "sel_block")) {
+            char min_str[MAX_LINE];
+            char max_str[MAX_LINE];
+            double max_vals[SHAPE_MAX_RANK];
+
+            if(sscanf(rest, "%s %s", min_str, max_str) != 2)
+                continue;
+            if(!strcmp(key, "sel_count"))
+                dset->shape_rank = parse_dims(min_str, dset->count_min);
+            else if(!strcmp(key, "sel_block"))
+                parse_dims(min_str, dset->block_min);
+            else {
+                parse_dims(max_str, max_vals);
+                memcpy(dset->stride_max, max_vals, sizeof(max_vals));
+            }
+        }
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+
+/* Byte-weighted median bin of a histogram, or -1 if it is empty */
+static int
+dominant_bin(const double *hist)
+{
+    double total = 0.0;
+    double cum = 0.0;
+    int bin;
+
+    for(bin = 0; bin < HIST_NBINS; bin++)
+        total += hist[bin] * (double)(1ULL << bin);
+    if(total <= 0.0)
+        return -1;
+
+    for(bin = 0; bin < HIST_NBINS; bin++) {
+        cum += hist[bin] * (double)(1ULL << bin);
+        if(cum >= total / 2.0)
+            return bin;
+    }
+
+    return HIST_NBINS - 1;
+}
+
+
+static void
+print_size(double bytes)
+{
+    if(bytes >= MIB * KIB)
+        printf("%g GiB", bytes / (MIB * KIB));
+    else if(bytes >= MIB)
+        printf("%g MiB", bytes / MIB);
+    else if(bytes >= KIB)
+        printf("%g KiB", bytes / KIB);
+    else
+        printf("%g B", bytes);
+}
+
+
+static void
+print_hist(const char *name, const double *hist)
+{
+    double max = 0.0;
+    int bin;
+
+    for(bin = 0; bin < HIST_NBINS; bin++)
+        if(hist[bin] > max)
+            max = hist[bin];
+    if(max <= 0.0)
+        return;
+
+    printf("  %s request sizes:\n", name);
+    for(bin = 0; bin < HIST_NBINS; bin++)
+        if(hist[bin] > 0.0) {
+            int width = (int)(40.0 * hist[bin] / max);
+
+            printf("    [");
+            print_size((double)(1ULL << bin));
+            printf(", ");
+            print_size((double)(1ULL << (bin + 1)));
+            printf(")\t%10.0f ", hist[bin]);
+            while(width-- > 0)
+                putchar('#');
+            putchar('\n');
+        }
+}
+
+
+static const char *
+base_name(const char *path)
+{
+    const char *base = strrchr(path, '/');
+
+    return base ? base + 1 : path;
+}
+
+
+static void
+suggest_file(const char *filename)
+{
+    double hist[HIST_NBINS];
+    double size;
+    long long striping_unit;
+    long long cb_buffer_size;
+    long long threshold;
+    int bin;
+    size_t i;
+
+    /* Combine the write and read histograms of all datasets in this file */
+    memset(hist, 0, sizeof(hist));
+    for(i = 0; i < ndsets_g; i++)
+        if(!strcmp(dsets_g[i].filename, filename))
+            for(bin = 0; bin < HIST_NBINS; bin++)
+                hist[bin] += dsets_g[i].write_hist[bin] + dsets_g[i].read_hist[bin];
+
+    if((bin = dominant_bin(hist)) < 0)
+        return;
+    size = (double)(1ULL << bin);
+
+    striping_unit = ((long long)size / (64 * 1024)) * (64 * 1024);
+    if(striping_unit < (long long)MIB)
+        striping_unit = (long long)MIB;
+    if(striping_unit > 64 * (long long)MIB)
+        striping_unit = 64 * (long long)MIB;
+
+    cb_buffer_size = striping_unit;
+    while(cb_buffer_size < (long long)size && cb_buffer_size + striping_unit <= 128 * (long long)MIB)
+        cb_buffer_size += striping_unit;
+
+    threshold = (long long)(size / 2.0);
+    if(threshold < 1)
+        threshold = 1;
+
+    printf("file %s\n", filename);
+    printf("  dominant request size: [");
+    print_size(size);
+    printf(", ");
+    print_size(2.0 * size);
+    printf(")\n");
+    printf("  suggested:\n");
+    printf("    <striping_unit FileName=\"%s\">%lld</striping_unit>\n", base_name(filename), striping_unit);
+    printf("    <cb_buffer_size FileName=\"%s\">%lld</cb_buffer_size>\n", base_name(filename), cb_buffer_size);
+    printf("    <alignment FileName=\"%s\">%lld,%lld</alignment>\n", base_name(filename), threshold, striping_unit);
+}
+
+
+static void
+suggest_dset(const report_dset_t *dset)
+{
+    int d;
+
+    printf("dataset %s %s (%d ranks)\n", dset->filename, dset->dset_name, dset->ranks);
+    if(dset->write_calls > 0.0) {
+        printf("  writes: up to %.0f calls, ", dset->write_calls);
+        print_size(dset->write_bytes);
+        printf(" per rank\n");
+    }
+    if(dset->read_calls > 0.0) {
+        printf("  reads: up to %.0f calls, ", dset->read_calls);
+        print_size(dset->read_bytes);
+        printf(" per rank\n");
+    }
+    print_hist("write", dset->write_hist);
+    print_hist("read", dset->read_hist);
+
+    /* Chunk to the extent each rank selects: count * block along dimensions
+     * where the blocks are adjacent, a single block where they are strided */
+    if(dset->shape_rank > 0) {
+        printf("  suggested:\n");
+        printf("    <chunk FileName=\"%s\" VariableName=\"%s\">", base_name(dset->filename), base_name(dset->dset_name));
+        for(d = 0; d < dset->shape_rank; d++) {
+            double block = dset->block_min[d] > 0.0 ? dset->block_min[d] : 1.0;
+            double extent = dset->stride_max[d] <= block ? dset->count_min[d] * block : block;
+
+            printf("%s%.0f", d ? "," : "", extent > 0.0 ? extent : 1.0);
+        }
+        printf("</chunk>\n");
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    size_t i, j;
+
+    if(argc != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(read_stats(argv[1]) < 0)
+        return 1;
+
+    for(i = 0; i < ndsets_g; i++)
+        suggest_dset(&dsets_g[i]);
+
+    printf("\n");
+    for(i = 0; i < ndsets_g; i++) {
+        /* Once per file */
+        for(j = 0; j < i; j++)
+            if(!strcmp(dsets_g[j].filename, dsets_g[i].filename))
+                break;
+        if(j == i)
+            suggest_file(dsets_g[i].filename);
+    }
+
+    free(dsets_g);
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * h5tuner-top: shows the I/O progress of the processes on this node that run
+ * with H5TUNER_LIVE=1.  Every interval it reads the shared memory segments
+ * the H5Tuner library publishes (see autotuner_live.h), sums the counters of
+ * all processes per file, and prints the bytes and operations so far and
+ * the throughput over the last interval.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "autotuner_live.h"
+
+#define SHM_DIR "/dev/shm"
+#define MAX_PROCS 256
+#define MAX_FILES 1024
+#define SNAPSHOT_TRIES 10000
+
+typedef struct file_total_t {
+    const char *name;
+    int nprocs;
+    double write_ops;
+    double write_bytes;
+    double read_ops;
+    double read_bytes;
+    double write_rate;          /* Bytes/s over the last interval */
+    double read_rate;
+} file_total_t;
+
+static live_segment_t prev_g[MAX_PROCS];
+static int nprev_g = 0;
+static live_segment_t cur_g[MAX_PROCS];
+static int ncur_g = 0;
+
+
+static double
+wtime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9;
+}
+
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-d SECONDS] [-n COUNT]\n", prog);
+    fprintf(stderr, "Show the I/O progress of the processes on this node running with\n");
+    fprintf(stderr, "H5TUNER_LIVE=1, every SECONDS (default 2), COUNT times (default until\n");
+    fprintf(stderr, "interrupted).\n");
+}
+
+
+/* Copy a consistent snapshot of the segment.  Returns 0 on success and -1 if
+ * the writer kept it busy. */
+static int
+snapshot(const live_segment_t *seg, live_segment_t *copy)
+{
+    int tries;
+
+    for(tries = 0; tries < SNAPSHOT_TRIES; tries++) {
+        uint64_t seq1, seq2;
+
+        seq1 = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+        if(seq1 & 1)
+            continue;
+        memcpy(copy, (const void *)seg, sizeof(live_segment_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq2 = __atomic_load_n(&seg->seq, __ATOMIC_RELAXED);
+        if(seq1 == seq2)
+            return 0;
+    }
+
+    return -1;
+}
+
+
+/* Read the segments of all live processes into cur_g */
+static void
+read_segments(void)
+{
+    DIR *dir;
+    struct dirent *ent;
+    size_t prefix_len = strlen(LIVE_SHM_PREFIX) - 1;
+
+    ncur_g = 0;
+    if(NULL == (dir = opendir(SHM_DIR)))
+        return;
+
+    while((ent = readdir(dir)) && ncur_g < MAX_PROCS) {
+        char name[300];
+        struct stat st;
+        void *addr;
+        int fd;
+
+        /* LIVE_SHM_PREFIX without the leading '/' */
+        if(strncmp(ent->d_name, LIVE_SHM_PREFIX + 1, prefix_len) != 0)
+            continue;
+
+        snprintf(name, sizeof(name), "/%s", ent->d_name);
+        if((fd = shm_open(name, O_RDONLY, 0)) < 0)
+            continue;
+        if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(live_segment_t)) {
+            close(fd);
+            continue;
+        }
+        addr = mmap(NULL, sizeof(live_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(addr == MAP_FAILED)
+            continue;
+
+        if(snapshot((const live_segment_t *)addr, &cur_g[ncur_g]) == 0) {
+            live_segment_t *seg = &cur_g[ncur_g];
+            uint32_t i;
+
+            for(i = 0; i < LIVE_MAX_FILES; i++)
+                seg->files[i].name[LIVE_NAME_LEN - 1] = '\0';
+
+            /* Skip segments not yet set up, and those of processes that were
+             * killed before removing them */
+            if(!memcmp(seg->magic, LIVE_MAGIC, sizeof(LIVE_MAGIC)) && seg->version == LIVE_VERSION
+                    && seg->nfiles <= LIVE_MAX_FILES && !(kill((pid_t)seg->pid, 0) < 0 && errno == ESRCH))
+                ncur_g++;
+        }
+        munmap(addr, sizeof(live_segment_t));
+    }
+
+    closedir(dir);
+}
+
+
+static const live_file_t *
+find_prev(const live_segment_t *seg, const live_file_t *file)
+{
+    int p;
+    uint32_t i;
+
+    for(p = 0; p < nprev_g; p++)
+        if(prev_g[p].pid == seg->pid && prev_g[p].start_time == seg->start_time) {
+            for(i = 0; i < prev_g[p].nfiles; i++)
+                if(!strcmp(prev_g[p].files[i].name, file->name))
+                    return &prev_g[p].files[i];
+            break;
+        }
+
+    return NULL;
+}
+
+
+static int
+compare_totals(const void *a, const void *b)
+{
+    return strcmp(((const file_total_t *)a)->name, ((const file_total_t *)b)->name);
+}
+
+
+static void
+print_totals(double interval)
+{
+    static file_total_t totals[MAX_FILES];
+    int ntotals = 0;
+    double dropped = 0.0;
+    int p, t;
+    uint32_t i;
+
+    for(p = 0; p < ncur_g; p++) {
+        const live_segment_t *seg = &cur_g[p];
+
+        dropped += (double)seg->dropped;
+        for(i = 0; i < seg->nfiles; i++) {
+            const live_file_t *file = &seg->files[i];
+            const live_file_t *prev;
+
+            for(t = 0; t < ntotals; t++)
+                if(!strcmp(totals[t].name, file->name))
+                    break;
+            if(t == ntotals) {
+                if(ntotals == MAX_FILES)
+                    continue;
+                memset(&totals[t], 0, sizeof(file_total_t));
+                totals[t].name = file->name;
+                ntotals++;
+            }
+
+            totals[t].nprocs++;
+            totals[t].write_ops += (double)file->write_ops;
+            totals[t].write_bytes += (double)file->write_bytes;
+            totals[t].read_ops += (double)file->read_ops;
+            totals[t].read_bytes += (double)file->read_bytes;
+            if(interval > 0.0 && (prev = find_prev(seg, file))) {
+                totals[t].write_rate += (double)(file->write_bytes - prev->write_bytes) / interval;
+                totals[t].read_rate += (double)(file->read_bytes - prev->read_bytes) / interval;
+            }
+        }
+    }
+
+    qsort(totals, (size_t)ntotals, sizeof(file_total_t), compare_totals);
+
+    printf("h5tuner-top: %d processes, %d files, %.0f dropped updates\n\n", ncur_g, ntotals, dropped);
+    printf("%5s %12s %12s %10s %10s %12s %12s  %s\n", "PROCS", "WRITE_MB", "READ_MB", "WRITE_OPS",
+            "READ_OPS", "WRITE_MB/s", "READ_MB/s", "FILE");
+    for(t = 0; t < ntotals; t++)
+        printf("%5d %12.1f %12.1f %10.0f %10.0f %12.1f %12.1f  %s\n", totals[t].nprocs,
+                totals[t].write_bytes / 1048576.0, totals[t].read_bytes / 1048576.0, totals[t].write_ops,
+                totals[t].read_ops, totals[t].write_rate / 1048576.0, totals[t].read_rate / 1048576.0,
+                totals[t].name);
+    fflush(stdout);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    double delay = 2.0;
+    long count = 0;
+    long iter;
+    double sample_time = 0.0;
+    int clear;
+    int opt;
+
+    while((opt = getopt(argc, argv, "d:n:h")) != -1)
+        switch(opt) {
+            case 'd':
+                delay = strtod(optarg, NULL);
+                break;
+            case 'n':
+                count = strtol(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    if(optind != argc || delay <= 0.0 || count < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    clear = isatty(STDOUT_FILENO) && count != 1;
+
+    for(iter = 0; count == 0 || iter < count; iter++) {
+        struct timespec ts;
+        double now;
+
+        read_segments();
+        now = wtime();
+        if(clear)
+            printf("\033[H\033[2J");
+        else if(iter > 0)
+            printf("\n");
+        print_totals(iter > 0 ? now - sample_time : 0.0);
+        sample_time = now;
+
+        memcpy(prev_g, cur_g, (size_t)ncur_g * sizeof(live_segment_t));
+        nprev_g = ncur_g;
+
+        if(count != 0 && iter + 1 == count)
+            break;
+        ts.tv_sec = (time_t)delay;
+        ts.tv_nsec = (long)((delay - (double)ts.tv_sec) * 1.0e9);
+        nanosleep(&ts, NULL);
+    }
+
+    return 0;
+}
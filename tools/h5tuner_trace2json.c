@@ -0,0 +1,239 @@
+/*
+* Copyright by The HDF Group.
+* All rights reserved.
+*
+* This file is part of h5tuner. The full h5tuner copyright notice,
+* including terms governing use, modification, and redistribution, is
+* contained in the file COPYING, which can be found at the root of the
+* source code distribution tree.  If you do not have access to this file,
+* you may request a copy from help@hdfgroup.org.
+*/
+
+/*
+ * h5tuner-trace2json: merges the per-rank trace files written by the
+ * H5Tuner library (H5TUNER_TRACE=<prefix>) into one Chrome trace event
+ * JSON file, which can be loaded in chrome://tracing or Perfetto.  Each
+ * rank is shown as a process and each thread as a thread, and MPI-IO calls
+ * (H5TUNER_MPIIO=1) nest under the HDF5 call that made them.  Timestamps are
+ * converted to real time and shifted so the earliest event is at 0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "autotuner_trace.h"
+
+typedef struct trace_file_t {
+    const char *path;
+    trace_header_t header;
+    char **names;
+    uint32_t nnames;
+} trace_file_t;
+
+static const char *op_names_g[TRACE_NOPS] = TRACE_OP_NAMES;
+
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-o OUTPUT_FILE] TRACE_FILE...\n", prog);
+    fprintf(stderr, "Merge H5Tuner trace files (<H5TUNER_TRACE>.<rank>.trace) into Chrome\n");
+    fprintf(stderr, "trace event JSON, written to OUTPUT_FILE or standard output.\n");
+}
+
+
+/* Print a string as a JSON string literal */
+static void
+print_json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for(; *str; str++) {
+        if(*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if((unsigned char)*str < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char)*str);
+        else
+            fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+
+static FILE *
+open_trace(trace_file_t *tf)
+{
+    FILE *fp;
+
+    if(NULL == (fp = fopen(tf->path, "rb"))) {
+        fprintf(stderr, "Unable to open trace file %s\n", tf->path);
+        return NULL;
+    }
+    if(fread(&tf->header, sizeof(tf->header), 1, fp) != 1
+            || memcmp(tf->header.magic, TRACE_MAGIC, sizeof(tf->header.magic)) != 0) {
+        fprintf(stderr, "%s is not an H5Tuner trace file\n", tf->path);
+        fclose(fp);
+        return NULL;
+    }
+    if(tf->header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s has unsupported trace version %u\n", tf->path, (unsigned)tf->header.version);
+        fclose(fp);
+        return NULL;
+    }
+
+    return fp;
+}
+
+
+/* Read the next event, handling any name records before it.  Returns 1 if
+ * an event was read, 0 at end of file and -1 on error. */
+static int
+read_event(FILE *fp, trace_file_t *tf, trace_record_t *rec)
+{
+    uint32_t tag;
+
+    while(fread(&tag, sizeof(tag), 1, fp) == 1) {
+        if(tag == TRACE_TAG_EVENT)
+            return fread(rec, sizeof(*rec), 1, fp) == 1 ? 1 : -1;
+        else if(tag == TRACE_TAG_NAME) {
+            uint32_t id, len;
+
+            if(fread(&id, sizeof(id), 1, fp) != 1 || fread(&len, sizeof(len), 1, fp) != 1)
+                return -1;
+            if(id >= tf->nnames) {
+                char **new_names;
+
+                if(NULL == (new_names = (char **)realloc(tf->names, (id + 1) * sizeof(char *))))
+                    return -1;
+                memset(new_names + tf->nnames, 0, (id + 1 - tf->nnames) * sizeof(char *));
+                tf->names = new_names;
+                tf->nnames = id + 1;
+            }
+            free(tf->names[id]);
+            if(NULL == (tf->names[id] = (char *)malloc(len + 1)))
+                return -1;
+            if(fread(tf->names[id], 1, len, fp) != len)
+                return -1;
+            tf->names[id][len] = '\0';
+        }
+        else
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static const char *
+lookup_name(const trace_file_t *tf, int32_t id)
+{
+    if(id < 0 || (uint32_t)id >= tf->nnames || !tf->names[id])
+        return NULL;
+
+    return tf->names[id];
+}
+
+
+int
+main(int argc, char **argv)
+{
+    trace_file_t *files = NULL;
+    int nfiles;
+    FILE *out = stdout;
+    double t0 = -1.0;
+    int first = 1;
+    int argi = 1;
+    int i;
+    int ret = 0;
+
+    if(argc > 2 && !strcmp(argv[1], "-o")) {
+        if(NULL == (out = fopen(argv[2], "w"))) {
+            fprintf(stderr, "Unable to open output file %s\n", argv[2]);
+            return 1;
+        }
+        argi = 3;
+    }
+    if(argi >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    nfiles = argc - argi;
+    if(NULL == (files = (trace_file_t *)calloc((size_t)nfiles, sizeof(trace_file_t)))) {
+        fprintf(stderr, "Unable to allocate trace file table\n");
+        return 1;
+    }
+
+    /* First pass: find the earliest event over all ranks */
+    for(i = 0; i < nfiles; i++) {
+        trace_record_t rec;
+        FILE *fp;
+        int r;
+
+        files[i].path = argv[argi + i];
+        if(NULL == (fp = open_trace(&files[i]))) {
+            ret = 1;
+            goto done;
+        }
+        while((r = read_event(fp, &files[i], &rec)) > 0) {
+            double t = rec.start + files[i].header.clock_offset;
+
+            if(t0 < 0.0 || t < t0)
+                t0 = t;
+        }
+        fclose(fp);
+        if(r < 0)
+            fprintf(stderr, "Truncated or corrupt trace file %s, using the events before the error\n", files[i].path);
+    }
+
+    /* Second pass: write events */
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(i = 0; i < nfiles; i++) {
+        trace_record_t rec;
+        FILE *fp;
+
+        if(NULL == (fp = open_trace(&files[i]))) {
+            ret = 1;
+            goto done;
+        }
+
+        fprintf(out, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}", first ? "" : ",\n", (int)files[i].header.rank, (int)files[i].header.rank);
+        first = 0;
+
+        while(read_event(fp, &files[i], &rec) > 0) {
+            const char *file_name = lookup_name(&files[i], rec.file_name_id);
+            const char *dset_name = lookup_name(&files[i], rec.dset_name_id);
+            const char *op_name = rec.op < TRACE_NOPS ? op_names_g[rec.op] : "unknown";
+
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%llu,\"args\":{",
+                    op_name, rec.op < TRACE_NHDF5_OPS ? "hdf5" : "mpiio", (rec.start + files[i].header.clock_offset - t0) * 1.0e6, rec.duration * 1.0e6,
+                    (int)files[i].header.rank, (unsigned long long)rec.tid);
+            fprintf(out, "\"bytes\":%llu", (unsigned long long)rec.bytes);
+            if(file_name) {
+                fprintf(out, ",\"file\":");
+                print_json_string(out, file_name);
+            }
+            if(dset_name) {
+                fprintf(out, ",\"dataset\":");
+                print_json_string(out, dset_name);
+            }
+            fprintf(out, "}}");
+        }
+        fclose(fp);
+    }
+    fprintf(out, "\n]}\n");
+
+done:
+    if(out != stdout)
+        fclose(out);
+
+    for(i = 0; i < nfiles; i++) {
+        uint32_t n;
+
+        for(n = 0; n < files[i].nnames; n++)
+            free(files[i].names[n]);
+        free(files[i].names);
+    }
+    free(files);
+
+    return ret;
+}